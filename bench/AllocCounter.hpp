@@ -0,0 +1,47 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <malloc.h>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+/*
+ * Replaces global operator new and delete, so that a benchmark can count
+ * heap allocations and live heap bytes. Must be included by exactly one
+ * translation unit of a benchmark.
+ */
+
+// GCC cannot see that the pointers it complains about come from malloc below.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+namespace alloc_counter {
+    uint64_t allocations = 0;
+    int64_t heap_bytes = 0;
+}
+
+void *operator new(size_t size) {
+    void *p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    alloc_counter::allocations++;
+    alloc_counter::heap_bytes += malloc_usable_size(p);
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p == nullptr) return;
+    alloc_counter::heap_bytes -= malloc_usable_size(p);
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    operator delete(p);
+}
+
+#endif //ALLOC_COUNTER_HPP
@@ -0,0 +1,83 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef BOTS_HPP
+#define BOTS_HPP
+
+#include <string>
+#include <vector>
+
+#include "../server/Game.hpp"
+
+/*
+ * Players of benchmarks. They steer clear of trails looking a few steps
+ * ahead (as a careful human player would) so that games last.
+ */
+namespace bots {
+    /// Connects @p num_players players to @p game (unless connected already) and
+    /// starts a game. All of them join before any gets ready, as the game starts
+    /// when everybody is ready.
+    inline void startGame(Game &game, int num_players) {
+        std::vector<struct sockaddr_in6> addrs(num_players);
+        for (int i = 0; i < num_players; i++) {
+            addrs[i].sin6_family = AF_INET6;
+            addrs[i].sin6_port = htons(10000 + i);
+            client_mess mess{1, 0, 0, "player" + std::to_string(i), &addrs[i], CAPABILITY_WIDE};
+            game.handleClient(ClientKey(&addrs[i]), mess, 0);
+        }
+        for (int i = 0; i < num_players; i++) {
+            client_mess mess{1, 1, 0, "player" + std::to_string(i), &addrs[i], CAPABILITY_WIDE};
+            ClientKey key(&addrs[i]);
+            game.handleClient(key, mess, 0);
+            game.waitingRoomRoutine(key);
+        }
+        if (game.isWaitingRoom()) {
+            syserr("The game has not started.");
+        }
+    }
+
+    /// Number of steps (up to LOOKAHEAD) @p player can make turning by @p turn every round.
+    inline int freeSteps(const Game &game, const Player &player, int turn) {
+        constexpr int LOOKAHEAD = 40;
+        Position pos = player.pos;
+        int direction = player.direction;
+        auto pixel = pos.pixel();
+        const Board &board = *game.board;
+    
+        for (int i = 0; i < LOOKAHEAD; i++) {
+            direction = (direction + turn + 360) % 360;
+            pos.step(direction);
+            auto next = pos.pixel();
+            if (next == pixel) continue;
+            if (next.first < 0 || next.first >= board.max_x || next.second < 0 || next.second >= board.max_y ||
+                board.eaten_pixels.contains(next)) {
+                return i;
+            }
+            pixel = next;
+        }
+        return LOOKAHEAD;
+    }
+    
+    /// Keeps the current turn of @p player unless another one leads further.
+    inline void steer(const Game &game, Player &player, uint32_t random) {
+        const int turns[] = {0, game.turning_speed, -game.turning_speed};
+        uint8_t &current = player.client->last_turn_direction;
+    
+        int best = freeSteps(game, player, turns[current]);
+        // change the turn sometimes, so that trails are not straight lines
+        uint8_t first = random % 16 == 0 ? (uint8_t) (random / 16 % 3) : current;
+        for (uint8_t k = 0; k < 3; k++) {
+            uint8_t turn = (first + k) % 3;
+            int steps = freeSteps(game, player, turns[turn]);
+            if (steps > best || (turn == first && steps == best)) {
+                best = steps;
+                current = turn;
+            }
+        }
+    }
+}
+
+#endif //BOTS_HPP
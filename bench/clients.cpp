@@ -0,0 +1,115 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares identifying the client of a datagram by a string made with
+ * inet_ntop and looked up in an unordered_map (as done before) with the
+ * binary client key and the flat table. Clients are half IPv4 (mapped) and
+ * half IPv6, every datagram comes from a random known client.
+ * Reports time and heap allocations per lookup.
+ *
+ * Usage: ./bench-clients [-n clients] [-l lookups]
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "../utils.hpp"
+#include "../server/ClientKey.hpp"
+#include "../server/FlatTable.hpp"
+#include "AllocCounter.hpp"
+
+std::string legacyClientId(const struct sockaddr_in6 *client_address) {
+    char peer_addr[101];
+    inet_ntop(AF_INET, &client_address->sin6_addr, peer_addr, 100);
+    return toSocket(peer_addr, ntohs(client_address->sin6_port));
+}
+
+template <class Lookup>
+void run(const char *name, const std::vector<struct sockaddr_in6> &datagrams, Lookup lookup) {
+    using clock = std::chrono::steady_clock;
+
+    uint64_t allocations_before = alloc_counter::allocations;
+    uint64_t found = 0;
+    auto start = clock::now();
+
+    for (auto &addr: datagrams) {
+        found += lookup(&addr);
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    std::cout << name << ": " << ns / (double) datagrams.size() << " ns per lookup, "
+              << (double) (alloc_counter::allocations - allocations_before) / (double) datagrams.size()
+              << " allocations per lookup (" << found << " found)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int clients = 25;
+    int lookups = 10000000;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:l:")) != -1)
+        switch (c) {
+            case 'n':
+                clients = parseNumericParam(optarg);
+                break;
+            case 'l':
+                lookups = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-clients [-n clients] [-l lookups]");
+        }
+
+    if (clients <= 0 || lookups <= 0) {
+        syserr("Parameters should be positive.");
+    }
+
+    std::mt19937 gen(2021);
+    std::vector<struct sockaddr_in6> addrs(clients);
+    for (int i = 0; i < clients; i++) {
+        struct sockaddr_in6 &addr = addrs[i];
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(1024 + gen() % 60000);
+        if (i % 2 == 0) {
+            // IPv4-mapped address
+            addr.sin6_addr.s6_addr[10] = addr.sin6_addr.s6_addr[11] = 0xff;
+            for (int j = 12; j < 16; j++) addr.sin6_addr.s6_addr[j] = gen();
+        } else {
+            addr.sin6_addr.s6_addr[0] = 0x20;
+            addr.sin6_addr.s6_addr[1] = 0x01;
+            for (int j = 2; j < 16; j++) addr.sin6_addr.s6_addr[j] = gen();
+        }
+    }
+
+    std::vector<struct sockaddr_in6> datagrams(lookups);
+    for (auto &addr: datagrams) {
+        addr = addrs[gen() % clients];
+    }
+
+    std::unordered_map<std::string, int> legacy;
+    FlatTable<ClientKey, int> table;
+    for (int i = 0; i < clients; i++) {
+        legacy[legacyClientId(&addrs[i])] = i;
+        table.insert(ClientKey(&addrs[i]), i);
+    }
+
+    std::cout << clients << " clients, " << lookups << " lookups" << std::endl;
+    std::cout << "distinct string ids: " << legacy.size() << ", distinct keys: " << table.size() << std::endl;
+
+    run("inet_ntop + unordered_map<string>", datagrams, [&](const struct sockaddr_in6 *addr) {
+        return legacy.find(legacyClientId(addr)) != legacy.end();
+    });
+    run("ClientKey + FlatTable", datagrams, [&](const struct sockaddr_in6 *addr) {
+        return table.find(ClientKey(addr)) != nullptr;
+    });
+
+    return 0;
+}
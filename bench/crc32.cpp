@@ -0,0 +1,140 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Checks that all implementations of CRC-32 give the same results as the
+ * bytewise one (on random buffers of every length up to 2048 bytes) and
+ * measures their throughput on event records of realistic sizes (13 to 64
+ * bytes) and on full datagrams of 548 bytes.
+ * Exits with status 1 if any implementation differs.
+ *
+ * Usage: ./bench-crc32 [-m megabytes]
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+
+constexpr size_t DATAGRAM_SIZE = 548;
+
+struct Implementation {
+    const char *name;
+    crc::update_t update;
+};
+
+std::vector<Implementation> implementations() {
+    std::vector<Implementation> res = {
+            {"bytewise", crc::bytewise},
+            {"slicing-by-8", crc::slicing8},
+    };
+#ifdef CRC32_HAVE_PCLMUL
+    if (crc::hasPclmul()) {
+        res.push_back({"pclmul", crc::pclmul});
+    }
+#endif
+    res.push_back({"crc32 (dispatched)", crc::dispatched});
+    return res;
+}
+
+bool verify(std::mt19937 &gen) {
+    std::vector<uint8_t> data(2048);
+    for (auto &b: data) b = gen();
+
+    bool ok = true;
+    for (size_t len = 0; len <= data.size(); len++) {
+        for (size_t offset: {0, 1, 7}) {
+            if (offset + len > data.size()) continue;
+            uint32_t expected = ~crc::bytewise(~0U, data.data() + offset, len);
+
+            for (auto &impl: implementations()) {
+                if (~impl.update(~0U, data.data() + offset, len) != expected) {
+                    std::cout << impl.name << " differs on " << len << " bytes at offset " << offset << std::endl;
+                    ok = false;
+                }
+            }
+            if (crc32(data.data() + offset, len) != expected) {
+                std::cout << "crc32 differs on " << len << " bytes at offset " << offset << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+/// Computes checksums of consecutive records of @p sizes in @p data.
+void measure(const char *workload, const std::vector<uint8_t> &data, const std::vector<size_t> &sizes) {
+    using clock = std::chrono::steady_clock;
+
+    std::cout << workload << ":" << std::endl;
+    for (auto &impl: implementations()) {
+        uint32_t sink = 0;
+        auto start = clock::now();
+
+        size_t pos = 0;
+        for (size_t size: sizes) {
+            sink ^= ~impl.update(~0U, data.data() + pos, size);
+            pos += size;
+        }
+
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        std::cout << "    " << impl.name << ": " << (double) pos / seconds / 1e6 << " MB/s, "
+                  << seconds * 1e9 / (double) sizes.size() << " ns per record (" << sink % 10 << ")" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int megabytes = 64;
+    int c;
+
+    while ((c = getopt(argc, argv, "m:")) != -1)
+        switch (c) {
+            case 'm':
+                megabytes = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-crc32 [-m megabytes]");
+        }
+
+    if (megabytes <= 0) {
+        syserr("Parameters should be positive.");
+    }
+
+    std::mt19937 gen(2021);
+
+    std::cout << "implementation chosen for this CPU: "
+              << (crc::hasPclmul() ? "pclmul" : "slicing-by-8") << std::endl;
+    bool ok = verify(gen);
+    std::cout << "results " << (ok ? "identical" : "DIFFER") << std::endl;
+
+    size_t total = (size_t) megabytes << 20;
+    std::vector<uint8_t> data(total);
+    for (auto &b: data) b = gen();
+
+    // checksummed parts of events: GAME_OVER (9), PLAYER_ELIMINATED (10),
+    // PIXEL (18, most of them) and NEW_GAME with a few names (up to 64)
+    std::vector<size_t> events, datagrams;
+    for (size_t pos = 0; ; ) {
+        uint32_t r = gen() % 100;
+        size_t size = r < 85 ? 18 : (r < 92 ? 10 : (r < 96 ? 9 : 13 + gen() % 52));
+        if (pos + size > total) break;
+        events.push_back(size);
+        pos += size;
+    }
+    for (size_t pos = 0; pos + DATAGRAM_SIZE <= total; pos += DATAGRAM_SIZE) {
+        datagrams.push_back(DATAGRAM_SIZE);
+    }
+
+    measure("event records", data, events);
+    measure("datagrams of 548 bytes", data, datagrams);
+
+    return ok ? 0 : 1;
+}
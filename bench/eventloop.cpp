@@ -0,0 +1,207 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares backends of the server's event loop. A client thread floods
+ * a socket on the loopback interface with datagrams of the size of client
+ * messages, the loop answers every datagram with one datagram of the size of
+ * a small event datagram and ticks a timer like a room does. Reports received
+ * and sent datagrams per second and the jitter of ticks, i.e. how much time
+ * between consecutive ticks differed from the period.
+ *
+ * Usage: ./bench-eventloop [-d seconds] [-v ticks per second] [-b backend]
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../utils.hpp"
+#include "../server/EventLoop.hpp"
+#include "../server/UringLoop.hpp"
+#include "../server/Histogram.hpp"
+
+constexpr int CLIENT_MESS_SIZE = 33;
+constexpr int RESPONSE_SIZE = 26;
+
+int openSocket(uint16_t port) {
+    int sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) syserr("socket");
+
+    struct sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_loopback;
+    address.sin6_port = htons(port);
+    if (bind(sock, (struct sockaddr *) &address, sizeof(address)) < 0) syserr("bind");
+
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) != 0) syserr("fcntl");
+    return sock;
+}
+
+uint16_t portOf(int sock) {
+    struct sockaddr_in6 address{};
+    socklen_t len = sizeof(address);
+    getsockname(sock, (struct sockaddr *) &address, &len);
+    return ntohs(address.sin6_port);
+}
+
+/// Floods port @p port with datagrams until @p done, draining responses.
+void flood(uint16_t port, const std::atomic<bool> &done, uint64_t &responses) {
+    int sock = openSocket(0);
+
+    struct sockaddr_in6 server{};
+    server.sin6_family = AF_INET6;
+    server.sin6_addr = in6addr_loopback;
+    server.sin6_port = htons(port);
+
+    char mess[CLIENT_MESS_SIZE] = {};
+    std::vector<struct mmsghdr> msgs(RECV_BATCH_SIZE);
+    struct iovec iov{mess, sizeof(mess)};
+    for (auto &msg: msgs) {
+        msg.msg_hdr.msg_name = &server;
+        msg.msg_hdr.msg_namelen = sizeof(server);
+        msg.msg_hdr.msg_iov = &iov;
+        msg.msg_hdr.msg_iovlen = 1;
+    }
+
+    Receiver receiver;
+    IOStats stats;
+    while (!done.load(std::memory_order_relaxed)) {
+        sendmmsg(sock, msgs.data(), msgs.size(), MSG_DONTWAIT);
+        while (receiver.receive(sock, stats) > 0) {}
+    }
+    responses = stats.datagrams_in;
+    close(sock);
+}
+
+class EchoHandler : public EventLoop::Handler {
+    EventLoop &loop;
+    Sender sender;
+    IOStats &stats;
+    long period;
+    std::chrono::steady_clock::time_point end, last_tick;
+    char response[RESPONSE_SIZE] = {};
+
+public:
+    Histogram jitter;
+    uint64_t ticks = 0;
+
+    EchoHandler(EventLoop &loop_p, IOStats &stats_p, long period_p, int seconds) :
+            loop(loop_p), stats(stats_p), period(period_p) {
+        sender.init(&loop, &stats);
+        last_tick = std::chrono::steady_clock::now();
+        end = last_tick + std::chrono::seconds(seconds);
+    }
+
+    void onTimer(size_t, const Tick &tick) override {
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_tick).count();
+        last_tick = now;
+        ticks += tick.rounds;
+
+        int64_t expected = period * (int64_t) tick.rounds;
+        jitter.record(elapsed > expected ? elapsed - expected : expected - elapsed);
+
+        if (now >= end) {
+            loop.stop();
+        }
+    }
+
+    void onDatagram(char *, int, struct sockaddr_in6 *addr) override {
+        sender.send(response, sizeof(response), *addr);
+    }
+
+    void onWakeup() override {}
+
+    void onBatchEnd() override {
+        sender.flush();
+    }
+};
+
+void run(const std::string &backend, int seconds, long rounds_per_sec) {
+    int sock = openSocket(0);
+    int event_fd = eventfd(0, EFD_NONBLOCK);
+    IOStats stats;
+
+    std::unique_ptr<EventLoop> loop;
+    if (backend == "io_uring") {
+        loop = std::make_unique<UringLoop>(sock, event_fd, stats);
+    } else {
+        loop = std::make_unique<PollLoop>(sock, event_fd, stats);
+    }
+
+    long period = SECOND / rounds_per_sec;
+    loop->addTimer(period, CatchUpPolicy::BURST);
+    EchoHandler handler(*loop, stats, period, seconds);
+
+    std::atomic<bool> done(false);
+    uint64_t responses = 0;
+    std::thread client(flood, portOf(sock), std::ref(done), std::ref(responses));
+
+    auto start = std::chrono::steady_clock::now();
+    loop->run(handler);
+    double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    done.store(true);
+    client.join();
+
+    std::cout << backend << ": "
+              << (uint64_t) ((double) stats.datagrams_in / duration) << " datagrams in/s, "
+              << (uint64_t) ((double) stats.datagrams_out / duration) << " out/s ("
+              << (uint64_t) ((double) responses / duration) << " received by the client), "
+              << (double) (stats.recv_calls + stats.send_calls) / (double) (stats.datagrams_in + 1)
+              << " system calls per datagram" << std::endl
+              << "    " << handler.ticks << " ticks, jitter p50 " << handler.jitter.percentile(0.5) / 1000
+              << " us, p99 " << handler.jitter.percentile(0.99) / 1000
+              << " us, max " << handler.jitter.max() / 1000 << " us" << std::endl;
+
+    loop.reset();
+    close(event_fd);
+    close(sock);
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = 3;
+    long rounds_per_sec = 50;
+    std::string backend;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:v:b:")) != -1)
+        switch (c) {
+            case 'd':
+                seconds = parseNumericParam(optarg);
+                break;
+            case 'v':
+                rounds_per_sec = parseNumericParam(optarg);
+                break;
+            case 'b':
+                backend = (std::string) optarg;
+                break;
+            default:
+                syserr("Usage: ./bench-eventloop [-d seconds] [-v ticks per second] [-b backend]");
+        }
+
+    if (seconds <= 0 || rounds_per_sec <= 0 || rounds_per_sec > 500) {
+        syserr("Parameters should be positive (and there are at most 500 ticks per second).");
+    }
+
+    std::cout << seconds << " s per backend, " << rounds_per_sec << " ticks per second" << std::endl;
+
+    if (backend.empty() || backend == "poll") run("poll", seconds, rounds_per_sec);
+    if (backend.empty() || backend == "io_uring") run("io_uring", seconds, rounds_per_sec);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares the event log of a board with the vector of shared pointers to
+ * separately allocated events used before. Every tick each player produces
+ * a PIXEL event and every tick all new events are packed into datagrams.
+ * Reports heap allocations per tick, heap bytes per event and time per event.
+ *
+ * Usage: ./bench-events [-n players] [-t ticks] [-g games]
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../utils.hpp"
+#include "../server/Event.hpp"
+#include "AllocCounter.hpp"
+
+/// Event as it was stored before: a separately allocated record.
+struct LegacyEvent {
+    uint32_t total_size;
+    char *content;
+
+    LegacyEvent(const std::vector<std::string> &names, uint32_t maxx, uint32_t maxy) {
+        uint32_t len = 13;
+        for (auto &name: names) {
+            len += name.size() + 1;
+        }
+        total_size = len + 8;
+        content = new char[total_size];
+
+        put_uint32(content, len);
+        put_uint32(content + 4, 0);
+        put_uint8(content + 8, 0);
+        put_uint32(content + 9, maxx);
+        put_uint32(content + 13, maxy);
+
+        uint32_t ind = 17;
+        for (auto &name: names) {
+            std::strcpy(content + ind, name.c_str());
+            ind += name.size() + 1;
+        }
+        put_uint32(content + ind, crc32(content, ind));
+    }
+
+    LegacyEvent(uint32_t event_num, uint8_t player_number, uint32_t x, uint32_t y) {
+        total_size = 22;
+        content = new char[total_size];
+
+        put_uint32(content, 14);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, 1);
+        put_uint8(content + 9, player_number);
+        put_uint32(content + 10, x);
+        put_uint32(content + 14, y);
+        put_uint32(content + 18, crc32(content, 18));
+    }
+
+    ~LegacyEvent() {
+        delete[] content;
+    }
+};
+
+struct LegacyLog {
+    std::vector<std::shared_ptr<LegacyEvent>> events;
+
+    size_t size() const { return events.size(); }
+    void clear() { events.clear(); }
+
+    void pushNewGame(const std::vector<std::string> &names, uint32_t maxx, uint32_t maxy) {
+        events.push_back(std::make_shared<LegacyEvent>(names, maxx, maxy));
+    }
+
+    void pushPixel(uint8_t player_number, uint32_t x, uint32_t y) {
+        events.push_back(std::make_shared<LegacyEvent>(events.size(), player_number, x, y));
+    }
+
+    uint32_t copy(unsigned int &from, char *dst, uint32_t capacity) const {
+        uint32_t len = 0;
+        while (from < events.size() && len + events[from]->total_size <= capacity) {
+            std::memcpy(dst + len, events[from]->content, events[from]->total_size);
+            len += events[from]->total_size;
+            from++;
+        }
+        return len;
+    }
+};
+
+template <class Log>
+void run(const char *name, int players, int ticks, int games) {
+    using clock = std::chrono::steady_clock;
+    std::vector<std::string> names;
+    for (int i = 0; i < players; i++) {
+        names.push_back("player" + std::to_string(i));
+    }
+
+    char buffer[548];
+    uint64_t datagram_bytes = 0;
+    uint64_t steady_allocations = 0;
+    int64_t heap_per_game = 0;
+    double ns = 0;
+
+    int64_t heap_before = alloc_counter::heap_bytes;
+    auto log = std::make_unique<Log>();
+
+    for (int g = 0; g < games; g++) {
+        uint64_t allocations_before = alloc_counter::allocations;
+        auto start = clock::now();
+
+        log->clear();
+        log->pushNewGame(names, 4000, 4000);
+        unsigned int broadcast = 0;
+
+        for (int t = 0; t < ticks; t++) {
+            for (int p = 0; p < players; p++) {
+                log->pushPixel(p, t, p);
+            }
+            uint32_t len;
+            while ((len = log->copy(broadcast, buffer, sizeof(buffer))) > 0) {
+                datagram_bytes += len;
+            }
+        }
+
+        ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if (g == games - 1) {
+            steady_allocations = alloc_counter::allocations - allocations_before;
+            heap_per_game = alloc_counter::heap_bytes - heap_before;
+        }
+    }
+
+    uint64_t events = (uint64_t) ticks * players + 1;
+    std::cout << name << ": "
+              << (double) steady_allocations / ticks << " allocations per tick, "
+              << (double) heap_per_game / (double) events << " heap bytes per event, "
+              << ns / (double) (events * games) << " ns per event ("
+              << datagram_bytes / games << " bytes of datagrams per game)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int players = 25;
+    int ticks   = 20000;
+    int games   = 3;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:t:g:")) != -1)
+        switch (c) {
+            case 'n':
+                players = parseNumericParam(optarg);
+                break;
+            case 't':
+                ticks = parseNumericParam(optarg);
+                break;
+            case 'g':
+                games = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-events [-n players] [-t ticks] [-g games]");
+        }
+
+    if (players <= 0 || players > 256 || ticks <= 0 || games <= 0) {
+        syserr("Parameters should be positive (and there are at most 256 players).");
+    }
+
+    std::cout << players << " players, " << ticks << " ticks per game, "
+              << games << " games (stats of the last game)" << std::endl;
+
+    run<LegacyLog>("vector<shared_ptr<Event>>", players, ticks, games);
+    run<EventLog>("EventLog", players, ticks, games);
+
+    return 0;
+}
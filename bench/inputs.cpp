@@ -0,0 +1,181 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares observers following a game through events (as done before) and
+ * through the input stream, simulating the game themselves. Both are sent the
+ * new records of their stream after every round, as broadcast by the server;
+ * their GUI lines have to be identical. Reports bytes per round of both
+ * streams, without and with UDP/IPv6 headers. Then a TICK of the input stream
+ * is tampered with on its way to a third observer, which has to notice it at
+ * the next CHECKSUM and fall back to events.
+ * Exits with status 1 if the GUI lines differ or the fallback does not happen.
+ *
+ * Usage: ./bench-inputs [-w n] [-h n] [-n players] [-r rounds]
+ */
+
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../client/ClientState.hpp"
+#include "Bots.hpp"
+
+/// UDP and IPv6 headers of a datagram
+constexpr uint64_t HEADERS_SIZE = 48;
+
+struct Stream {
+    uint64_t bytes = 0;
+    uint64_t datagrams = 0;
+    std::vector<std::string> lines;
+};
+
+/// Takes GUI lines of @p observer.
+void takeLines(ClientState &observer, std::vector<std::string> &lines) {
+    while (!observer.events.empty()) {
+        lines.push_back(observer.events.front());
+        observer.events.pop();
+    }
+}
+
+/// Flips the turn of player @p player_num in the first TICK record of @p datagram.
+bool tamper(char *datagram, int len, size_t player_num) {
+    for (int pos = 4; pos + 13 <= len; ) {
+        uint32_t record_len = get_uint32(datagram + pos);
+        if (get_uint8(datagram + pos + 8) == EVENT_TICK) {
+            char *turn = datagram + pos + 9 + player_num / 4;
+            *turn = (char) (*turn ^ 1 << (2 * (player_num % 4)));
+            put_uint32(datagram + pos + 4 + record_len, crc32(datagram + pos, record_len + 4));
+            return true;
+        }
+        pos += (int) record_len + 8;
+    }
+    return false;
+}
+
+/// Sends new records of a stream of @p game to @p observers.
+void broadcast(Game &game, bool input_stream, std::vector<ClientState *> observers, Stream &stream) {
+    char buffer[MAX_DATAGRAM_SIZE];
+    int &next = game.board->toBroadcast(input_stream);
+    unsigned int from = next;
+    while (from < game.board->log(input_stream).size()) {
+        int len;
+        const char *datagram = game.getDatagram(from, len, buffer, input_stream);
+        for (ClientState *observer: observers) {
+            observer->parseMessage(datagram, len);
+        }
+        stream.bytes += len;
+        stream.datagrams++;
+    }
+    next = (int) from;
+}
+
+void report(const char *name, const Stream &stream, int rounds) {
+    std::cout << "    " << name << ": " << stream.bytes << " bytes in " << stream.datagrams << " datagrams, "
+              << (double) stream.bytes / rounds << " B/round, "
+              << (double) (stream.bytes + stream.datagrams * HEADERS_SIZE) / rounds << " B/round with headers"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int width = 2000, height = 2000;
+    int num_players = 10;
+    int rounds = 4000;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:h:n:r:")) != -1)
+        switch (c) {
+            case 'w':
+                width = parseNumericParam(optarg);
+                break;
+            case 'h':
+                height = parseNumericParam(optarg);
+                break;
+            case 'n':
+                num_players = parseNumericParam(optarg);
+                break;
+            case 'r':
+                rounds = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-inputs [-w n] [-h n] [-n players] [-r rounds]");
+        }
+
+    if (width <= 0 || height <= 0 || rounds <= 0 || num_players < 2 || num_players > MAX_PLAYERS) {
+        syserr("Parameters should be positive (2 to 2048 players).");
+    }
+
+    Game game(6, width, height, 2021, MovementMode::FIXED, std::max(num_players, V1_MAX_CLIENTS));
+    // observers below are not clients of the game
+    game.keep_inputs = true;
+    bots::startGame(game, num_players);
+
+    ClientState events_observer("", 1);
+    ClientState inputs_observer("", 2, CAPABILITY_INPUTS);
+    ClientState tampered_observer("", 3, CAPABILITY_INPUTS);
+    Stream events, inputs;
+
+    Random turns(77);
+    int played = 0;
+    int tamper_round = rounds / 2;
+    bool tampered = false;
+    broadcast(game, false, {&events_observer}, events);
+    broadcast(game, true, {&inputs_observer, &tampered_observer}, inputs);
+    for (; played < rounds && !game.isWaitingRoom(); played++) {
+        for (auto &player: game.players) {
+            bots::steer(game, *player, turns.rand());
+        }
+        game.doRound();
+
+        broadcast(game, false, {&events_observer}, events);
+        if (played < tamper_round || tampered) {
+            broadcast(game, true, {&inputs_observer, &tampered_observer}, inputs);
+            continue;
+        }
+
+        // the tampered observer gets the same records with a player turning otherwise
+        int &next = game.board->toBroadcast(true);
+        unsigned int from = next;
+        char buffer[MAX_DATAGRAM_SIZE];
+        while (from < game.board->inputs.size()) {
+            int len;
+            const char *datagram = game.getDatagram(from, len, buffer, true);
+            inputs_observer.parseMessage(datagram, len);
+            inputs.bytes += len;
+            inputs.datagrams++;
+
+            char copy[MAX_DATAGRAM_SIZE];
+            std::memcpy(copy, datagram, len);
+            for (auto &player: game.players) {
+                if (!player->eliminated && !tampered) {
+                    tampered = tamper(copy, len, player->player_num);
+                }
+            }
+            tampered_observer.parseMessage(copy, len);
+        }
+        next = (int) from;
+    }
+    takeLines(events_observer, events.lines);
+    takeLines(inputs_observer, inputs.lines);
+
+    bool same = events.lines == inputs.lines;
+    std::cout << num_players << " players, " << played << " rounds" << (game.isWaitingRoom() ? " (game over)" : "")
+              << ", " << events.lines.size() << " GUI lines " << (same ? "identical" : "DIFFER") << ":" << std::endl;
+    report("events", events, played);
+    report("inputs", inputs, played);
+    std::cout << "    inputs/events: " << (double) inputs.bytes / (double) events.bytes << std::endl;
+
+    bool fallback = !tampered || !tampered_observer.simulatesInputs();
+    if (tampered) {
+        std::cout << "tampered TICK after round " << tamper_round << ": "
+                  << (fallback ? "detected, fell back to events" : "NOT DETECTED") << std::endl;
+    }
+
+    return same && fallback ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Checks and compares representations of positions of players. On every
+ * recorded seed a player is placed as by Player::init and moves for a number
+ * of steps, turning as decided by the generator. Pixels visited with
+ * cosl/sinl called on every step (as the server did before) must be exactly
+ * the pixels of the compat mode; the fixed point mode is compared with them
+ * as well. Reports time per step of each representation.
+ * Exits with status 1 if the compat mode differs.
+ *
+ * Usage: ./bench-movement [-n steps] [-t turning_speed]
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../server/misc.hpp"
+#include "../server/Movement.hpp"
+
+constexpr uint32_t SEEDS[] = {77, 2021, 12345, 987654321, 4242424242u};
+constexpr int WIDTH = 640;
+constexpr int HEIGHT = 480;
+
+/// Position as it was stored before.
+class LegacyPosition {
+    long double pos_x = -1, pos_y = -1;
+
+public:
+    explicit LegacyPosition(MovementMode) {}
+
+    void set(int x, int y) {
+        pos_x = ((long double) x) + 0.5;
+        pos_y = ((long double) y) + 0.5;
+    }
+
+    void step(int direction) {
+        long double dir = direction;
+        dir = dir * M_PI / 180.0;
+        pos_x += cosl(dir);
+        pos_y += sinl(dir);
+    }
+
+    [[nodiscard]] std::pair<int, int> pixel() const {
+        return {(int) floorl(pos_x), (int) floorl(pos_y)};
+    }
+};
+
+/// Pixels visited by a player on seed @p seed, a new pixel is recorded when it changes.
+template <class Pos>
+std::vector<std::pair<int, int>> simulate(MovementMode mode, uint32_t seed, int steps, int turning_speed,
+                                          double &ns) {
+    Random random(seed);
+    Pos pos(mode);
+    std::vector<std::pair<int, int>> pixels;
+    pixels.reserve(steps);
+
+    int x = (int) (random.rand() % WIDTH);
+    int y = (int) (random.rand() % HEIGHT);
+    pos.set(x, y);
+    int direction = (int) (random.rand() % 360);
+    pixels.push_back(pos.pixel());
+
+    auto start = std::chrono::steady_clock::now();
+    int turn = 0;
+    for (int i = 0; i < steps; i++) {
+        if (i % 16 == 0) {
+            // players keep a direction for a while
+            turn = (int) (random.rand() % 3);
+        }
+        int change = turn == 0 ? 0 : (turn == 1 ? turning_speed : -turning_speed);
+        direction = (direction + change + 360) % 360;
+
+        auto pixel = pos.pixel();
+        pos.step(direction);
+        if (pixel != pos.pixel()) {
+            pixels.push_back(pos.pixel());
+        }
+    }
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    return pixels;
+}
+
+/// Index of the first pixel that differs, or -1.
+long firstDifference(const std::vector<std::pair<int, int>> &a, const std::vector<std::pair<int, int>> &b) {
+    for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+        if (a[i] != b[i]) return (long) i;
+    }
+    return a.size() == b.size() ? -1 : (long) std::min(a.size(), b.size());
+}
+
+int main(int argc, char *argv[]) {
+    int steps = 1000000;
+    int turning_speed = 6;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:t:")) != -1)
+        switch (c) {
+            case 'n':
+                steps = parseNumericParam(optarg);
+                break;
+            case 't':
+                turning_speed = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-movement [-n steps] [-t turning_speed]");
+        }
+
+    if (steps <= 0 || turning_speed <= 0 || turning_speed > 90) {
+        syserr("Parameters should be positive (and turning speed at most 90).");
+    }
+
+    double legacy_ns = 0, compat_ns = 0, fixed_ns = 0;
+    bool compat_ok = true;
+
+    for (uint32_t seed: SEEDS) {
+        auto legacy = simulate<LegacyPosition>(MovementMode::COMPAT, seed, steps, turning_speed, legacy_ns);
+        auto compat = simulate<Position>(MovementMode::COMPAT, seed, steps, turning_speed, compat_ns);
+        auto fixed = simulate<Position>(MovementMode::FIXED, seed, steps, turning_speed, fixed_ns);
+
+        long compat_diff = firstDifference(legacy, compat);
+        long fixed_diff = firstDifference(legacy, fixed);
+        compat_ok &= compat_diff < 0;
+
+        std::cout << "seed " << seed << ": " << legacy.size() << " pixels, compat "
+                  << (compat_diff < 0 ? "identical" : "differs at pixel " + std::to_string(compat_diff))
+                  << ", fixed point "
+                  << (fixed_diff < 0 ? "identical" : "differs from pixel " + std::to_string(fixed_diff))
+                  << std::endl;
+    }
+
+    double total = (double) steps * (sizeof(SEEDS) / sizeof(SEEDS[0]));
+    std::cout << "cosl/sinl on every step: " << legacy_ns / total << " ns per step" << std::endl
+              << "compat:                  " << compat_ns / total << " ns per step" << std::endl
+              << "fixed point:             " << fixed_ns / total << " ns per step" << std::endl;
+
+    return compat_ok ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares the tiled occupancy grid used by Board with the hash set of pixels
+ * and the dense grid (a byte per pixel) used before. For every fill ratio
+ * (the part of the board a game paints) every "game" fills the board with
+ * random worm-like walks, probing the set before each insert (as Player::move
+ * does), then looks up the pixels of another walk and clears the set (as
+ * Board::prepareNewGame does). The dense grid is skipped on boards too big to
+ * allocate it comfortably.
+ *
+ * Usage: ./bench-occupancy [-w n] [-h n] [-f ratio,...] [-g n]
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../server/OccupancyGrid.hpp"
+
+struct pair_hash {
+    template <class T1, class T2>
+    std::size_t operator() (std::pair<T1, T2> const &pair) const {
+        std::size_t h1 = std::hash<T1>()(pair.first);
+        std::size_t h2 = std::hash<T2>()(pair.second);
+        return h1 ^ h2;
+    }
+};
+
+struct HashSet {
+    std::unordered_set<std::pair<int, int>, pair_hash> set;
+
+    HashSet(int, int) {}
+    bool contains(std::pair<int, int> p) const { return set.find(p) != set.end(); }
+    void insert(std::pair<int, int> p) { set.insert(p); }
+    void clear() { set.clear(); }
+    /// nodes of libstdc++ hold the pair, a link and the hash
+    size_t memoryUsage() const {
+        return set.bucket_count() * sizeof(void *) + set.size() * (sizeof(std::pair<int, int>) + 2 * sizeof(void *));
+    }
+};
+
+/// The grid Board used before tiles: a tag of the current epoch for every pixel.
+struct DenseGrid {
+    const size_t width;
+    std::vector<uint8_t> cells;
+    std::vector<uint16_t> owners;
+    uint8_t epoch = 1;
+
+    DenseGrid(int width_p, int height_p) :
+            width(width_p), cells((size_t) width_p * height_p, 0), owners((size_t) width_p * height_p, 0) {}
+    bool contains(std::pair<int, int> p) const { return cells[p.second * width + p.first] == epoch; }
+    void insert(std::pair<int, int> p) {
+        cells[p.second * width + p.first] = epoch;
+        owners[p.second * width + p.first] = 0;
+    }
+    void clear() {
+        if (++epoch == 0) {
+            std::fill(cells.begin(), cells.end(), 0);
+            epoch = 1;
+        }
+    }
+    size_t memoryUsage() const {
+        return cells.capacity() * sizeof(uint8_t) + owners.capacity() * sizeof(uint16_t);
+    }
+};
+
+/// Boards with more pixels are not tried with DenseGrid.
+constexpr uint64_t MAX_DENSE_PIXELS = 1ULL << 28;
+
+/// Pixels visited by worms wandering from random positions.
+std::vector<std::pair<int, int>> generateWalk(int width, int height, size_t pixels, uint32_t seed) {
+    std::vector<std::pair<int, int>> res;
+    res.reserve(pixels);
+    uint64_t state = seed;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (uint32_t) (state >> 33);
+    };
+
+    int x = next() % width, y = next() % height;
+    while (res.size() < pixels) {
+        if (next() % 500 == 0) {
+            x = next() % width;
+            y = next() % height;
+        }
+        x = (x + (int) (next() % 3) - 1 + width) % width;
+        y = (y + (int) (next() % 3) - 1 + height) % height;
+        res.emplace_back(x, y);
+    }
+    return res;
+}
+
+template <class Set>
+void run(const char *name, int width, int height, const std::vector<std::pair<int, int>> &walk,
+         const std::vector<std::pair<int, int>> &probes, int games) {
+    using clock = std::chrono::steady_clock;
+    Set set(width, height);
+    size_t eaten = 0, found = 0, memory = 0;
+    double probe_ns = 0, lookup_ns = 0, clear_ns = 0;
+
+    for (int g = 0; g < games; g++) {
+        auto start = clock::now();
+        for (auto &p: walk) {
+            if (!set.contains(p)) {
+                set.insert(p);
+                eaten++;
+            }
+        }
+        auto filled = clock::now();
+        for (auto &p: probes) {
+            found += set.contains(p);
+        }
+        auto looked_up = clock::now();
+        memory = std::max(memory, set.memoryUsage());
+        set.clear();
+        auto end = clock::now();
+
+        probe_ns += std::chrono::duration<double, std::nano>(filled - start).count();
+        lookup_ns += std::chrono::duration<double, std::nano>(looked_up - filled).count();
+        clear_ns += std::chrono::duration<double, std::nano>(end - looked_up).count();
+    }
+
+    std::cout << "  " << name << ": "
+              << probe_ns / (double) (walk.size() * games) << " ns per probe+insert, "
+              << lookup_ns / (double) (probes.size() * games) << " ns per lookup, "
+              << clear_ns / games / 1000 << " us per clear, "
+              << memory / 1024 << " KiB ("
+              << eaten / games << " pixels eaten, " << found / games << " found per game)" << std::endl;
+}
+
+std::vector<double> parseRatios(const char *arg) {
+    std::vector<double> res;
+    std::stringstream stream(arg);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char *end;
+        double ratio = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(ratio > 0) || ratio > 1) {
+            syserr("Fill ratios should be numbers in (0, 1].");
+        }
+        res.push_back(ratio);
+    }
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    int width  = 8192;
+    int height = 8192;
+    std::vector<double> ratios = {0.001, 0.01, 0.1};
+    int games  = 3;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:h:f:g:")) != -1)
+        switch (c) {
+            case 'w':
+                width = parseNumericParam(optarg);
+                break;
+            case 'h':
+                height = parseNumericParam(optarg);
+                break;
+            case 'f':
+                ratios = parseRatios(optarg);
+                break;
+            case 'g':
+                games = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-occupancy [-w n] [-h n] [-f ratio,...] [-g n]");
+        }
+
+    if (width <= 0 || height <= 0 || games <= 0 || width > 65536 || height > 65536) {
+        syserr("Width and height should be between 1 and 65536, the number of games positive.");
+    }
+
+    const uint64_t pixels = (uint64_t) width * height;
+    std::cout << "Board " << width << "x" << height << ", " << games << " games per fill ratio" << std::endl;
+
+    for (double ratio: ratios) {
+        auto moves = (size_t) std::max(1.0, ratio * (double) pixels);
+        auto walk = generateWalk(width, height, moves, 2021);
+        auto probes = generateWalk(width, height, std::min<size_t>(moves, 1'000'000), 2022);
+        std::cout << "Fill ratio " << ratio << ", " << moves << " moves per game" << std::endl;
+
+        run<HashSet>("unordered_set", width, height, walk, probes, games);
+        if (pixels <= MAX_DENSE_PIXELS) {
+            run<DenseGrid>("dense grid", width, height, walk, probes, games);
+        }
+        run<OccupancyGrid>("OccupancyGrid", width, height, walk, probes, games);
+    }
+
+    return 0;
+}
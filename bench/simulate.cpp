@@ -0,0 +1,266 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Plays games as the server does, without sockets: players are synthetic
+ * clients whose turn directions are random, scripted or chosen by steering
+ * bots, and every round new events of both streams are packed into datagrams
+ * as they would be broadcast. A game that ends is followed by the next one
+ * until the given number of rounds is played. Choosing turn directions is not
+ * measured. Reports rounds and events per second, heap allocations per round,
+ * bytes of datagrams and peak resident set size, and percentiles of the time
+ * of a round against the budget of a tick at -v rounds per second. With -R
+ * games are recorded to a file as the server does, within the measured time.
+ * Players and -o idle observers are clients of the room, new events are
+ * broadcast to them (and missed ones paced) as the server does every tick,
+ * to a sink that drops the datagrams. With -g observers listen to a multicast
+ * group, which is sent the events once for all of them.
+ * Exits with status 1 if the 99th percentile exceeds the budget.
+ *
+ * Usage: ./bench-simulate [-w n] [-h n] [-n players] [-r rounds] [-s seed] [-t n] [-m mode] [-i inputs] [-v n]
+ *                         [-R file] [-o observers] [-g]
+ */
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "../utils.hpp"
+#include "../server/CatchUp.hpp"
+#include "../server/Histogram.hpp"
+#include "../server/Recording.hpp"
+#include "AllocCounter.hpp"
+#include "Bots.hpp"
+
+enum class Inputs {RANDOM, SCRIPTED, BOTS};
+
+/// Sets turn directions of players of @p game for the next round.
+void chooseTurns(Game &game, Inputs inputs, Random &random) {
+    for (auto &player: game.players) {
+        uint8_t &turn = player->client->last_turn_direction;
+        switch (inputs) {
+            case Inputs::RANDOM: {
+                uint32_t r = random.rand();
+                if (r % 8 == 0) {
+                    turn = r / 8 % 3;
+                }
+                break;
+            }
+            case Inputs::SCRIPTED:
+                // arcs and straight lines of 50 rounds, different for every player
+                turn = (game.round + 7 * player->player_num) / 50 % 3;
+                break;
+            case Inputs::BOTS:
+                bots::steer(game, *player, random.rand());
+                break;
+        }
+    }
+}
+
+/// Packs events of a stream of @p game from @p next into datagrams, @return their bytes.
+uint64_t broadcast(Game &game, bool input_stream, char *buffer, uint64_t &datagrams, unsigned int &next) {
+    uint64_t bytes = 0;
+    while (next < game.board->log(input_stream).size()) {
+        int len;
+        game.getDatagram(next, len, buffer, input_stream);
+        bytes += len;
+        datagrams++;
+    }
+    return bytes;
+}
+
+/// Drops datagrams broadcast to clients, counting them.
+class DiscardSink : public BatchSink {
+public:
+    void sendBatch(struct mmsghdr *msgs, unsigned int n, IOStats &stats) override {
+        for (unsigned int i = 0; i < n; i++) {
+            for (size_t j = 0; j < msgs[i].msg_hdr.msg_iovlen; j++) {
+                stats.bytes_out += msgs[i].msg_hdr.msg_iov[j].iov_len;
+            }
+        }
+        stats.datagrams_out += n;
+    }
+};
+
+/// Connects @p num_observers observers with @p capabilities to @p game, they never send anything again.
+void addObservers(Game &game, int num_observers, uint8_t capabilities) {
+    for (int i = 0; i < num_observers; i++) {
+        struct sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(20000);
+        put_uint32((char *) addr.sin6_addr.s6_addr, i);
+        client_mess mess{1, 0, 0, "", &addr, capabilities};
+        ClientKey key(&addr);
+        game.handleClient(key, mess, 0);
+        game.setCapabilities(**game.client_map.find(key), capabilities);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int width = 640, height = 480;
+    int num_players = 10;
+    int rounds = 100000;
+    uint32_t seed = 2021;
+    int turning_speed = 6;
+    MovementMode movement = MovementMode::FIXED;
+    Inputs inputs = Inputs::BOTS;
+    int rounds_per_sec = 50;
+    int num_observers = 0;
+    bool multicast = false;
+    std::string record_path;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:h:n:r:s:t:m:i:v:R:o:g")) != -1)
+        switch (c) {
+            case 'w':
+                width = parseNumericParam(optarg);
+                break;
+            case 'h':
+                height = parseNumericParam(optarg);
+                break;
+            case 'n':
+                num_players = parseNumericParam(optarg);
+                break;
+            case 'r':
+                rounds = parseNumericParam(optarg);
+                break;
+            case 's':
+                seed = parseNumericParam(optarg);
+                break;
+            case 't':
+                turning_speed = parseNumericParam(optarg);
+                break;
+            case 'm':
+                if (std::string(optarg) == "fixed") {
+                    movement = MovementMode::FIXED;
+                } else if (std::string(optarg) == "compat") {
+                    movement = MovementMode::COMPAT;
+                } else {
+                    syserr("Provided movement mode is unknown (should be fixed or compat).");
+                }
+                break;
+            case 'i':
+                if (std::string(optarg) == "random") {
+                    inputs = Inputs::RANDOM;
+                } else if (std::string(optarg) == "scripted") {
+                    inputs = Inputs::SCRIPTED;
+                } else if (std::string(optarg) == "bots") {
+                    inputs = Inputs::BOTS;
+                } else {
+                    syserr("Provided inputs are unknown (should be random, scripted or bots).");
+                }
+                break;
+            case 'v':
+                rounds_per_sec = parseNumericParam(optarg);
+                break;
+            case 'R':
+                record_path = (std::string) optarg;
+                break;
+            case 'o':
+                num_observers = parseNumericParam(optarg);
+                break;
+            case 'g':
+                multicast = true;
+                break;
+            default:
+                syserr("Usage: ./bench-simulate [-w n] [-h n] [-n players] [-r rounds] [-s seed] [-t n] "
+                       "[-m mode] [-i inputs] [-v n] [-R file] [-o observers] [-g]");
+        }
+
+    if (width <= 0 || height <= 0 || rounds <= 0 || num_players < 2 || num_players > MAX_PLAYERS ||
+        turning_speed <= 0 || turning_speed > 90 || rounds_per_sec <= 0 || num_observers < 0 ||
+        num_players + num_observers > MAX_CLIENTS) {
+        syserr("Parameters should be positive (2 to 2048 players, turning speed at most 90, "
+               "at most 8192 players and observers).");
+    }
+
+    using bench_clock = std::chrono::steady_clock;
+    Game game(turning_speed, width, height, seed, movement,
+              std::max(num_players + num_observers, V1_MAX_CLIENTS));
+    // the input stream is measured along with events
+    game.keep_inputs = true;
+    addObservers(game, num_observers, CAPABILITY_WIDE | (multicast ? CAPABILITY_MULTICAST : 0));
+    struct sockaddr_in6 group{};
+    group.sin6_family = AF_INET6;
+
+    DiscardSink sink;
+    IOStats io{};
+    Sender sender;
+    sender.init(&sink, &io);
+    CatchUp catch_up({4 * MAX_DATAGRAM_SIZE, 64 * 1024});
+    Histogram round_ns;
+    Random random(seed);
+    char buffer[MAX_DATAGRAM_SIZE];
+    std::unique_ptr<GameRecorder> recorder;
+    if (!record_path.empty()) {
+        recorder = std::make_unique<GameRecorder>(record_path, seed);
+    }
+
+    double seconds = 0;
+    uint64_t events = 0, allocations = 0, games = 0;
+    uint64_t event_bytes = 0, event_datagrams = 0, input_bytes = 0, input_datagrams = 0;
+    unsigned int next_event = 0, next_input = 0;
+
+    for (int played = 0; played < rounds; played++) {
+        if (game.isWaitingRoom()) {
+            events += game.board->events.size();
+            bots::startGame(game, num_players);
+            games++;
+            next_event = next_input = 0;
+            event_bytes += broadcast(game, false, buffer, event_datagrams, next_event);
+            input_bytes += broadcast(game, true, buffer, input_datagrams, next_input);
+        }
+        chooseTurns(game, inputs, random);
+
+        uint64_t allocations_before = alloc_counter::allocations;
+        auto start = bench_clock::now();
+
+        game.doRound();
+        if (recorder != nullptr) {
+            recorder->record(game);
+        }
+        event_bytes += broadcast(game, false, buffer, event_datagrams, next_event);
+        input_bytes += broadcast(game, true, buffer, input_datagrams, next_input);
+        broadcastNewEvents(game, sender, buffer, multicast ? &group : nullptr);
+        catch_up.tick(game, sender, buffer, CatchUp::now());
+        sender.flush();
+
+        auto elapsed = bench_clock::now() - start;
+        seconds += std::chrono::duration<double>(elapsed).count();
+        round_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        allocations += alloc_counter::allocations - allocations_before;
+    }
+    events += game.board->events.size();
+
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::cout << num_players << " players, " << width << "x" << height << ", seed " << seed << ", "
+              << rounds << " rounds in " << games << " games:" << std::endl
+              << "    " << rounds / seconds << " rounds/s, " << (double) events / seconds << " events/s, "
+              << (double) allocations / rounds << " allocations per round" << std::endl
+              << "    events: " << event_bytes << " bytes in " << event_datagrams << " datagrams, "
+              << "inputs: " << input_bytes << " bytes in " << input_datagrams << " datagrams" << std::endl
+              << "    broadcast to " << num_players << " players and " << num_observers << " observers: "
+              << io.datagrams_out << " datagrams, " << io.bytes_out << " bytes" << std::endl
+              << "    peak RSS " << usage.ru_maxrss << " KiB" << std::endl;
+    if (recorder != nullptr) {
+        std::cout << "    recorded " << recorder->games() << " finished games, " << recorder->bytes()
+                  << " bytes in " << record_path << std::endl;
+    }
+
+    uint64_t budget_ns = 1'000'000'000 / rounds_per_sec;
+    bool within = round_ns.percentile(0.99) <= budget_ns;
+    std::cout << "    round p50 " << round_ns.percentile(0.5) / 1000 << " us, p99 "
+              << round_ns.percentile(0.99) / 1000 << " us, max " << round_ns.max() / 1000 << " us, budget of a tick "
+              << budget_ns / 1000 << " us: " << (within ? "within budget" : "OVER BUDGET") << std::endl;
+
+    return within ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Compares an observer joining a game in progress by replaying all events
+ * (as done before) with a snapshot of the board followed by the remaining
+ * events. Players steer clear of trails looking a few steps ahead (as
+ * a careful human player would) so that games last; at a few points of a game
+ * an observer joins both ways and its GUI lines are compared: the same
+ * pixels with the same owners and the same eliminated players are required.
+ * The snapshot is built a part per round as by the server, the game going on
+ * meanwhile, so the snapshot and the events after it are compared with the
+ * replay of the game as it is once the snapshot is complete.
+ * Reports bytes and datagrams sent, time to build and apply them (and the
+ * longest part of building) and the time until the observer is live when the
+ * server sends missed events at the given budget per tick.
+ * Exits with status 1 if the GUI lines differ.
+ *
+ * Usage: ./bench-snapshot [-w n] [-h n] [-n players] [-r rounds] [-b bytes] [-v n]
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../server/Snapshot.hpp"
+#include "../client/ClientState.hpp"
+#include "Bots.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct Join {
+    uint64_t bytes = 0;
+    uint64_t datagrams = 0;
+    double server_us = 0;
+    double client_us = 0;
+    /// parts the snapshot is built in and the longest of them
+    int steps = 0;
+    double longest_step_us = 0;
+    std::vector<std::string> lines;
+};
+
+/// Takes GUI lines of @p observer, sorted and without repetitions (a pixel
+/// eaten while the snapshot was built is also in a later event), without NEW_GAME.
+std::vector<std::string> guiLines(ClientState &observer) {
+    std::vector<std::string> res;
+    while (!observer.events.empty()) {
+        if (observer.events.front().rfind("NEW_GAME", 0) != 0) {
+            res.push_back(observer.events.front());
+        }
+        observer.events.pop();
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+/// Plays a round of @p game steered by bots, returns whether it was played.
+bool playRound(Game &game, Random &turns) {
+    if (game.isWaitingRoom()) {
+        return false;
+    }
+    for (auto &player: game.players) {
+        bots::steer(game, *player, turns.rand());
+    }
+    game.doRound();
+    return true;
+}
+
+/// Sends events from @p from to @p observer.
+void sendEvents(Game &game, ClientState &observer, uint32_t from, Join &res) {
+    char buffer[MAX_DATAGRAM_SIZE];
+    while (true) {
+        auto start = bench_clock::now();
+        int len;
+        const char *datagram = game.getDatagram(from, len, buffer);
+        auto mid = bench_clock::now();
+        if (len <= 0) break;
+
+        observer.parseMessage(datagram, len);
+        res.server_us += std::chrono::duration<double, std::micro>(mid - start).count();
+        res.client_us += std::chrono::duration<double, std::micro>(bench_clock::now() - mid).count();
+        res.bytes += len;
+        res.datagrams++;
+    }
+}
+
+Join replay(Game &game) {
+    Join res;
+    ClientState observer("", 1);
+    sendEvents(game, observer, 0, res);
+    res.lines = guiLines(observer);
+    return res;
+}
+
+/// Builds a snapshot a part per round of @p game, which goes on meanwhile.
+Join snapshot(Game &game, Random &turns, int &played) {
+    Join res;
+    ClientState observer("", 1, CAPABILITY_SNAPSHOT);
+
+    auto start = bench_clock::now();
+    Snapshot snap(game);
+    res.server_us += std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+    while (true) {
+        start = bench_clock::now();
+        bool complete = snap.build(*game.board, SNAPSHOT_PIXELS_PER_TICK);
+        double step_us = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+        res.server_us += step_us;
+        res.longest_step_us = std::max(res.longest_step_us, step_us);
+        res.steps++;
+        if (complete) {
+            break;
+        }
+        played += playRound(game, turns);
+    }
+
+    for (auto &page: snap.pages) {
+        start = bench_clock::now();
+        observer.parseMessage(page.data, (int) page.len);
+        res.client_us += std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+        res.bytes += page.len;
+        res.datagrams++;
+    }
+    sendEvents(game, observer, snap.event_no, res);
+    res.lines = guiLines(observer);
+    return res;
+}
+
+void report(const char *name, const Join &join, int budget, int rounds_per_sec) {
+    // the first budget is available at once, then one per tick
+    uint64_t ticks = join.bytes <= (uint64_t) budget ? 0 : (join.bytes - 1) / budget;
+    std::cout << "    " << name << ": " << join.bytes << " bytes in " << join.datagrams
+              << " datagrams, server " << join.server_us << " us";
+    if (join.steps > 0) {
+        std::cout << " (" << join.steps << " parts, longest " << join.longest_step_us << " us)";
+    }
+    std::cout << ", client " << join.client_us
+              << " us, live after " << (double) ticks / rounds_per_sec << " s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int width = 2000, height = 2000;
+    int num_players = 10;
+    int rounds = 8000;
+    int budget = 4 * MAX_DATAGRAM_SIZE;
+    int rounds_per_sec = 50;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:h:n:r:b:v:")) != -1)
+        switch (c) {
+            case 'w':
+                width = parseNumericParam(optarg);
+                break;
+            case 'h':
+                height = parseNumericParam(optarg);
+                break;
+            case 'n':
+                num_players = parseNumericParam(optarg);
+                break;
+            case 'r':
+                rounds = parseNumericParam(optarg);
+                break;
+            case 'b':
+                budget = parseNumericParam(optarg);
+                break;
+            case 'v':
+                rounds_per_sec = parseNumericParam(optarg);
+                break;
+            default:
+                syserr("Usage: ./bench-snapshot [-w n] [-h n] [-n players] [-r rounds] [-b bytes] [-v n]");
+        }
+
+    if (width <= 0 || height <= 0 || rounds <= 0 || budget < MAX_DATAGRAM_SIZE || rounds_per_sec <= 0 ||
+        num_players < 2 || num_players > MAX_PLAYERS) {
+        syserr("Parameters should be positive (budget at least a datagram, 2 to 2048 players).");
+    }
+
+    Game game(6, width, height, 2021, MovementMode::FIXED, std::max(num_players, V1_MAX_CLIENTS));
+    bots::startGame(game, num_players);
+
+    Random turns(77);
+    bool ok = true;
+    int played = 0;
+    for (int checkpoint = rounds / 8; checkpoint <= rounds; checkpoint *= 2) {
+        while (played < checkpoint && playRound(game, turns)) {
+            played++;
+        }
+
+        Join fast = snapshot(game, turns, played);
+        Join slow = replay(game);
+        bool same = slow.lines == fast.lines;
+        ok &= same;
+
+        std::cout << "after " << played << " rounds, " << game.board->events.size() << " events, "
+                  << slow.lines.size() << " GUI lines " << (same ? "identical" : "DIFFER") << ":" << std::endl;
+        report("replay  ", slow, budget, rounds_per_sec);
+        report("snapshot", fast, budget, rounds_per_sec);
+
+        if (game.isWaitingRoom()) {
+            std::cout << "game over" << std::endl;
+            break;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -1,299 +1,670 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef CLIENT_STATE_HPP
-#define CLIENT_STATE_HPP
-
-#include <string>
-#include <utility>
-#include <cstring>
-#include <queue>
-#include <arpa/inet.h>
-
-#include "../utils.hpp"
-
-constexpr int MAX_USERNAME_LEN = 20;
-
-struct event_t {
-    uint32_t len;
-    uint32_t event_no;
-    uint8_t event_type;
-
-    const char* data;
-    uint32_t data_len;
-    uint32_t crc32;
-    uint32_t total_len;
-};
-
-class ClientState {
-    uint32_t game_id;
-    const uint64_t session_id;
-    std::string player_name;
-
-    uint32_t next_expected_event_no;
-    std::vector<std::string> players;
-
-    uint8_t key;
-    bool is_left_down, is_right_down;
-
-    uint32_t width, height;
-
-public:
-    std::queue<std::string> events;
-
-    explicit ClientState(std::string player_name_p, uint64_t session_id_p):
-            game_id(0),
-            session_id(session_id_p),
-            player_name(std::move(player_name_p)),
-            next_expected_event_no(0),
-            key(0),
-            is_left_down(false),
-            is_right_down(false),
-            width(0),
-            height(0) {}
-
-    static bool parse(const char *buffer, unsigned buff_len, struct event_t *res) {
-        if (buff_len == 0) {
-            return false;
-        }
-
-        res->len        = get_uint32(buffer);
-
-        if (buff_len < 8 + res->len || res->len < 5) {
-#ifdef DEBUG
-            std::cout << "Invalid length of datagram, cannot calculate crc, ignoring" << std::endl;
-#endif
-            return false;
-        }
-
-        res->event_no   = get_uint32(buffer + 4);
-        res->event_type = get_uint8(buffer + 8);
-        res->data       = buffer + 9;
-
-        res->data_len   = res->len - 5;
-        res->total_len  = res->len + 8;
-
-        res->crc32      = get_uint32(buffer + res->len + 4);
-
-        if (crc32(buffer, res->len + 4) != res->crc32) {
-#ifdef DEBUG
-            std::cout << "Wrong control sum, ignoring" << std::endl;
-#endif
-            return false;
-        }
-
-        return true;
-    }
-
-    void parseMessage(const char *buffer, int len) {
-        uint32_t game_id_rec = get_uint32(buffer);
-
-        if (len < 4) return;
-
-        if (game_id != game_id_rec) {
-            struct event_t first_event{};
-
-            if (parse(buffer + 4, len - 4, &first_event) && first_event.event_type == 0) {
-                // Received event is a proper NEW_GAME event
-                game_id = game_id_rec;
-                next_expected_event_no = 0;
-            }
-
-            else {
-#ifdef DEBUG
-                std::cout << "Incorrect game_id, ignoring" << std::endl;
-#endif
-                return;
-            }
-        }
-
-        buffer += 4;
-        len -= 4;
-
-        struct event_t event{};
-
-        while (parse(buffer, len, &event)) {
-            buffer += event.total_len;
-            len -= event.total_len;
-            parseEvent(&event);
-        }
-    }
-
-    void parseEvent(const struct event_t *event) {
-
-        if (next_expected_event_no != event->event_no) {
-#ifdef DEBUG
-            std::cout << "Wrong event number (expected"
-                      << next_expected_event_no << ", got " << event->event_no
-                      << "). Ignoring" << std::endl;
-#endif
-            return;
-        }
-        switch (event->event_type) {
-            case 0:
-                parseNewGame(event);
-                break;
-            case 1:
-                parsePixel(event);
-                break;
-
-            case 2:
-                parsePlayerEliminated(event);
-                break;
-
-            case 3:
-                // GAME OVER
-                break;
-
-            default:;
-#ifdef DEBUG
-                std::cout << "Unrecognised type of event, stepping over" << std::endl;
-#endif
-        }
-        next_expected_event_no++;
-    }
-
-    void parsePlayerEliminated(const struct event_t *event) {
-        if (event->data_len != 1) {
-            syserr("Incorrect size of PLAYER_ELIMINATED event, aborting.");
-        }
-
-        uint8_t player_number  = get_uint8(event->data);
-
-        if (player_number >= players.size()) {
-            syserr("Incorrect player number, aborting.");
-        }
-
-        events.push(
-                "PLAYER_ELIMINATED " +
-                players[player_number] + "\n");
-
-    }
-
-    void parsePixel(const struct event_t *event) {
-        if (event->data_len != 9) {
-            syserr("Incorrect size of PIXEL event, aborting.");
-        }
-
-        uint8_t player_number  = get_uint8(event->data);
-        uint32_t x             = get_uint32(event->data + 1);
-        uint32_t y             = get_uint32(event->data + 5);
-
-        if (x >= width || y >= height) {
-            syserr("Received illogical event: pixel out of the board, aborting.");
-        }
-
-        if (player_number >= players.size()) {
-            syserr("Incorrect player number, aborting.");
-        }
-
-        events.push(
-                "PIXEL " +
-                std::to_string(x) + " " +
-                std::to_string(y) + " " +
-                players[player_number] + "\n");
-
-    }
-
-    void parseNewGame(const struct event_t *event) {
-        if (event->data[event->data_len - 1] != '\0') {
-            syserr("Incorrect event, player name is not null terminated, aborting");
-        }
-
-        width  = get_uint32(event->data);
-        height = get_uint32(event->data + 4);
-
-        std::string mess = "NEW_GAME " +
-                std::to_string(width) + " " +
-                std::to_string(height) + " ";
-
-        std::string next_player_name;
-        next_player_name.reserve(MAX_USERNAME_LEN);
-
-        players.clear();
-
-        for (const char *i = event->data + 8; i < event->data + event->data_len; ++i) {
-            if (*i == '\0') {
-                if (i != event->data + event->data_len - 1) {
-                    mess += ' ';
-                }
-
-                if (next_player_name.empty() || next_player_name.size() > MAX_USERNAME_LEN) {
-                    syserr("Invalid length of player name in NEW_GAME event, aborting.");
-                }
-
-                players.push_back(next_player_name);
-                next_player_name.clear();
-            }
-
-            else if (*i < 33 || *i > 126) {
-                syserr("Invalid character in NEW_GAME event, aborting.");
-            }
-
-            else {
-                mess += *i;
-                next_player_name += *i;
-            }
-        }
-        events.push(mess + "\n");
-    }
-
-    /**
-     * It parses a message received from GUI and modifies client's state accordingly.
-     * @param buffer    a message as a sequence of characters (not null terminated),
-     * @param buff_len  length of the message.
-     */
-    void parseGUI(const char *buffer, int buff_len) {
-        char left_down[]    = "LEFT_KEY_DOWN\n";
-        char left_up[]      = "LEFT_KEY_UP\n";
-        char right_down[]   = "RIGHT_KEY_DOWN\n";
-        char right_up[]     = "RIGHT_KEY_UP\n";
-
-        if (std::strncmp(buffer, left_down, sizeof(left_down) - 1) == 0 && (sizeof(left_down) - 1) == buff_len) {
-            is_left_down = true;
-            key = 2;
-        }
-        else if (std::strncmp(buffer, left_up, sizeof(left_up) - 1) == 0 && (sizeof(left_up) - 1) == buff_len) {
-            is_left_down = false;
-            if (is_right_down) {
-                key = 1;
-            } else {
-                key = 0;
-            }
-        }
-        else if (std::strncmp(buffer, right_down, sizeof(right_down) - 1) == 0 && (sizeof(right_down) - 1) == buff_len) {
-            is_right_down = true;
-            key = 1;
-        }
-        else if (std::strncmp(buffer, right_up, sizeof(right_up) - 1) == 0 && (sizeof(right_up) - 1) == buff_len) {
-            is_right_down = false;
-            if (is_left_down) {
-                key = 2;
-            } else {
-                key = 0;
-            }
-        }
-        else {
-            std::cout << "Not recognised message from gui, ignoring" << std::endl;
-        }
-    }
-
-    /**
-     * Generates content of a datagram that is send to server every 30ms.
-     * @param mess      is an output parameter - a buffer which must be at least 34 bytes long,
-     * @return          length generated message.
-     */
-    unsigned int generateServerMessage(char *mess) {
-        put_uint64(mess, session_id);
-        put_uint8(mess + 8, key);
-        put_uint32(mess + 9, next_expected_event_no);
-        strcpy(mess + 13, player_name.c_str());
-
-        return player_name.size() + 13;
-    }
-};
-
-#endif //CLIENT_STATE_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef CLIENT_STATE_HPP
+#define CLIENT_STATE_HPP
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <cstring>
+#include <queue>
+#include <arpa/inet.h>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "../server/Player.hpp"
+
+constexpr int MAX_USERNAME_LEN = 20;
+
+struct event_t {
+    uint32_t len;
+    uint32_t event_no;
+    uint8_t event_type;
+
+    const char* data;
+    uint32_t data_len;
+    uint32_t crc32;
+    uint32_t total_len;
+};
+
+class ClientState {
+    uint32_t game_id;
+    const uint64_t session_id;
+    std::string player_name;
+
+    uint32_t next_expected_event_no;
+    std::vector<std::string> players;
+    std::vector<bool> eliminated;
+
+    /// the game is a wide one (see protocol.hpp) of players_announced players,
+    /// whose names come in PLAYER_NAMES records
+    bool wide;
+    size_t players_announced;
+
+    /// extensions of the protocol asked for (see protocol.hpp)
+    uint8_t capabilities;
+    /// the input stream has diverged, the client starts again with events
+    bool resync;
+
+    /// snapshot being applied: its event number and the next pixel expected
+    uint32_t snapshot_event_no;
+    uint64_t snapshot_pos;
+
+    uint8_t key;
+    bool is_left_down, is_right_down;
+
+    uint32_t width, height;
+
+    /// the game simulated from the input stream, events it generates become
+    /// lines for GUI as if they came from the server
+    board_ptr board;
+    std::vector<player_ptr> simulated_players;
+    int turning_speed;
+    std::vector<uint8_t> turns;
+    std::vector<char> checksum_state;
+
+    /// log of a relay: records are appended to it in order, as they are,
+    /// instead of becoming lines for GUI
+    EventLog *relay_log;
+
+public:
+    std::queue<std::string> events;
+
+    /// counters of received records, for load tests
+    struct Stats {
+        /// records ahead of the next expected one (some were lost or reordered)
+        uint64_t out_of_order = 0;
+        /// records known already
+        uint64_t duplicates = 0;
+        /// datagrams with a record that does not parse (wrong control sum or length)
+        uint64_t crc_failures = 0;
+        /// one more than the greatest event number received in the current game
+        uint32_t events_seen = 0;
+    } stats;
+
+    explicit ClientState(std::string player_name_p, uint64_t session_id_p, uint8_t capabilities_p = 0):
+            game_id(0),
+            session_id(session_id_p),
+            player_name(std::move(player_name_p)),
+            next_expected_event_no(0),
+            wide(false),
+            players_announced(0),
+            capabilities(capabilities_p),
+            resync(false),
+            snapshot_event_no(0),
+            snapshot_pos(0),
+            key(0),
+            is_left_down(false),
+            is_right_down(false),
+            width(0),
+            height(0),
+            turning_speed(0),
+            relay_log(nullptr) {}
+
+    [[nodiscard]] uint32_t nextExpected() const {
+        return next_expected_event_no;
+    }
+
+    [[nodiscard]] uint32_t gameId() const {
+        return game_id;
+    }
+
+    /// Makes the client a relay: records of the current game are kept in
+    /// @p log (cleared for every new game) and no lines for GUI are made.
+    void relayTo(EventLog *log) {
+        relay_log = log;
+    }
+
+    /// Sets the turn direction sent to the server, as keys of GUI would.
+    void setTurn(uint8_t turn_direction) {
+        key = turn_direction;
+    }
+
+    /// Whether the client simulates the game from the input stream.
+    [[nodiscard]] bool simulatesInputs() const {
+        return capabilities & CAPABILITY_INPUTS;
+    }
+
+    static bool parse(const char *buffer, unsigned buff_len, struct event_t *res) {
+        if (buff_len == 0) {
+            return false;
+        }
+
+        res->len        = get_uint32(buffer);
+
+        if (buff_len < 8 + res->len || res->len < 5) {
+#ifdef DEBUG
+            std::cout << "Invalid length of datagram, cannot calculate crc, ignoring" << std::endl;
+#endif
+            return false;
+        }
+
+        res->event_no   = get_uint32(buffer + 4);
+        res->event_type = get_uint8(buffer + 8);
+        res->data       = buffer + 9;
+
+        res->data_len   = res->len - 5;
+        res->total_len  = res->len + 8;
+
+        res->crc32      = get_uint32(buffer + res->len + 4);
+
+        if (crc32(buffer, res->len + 4) != res->crc32) {
+#ifdef DEBUG
+            std::cout << "Wrong control sum, ignoring" << std::endl;
+#endif
+            return false;
+        }
+
+        return true;
+    }
+
+    void parseMessage(const char *buffer, int len) {
+        uint32_t game_id_rec = get_uint32(buffer);
+
+        if (len < 4) return;
+
+        if (game_id != game_id_rec) {
+            struct event_t first_event{};
+
+            if (parse(buffer + 4, len - 4, &first_event) &&
+                (first_event.event_type == 0 || first_event.event_type == EVENT_NEW_GAME_WIDE)) {
+                // Received event is a proper NEW_GAME event
+                game_id = game_id_rec;
+                next_expected_event_no = 0;
+                stats.events_seen = 0;
+                if (relay_log != nullptr) {
+                    relay_log->clear();
+                    relay_log->setWide(first_event.event_type == EVENT_NEW_GAME_WIDE);
+                }
+            }
+
+            else {
+#ifdef DEBUG
+                std::cout << "Incorrect game_id, ignoring" << std::endl;
+#endif
+                return;
+            }
+        }
+
+        buffer += 4;
+        len -= 4;
+
+        struct event_t event{};
+
+        while (parse(buffer, len, &event)) {
+            buffer += event.total_len;
+            len -= event.total_len;
+            if (event.event_type == EVENT_BOARD_SNAPSHOT) {
+                if (relay_log == nullptr) {
+                    parseSnapshot(&event);
+                }
+            } else {
+                parseEvent(&event);
+            }
+
+            if (resync) {
+                resync = false;
+                game_id = 0;
+                next_expected_event_no = 0;
+                return;
+            }
+        }
+
+        if (len > 0) {
+            stats.crc_failures++;
+        }
+    }
+
+    void parseEvent(const struct event_t *event) {
+        stats.events_seen = std::max(stats.events_seen, event->event_no + 1);
+
+        if (next_expected_event_no != event->event_no) {
+            if (next_expected_event_no < event->event_no) {
+                stats.out_of_order++;
+            } else {
+                stats.duplicates++;
+            }
+#ifdef DEBUG
+            std::cout << "Wrong event number (expected"
+                      << next_expected_event_no << ", got " << event->event_no
+                      << "). Ignoring" << std::endl;
+#endif
+            return;
+        }
+        if (relay_log != nullptr) {
+            relay_log->pushSerialized(event->data - 9, event->total_len);
+            next_expected_event_no++;
+            return;
+        }
+        switch (event->event_type) {
+            case 0:
+                parseNewGame(event);
+                break;
+            case 1:
+                parsePixel(event);
+                break;
+
+            case 2:
+                parsePlayerEliminated(event);
+                break;
+
+            case 3:
+                // GAME OVER
+                break;
+
+            case EVENT_SPAWN:
+                parseSpawn(event);
+                break;
+
+            case EVENT_TICK:
+                parseTick(event);
+                break;
+
+            case EVENT_CHECKSUM:
+                parseChecksum(event);
+                break;
+
+            case EVENT_NEW_GAME_WIDE:
+                parseNewGameWide(event);
+                break;
+
+            case EVENT_PLAYER_NAMES:
+                parsePlayerNames(event);
+                break;
+
+            default:;
+#ifdef DEBUG
+                std::cout << "Unrecognised type of event, stepping over" << std::endl;
+#endif
+        }
+        next_expected_event_no++;
+    }
+
+    /// Reads a player number, of 2 bytes in a wide game.
+    [[nodiscard]] uint16_t getPlayerNumber(const char *data) const {
+        return wide ? get_uint16(data) : get_uint8(data);
+    }
+
+    void parsePlayerEliminated(const struct event_t *event) {
+        if (event->data_len != (wide ? 2 : 1)) {
+            syserr("Incorrect size of PLAYER_ELIMINATED event, aborting.");
+        }
+
+        uint16_t player_number = getPlayerNumber(event->data);
+
+        if (player_number >= players.size()) {
+            syserr("Incorrect player number, aborting.");
+        }
+
+        pushPlayerEliminated(player_number);
+    }
+
+    void pushPlayerEliminated(uint16_t player_number) {
+        if (eliminated[player_number]) {
+            // already known from a snapshot
+            return;
+        }
+        eliminated[player_number] = true;
+
+        events.push(
+                "PLAYER_ELIMINATED " +
+                players[player_number] + "\n");
+    }
+
+    /// Turns events generated by the simulation into lines for GUI.
+    void flushSimulated() {
+        struct event_t event{};
+        for (uint32_t i = 0; i < board->events.size(); i++) {
+            const char *record = board->events.data(i);
+            if (!parse(record, board->events.totalSize(i), &event)) {
+                syserr("Simulation generated an invalid event, aborting.");
+            }
+            if (event.event_type == 1) {
+                parsePixel(&event);
+            } else if (event.event_type == 2) {
+                parsePlayerEliminated(&event);
+            }
+        }
+        board->events.clear();
+    }
+
+    /// Places players as the server did, the simulation of the input stream
+    /// starts. In a wide game every record places some of them.
+    void parseSpawn(const struct event_t *event) {
+        uint32_t header = wide ? 4 : 2;
+        size_t first = wide && event->data_len >= header ? get_uint16(event->data + 2) : 0;
+        size_t count = (event->data_len - header) / 10;
+        if (event->data_len < header || (event->data_len - header) % 10 != 0 ||
+            first + count > players.size() || (!wide && count != players.size())) {
+            syserr("Incorrect size of SPAWN event, aborting.");
+        }
+
+        uint8_t mode = get_uint8(event->data);
+        if (mode > (uint8_t) MovementMode::COMPAT) {
+            syserr("Unknown movement mode, aborting.");
+        }
+        turning_speed = (int8_t) get_uint8(event->data + 1);
+
+        if (first == 0) {
+            if (board == nullptr || (uint32_t) board->max_x != width || (uint32_t) board->max_y != height) {
+                board = std::make_shared<Board>(width, height);
+            }
+            board->prepareNewGame(players.size(), wide);
+            simulated_players.clear();
+        }
+        if (board == nullptr || first != simulated_players.size()) {
+            syserr("SPAWN event out of order, aborting.");
+        }
+
+        const char *p = event->data + header;
+        for (size_t i = first; i < first + count; i++) {
+            uint32_t x = get_uint32(p);
+            uint32_t y = get_uint32(p + 4);
+            int direction = get_uint8(p + 8) * 256 + get_uint8(p + 9);
+            if (x >= width || y >= height || direction >= 360) {
+                syserr("Received illogical event: player out of the board, aborting.");
+            }
+
+            simulated_players.push_back(std::make_shared<Player>(nullptr, board, i, (MovementMode) mode));
+            simulated_players.back()->spawn(x, y, direction);
+            p += 10;
+        }
+        flushSimulated();
+    }
+
+    /// Plays a round with turn directions of the TICK record.
+    void parseTick(const struct event_t *event) {
+        if (board == nullptr || simulated_players.size() != players.size() ||
+            event->data_len != (players.size() + 3) / 4) {
+            syserr("Incorrect TICK event, aborting.");
+        }
+
+        turns.resize(players.size());
+        for (size_t i = 0; i < players.size(); i++) {
+            turns[i] = (get_uint8(event->data + i / 4) >> (2 * (i % 4))) & 3;
+        }
+        playRound(simulated_players, *board, turning_speed, turns.data());
+        flushSimulated();
+    }
+
+    /// Compares the state of the simulation with the server's, falls back to events if they differ.
+    void parseChecksum(const struct event_t *event) {
+        if (board == nullptr || event->data_len != 4) {
+            syserr("Incorrect CHECKSUM event, aborting.");
+        }
+
+        if (stateChecksum(simulated_players, *board, checksum_state) != get_uint32(event->data)) {
+            std::cout << "Simulation of the game differs from the server, falling back to events" << std::endl;
+            capabilities &= ~CAPABILITY_INPUTS;
+            resync = true;
+        }
+    }
+
+    /**
+     * Applies a BOARD_SNAPSHOT record: eaten pixels become PIXEL lines for GUI.
+     * Records of a snapshot are applied only in order, a lost one makes the
+     * client wait for the next snapshot (or events) as it asks for the same
+     * events as before. The last record makes the snapshot's events known.
+     */
+    void parseSnapshot(const struct event_t *event) {
+        if (next_expected_event_no == 0 || next_expected_event_no >= event->event_no || event->data_len < 9 ||
+            players.size() != players_announced) {
+            // no NEW_GAME (or names of players) yet or the events are known already
+            return;
+        }
+
+        uint64_t pos = (uint64_t) get_uint32(event->data + 4) * width + get_uint32(event->data);
+        uint8_t flags = get_uint8(event->data + 8);
+
+        if (pos == 0) {
+            snapshot_event_no = event->event_no;
+            snapshot_pos = 0;
+        } else if (snapshot_event_no != event->event_no || snapshot_pos != pos) {
+#ifdef DEBUG
+            std::cout << "Snapshot record out of order, ignoring" << std::endl;
+#endif
+            return;
+        }
+
+        const char *p = event->data + 9;
+        const char *end = event->data + event->data_len;
+
+        if (flags & SNAPSHOT_ELIMINATED && wide) {
+            size_t bitmap = (players.size() + 7) / 8;
+            if ((size_t) (end - p) < bitmap) {
+                syserr("Incorrect size of BOARD_SNAPSHOT event, aborting.");
+            }
+            for (size_t i = 0; i < players.size(); i++) {
+                if (get_uint8(p + i / 8) >> (i % 8) & 1) {
+                    pushPlayerEliminated(i);
+                }
+            }
+            p += bitmap;
+        } else if (flags & SNAPSHOT_ELIMINATED) {
+            uint8_t count = p < end ? get_uint8(p++) : 0;
+            if (end - p < count) {
+                syserr("Incorrect size of BOARD_SNAPSHOT event, aborting.");
+            }
+            for (; count > 0; count--) {
+                uint8_t player_number = get_uint8(p++);
+                if (player_number >= players.size()) {
+                    syserr("Incorrect player number, aborting.");
+                }
+                pushPlayerEliminated(player_number);
+            }
+        }
+
+        uint64_t pixels = (uint64_t) width * height;
+        while (p < end) {
+            uint32_t run;
+            size_t read = getVarint(p, end, run);
+            if (read == 0 || p + read >= end || pos + run > pixels) {
+                syserr("Received illogical event: run out of the board, aborting.");
+            }
+            p += read;
+            uint32_t owner;
+            if (wide) {
+                read = getVarint(p, end, owner);
+                if (read == 0) {
+                    syserr("Incorrect owner of a run, aborting.");
+                }
+                p += read;
+            } else {
+                owner = get_uint8(p++);
+            }
+
+            if (owner > players.size()) {
+                syserr("Incorrect player number, aborting.");
+            }
+            if (owner != 0) {
+                for (uint64_t i = pos; i < pos + run; i++) {
+                    events.push(
+                            "PIXEL " +
+                            std::to_string(i % width) + " " +
+                            std::to_string(i / width) + " " +
+                            players[owner - 1] + "\n");
+                }
+            }
+            pos += run;
+        }
+        snapshot_pos = pos;
+
+        if (flags & SNAPSHOT_LAST) {
+            next_expected_event_no = event->event_no;
+        }
+    }
+
+    void parsePixel(const struct event_t *event) {
+        uint32_t id_len = wide ? 2 : 1;
+        if (event->data_len != 8 + id_len) {
+            syserr("Incorrect size of PIXEL event, aborting.");
+        }
+
+        uint16_t player_number = getPlayerNumber(event->data);
+        uint32_t x             = get_uint32(event->data + id_len);
+        uint32_t y             = get_uint32(event->data + id_len + 4);
+
+        if (x >= width || y >= height) {
+            syserr("Received illogical event: pixel out of the board, aborting.");
+        }
+
+        if (player_number >= players.size()) {
+            syserr("Incorrect player number, aborting.");
+        }
+
+        events.push(
+                "PIXEL " +
+                std::to_string(x) + " " +
+                std::to_string(y) + " " +
+                players[player_number] + "\n");
+
+    }
+
+    /// Appends zero-terminated names of players from [@p begin, @p end).
+    void parseNames(const char *begin, const char *end) {
+        if (begin == end || end[-1] != '\0') {
+            syserr("Incorrect event, player name is not null terminated, aborting");
+        }
+
+        std::string next_player_name;
+        next_player_name.reserve(MAX_USERNAME_LEN);
+
+        for (const char *i = begin; i < end; ++i) {
+            if (*i == '\0') {
+                if (next_player_name.empty() || next_player_name.size() > MAX_USERNAME_LEN) {
+                    syserr("Invalid length of player name in NEW_GAME event, aborting.");
+                }
+
+                players.push_back(next_player_name);
+                eliminated.push_back(false);
+                next_player_name.clear();
+            }
+
+            else if (*i < 33 || *i > 126) {
+                syserr("Invalid character in NEW_GAME event, aborting.");
+            }
+
+            else {
+                next_player_name += *i;
+            }
+        }
+    }
+
+    /// Tells GUI about the new game, all names of players are known.
+    void pushNewGame() {
+        std::string mess = "NEW_GAME " +
+                std::to_string(width) + " " +
+                std::to_string(height);
+        for (auto &name: players) {
+            mess += " " + name;
+        }
+        events.push(mess + "\n");
+    }
+
+    void parseNewGame(const struct event_t *event) {
+        width  = get_uint32(event->data);
+        height = get_uint32(event->data + 4);
+
+        wide = false;
+        players.clear();
+        eliminated.clear();
+        parseNames(event->data + 8, event->data + event->data_len);
+
+        players_announced = players.size();
+        pushNewGame();
+    }
+
+    void parseNewGameWide(const struct event_t *event) {
+        if (event->data_len != 10) {
+            syserr("Incorrect size of NEW_GAME_WIDE event, aborting.");
+        }
+
+        width  = get_uint32(event->data);
+        height = get_uint32(event->data + 4);
+        players_announced = get_uint16(event->data + 8);
+
+        wide = true;
+        players.clear();
+        eliminated.clear();
+    }
+
+    void parsePlayerNames(const struct event_t *event) {
+        if (!wide) {
+            syserr("PLAYER_NAMES event outside of a wide game, aborting.");
+        }
+        parseNames(event->data, event->data + event->data_len);
+
+        if (players.size() > players_announced) {
+            syserr("More players than announced in NEW_GAME_WIDE event, aborting.");
+        }
+        if (players.size() == players_announced) {
+            pushNewGame();
+        }
+    }
+
+    /**
+     * It parses a message received from GUI and modifies client's state accordingly.
+     * @param buffer    a message as a sequence of characters (not null terminated),
+     * @param buff_len  length of the message.
+     */
+    void parseGUI(const char *buffer, int buff_len) {
+        char left_down[]    = "LEFT_KEY_DOWN\n";
+        char left_up[]      = "LEFT_KEY_UP\n";
+        char right_down[]   = "RIGHT_KEY_DOWN\n";
+        char right_up[]     = "RIGHT_KEY_UP\n";
+
+        if (std::strncmp(buffer, left_down, sizeof(left_down) - 1) == 0 && (sizeof(left_down) - 1) == buff_len) {
+            is_left_down = true;
+            key = 2;
+        }
+        else if (std::strncmp(buffer, left_up, sizeof(left_up) - 1) == 0 && (sizeof(left_up) - 1) == buff_len) {
+            is_left_down = false;
+            if (is_right_down) {
+                key = 1;
+            } else {
+                key = 0;
+            }
+        }
+        else if (std::strncmp(buffer, right_down, sizeof(right_down) - 1) == 0 && (sizeof(right_down) - 1) == buff_len) {
+            is_right_down = true;
+            key = 1;
+        }
+        else if (std::strncmp(buffer, right_up, sizeof(right_up) - 1) == 0 && (sizeof(right_up) - 1) == buff_len) {
+            is_right_down = false;
+            if (is_left_down) {
+                key = 2;
+            } else {
+                key = 0;
+            }
+        }
+        else {
+            std::cout << "Not recognised message from gui, ignoring" << std::endl;
+        }
+    }
+
+    /**
+     * Generates content of a datagram that is send to server every 30ms.
+     * @param mess      is an output parameter - a buffer which must be at least 36 bytes long,
+     * @return          length generated message.
+     */
+    unsigned int generateServerMessage(char *mess) {
+        put_uint64(mess, session_id);
+        put_uint8(mess + 8, key);
+        put_uint32(mess + 9, next_expected_event_no);
+        strcpy(mess + 13, player_name.c_str());
+
+        if (capabilities == 0) {
+            return player_name.size() + 13;
+        }
+
+        // the capability trailer follows the terminating zero of the name
+        put_uint8(mess + 14 + player_name.size(), capabilities);
+        return player_name.size() + 15;
+    }
+};
+
+#endif //CLIENT_STATE_HPP
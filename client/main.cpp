@@ -19,6 +19,8 @@
 #include <cstring>
 
 #include "../utils.hpp"
+#include "../protocol.hpp"
+#include "../multicast.hpp"
 #include "ClientState.hpp"
 
 #define FREQ          30'000'000
@@ -92,17 +94,26 @@ void poll_routine(
         const char *game_server,
         const char *port_gui,
         const char *gui_server,
+        const std::string &group,
         ClientState &cs) {
 
     char buffer[BUFFER_SIZE];
     ssize_t rcv_len, snd_len, len;
 
-    struct pollfd p[3];
+    struct pollfd p[4];
     std::memset(p, 0, sizeof(p));
 
     initServerUDPSocket(&p[1], port_server, game_server);
     initGUITCPSocket(&p[2], port_gui, gui_server);
 
+    // new events come from the multicast group, if any (poll skips a negative fd)
+    p[3].fd = group.empty() ? -1 : joinGroup(parseGroup(group));
+    p[3].events = POLLIN;
+    std::vector<struct sockaddr_in6> group_sources;
+    if (p[3].fd >= 0) {
+        group_sources = serverSources(p[1].fd);
+    }
+
     // Init timer
     struct itimerspec timerValue{};
     int timer_fd;
@@ -128,9 +139,9 @@ void poll_routine(
 
     // wait for events
     while (true) {
-        p[0].revents = p[1].revents = p[2].revents = 0;
+        p[0].revents = p[1].revents = p[2].revents = p[3].revents = 0;
 
-        int numEvents = poll(p, 3, -1);
+        int numEvents = poll(p, 4, -1);
         if (numEvents <= 0) {
             syserr("poll interrupted");
             break;
@@ -168,6 +179,18 @@ void poll_routine(
             }
         }
 
+        if (p[3].revents & POLLIN) {
+            while ((rcv_len = receiveFromServer(p[3].fd, buffer, sizeof(buffer), group_sources)) >= 0) {
+#ifdef DEBUG
+                std::cout << "Message from multicast group, len = " << rcv_len << std::endl;
+#endif
+                cs.parseMessage(buffer, rcv_len);
+            }
+            if (!cs.events.empty()) {
+               p[2].events = POLLOUT;
+            }
+        }
+
         if (p[2].revents & (POLLIN | POLLERR)) {
             rcv_len = read(p[2].fd, buffer, GUI_MAX_MESS);
 #ifdef DEBUG
@@ -205,6 +228,9 @@ void poll_routine(
 
     if (close(p[2].fd) < 0)
         syserr("close");
+
+    if (p[3].fd >= 0 && close(p[3].fd) < 0)
+        syserr("close");
 }
 
 
@@ -213,7 +239,7 @@ int main(int argc, char *argv[]) {
     int c;
 
     if (argc < 2) {
-        syserr("Usage: ./screen-worms-client game_server [-n player_name] [-p n] [-i gui_server] [-r n]");
+        syserr("Usage: ./screen-worms-client game_server [-n player_name] [-p n] [-i gui_server] [-r n] [-s] [-u] [-w] [-g group]");
     }
 
     std::string game_server  = argv[1];
@@ -221,8 +247,10 @@ int main(int argc, char *argv[]) {
     std::string port_server  = "2021";
     std::string gui_server   = "localhost";
     std::string port_gui     = "20210";
+    std::string group;
+    uint8_t capabilities     = 0;
 
-    while ((c = getopt(argc - 1, argv + 1, "n:p:i:r:")) != -1)
+    while ((c = getopt(argc - 1, argv + 1, "n:p:i:r:suwg:")) != -1)
         switch (c) {
             case 'n':
                 player_name = (std::string) optarg;
@@ -242,17 +270,31 @@ int main(int argc, char *argv[]) {
                 }
                 port_gui = (std::string) optarg;
                 break;
+            case 's':
+                capabilities |= CAPABILITY_SNAPSHOT;
+                break;
+            case 'u':
+                capabilities |= CAPABILITY_INPUTS;
+                break;
+            case 'w':
+                capabilities |= CAPABILITY_WIDE;
+                break;
+            case 'g':
+                group = (std::string) optarg;
+                capabilities |= CAPABILITY_MULTICAST;
+                break;
             default:
                 syserr("wrong argument");
         }
 
-    ClientState cs{player_name, session_id};
+    ClientState cs{player_name, session_id, capabilities};
 
     poll_routine(
             port_server.c_str(),
             game_server.c_str(),
             port_gui.c_str(),
             gui_server.c_str(),
+            group,
             cs);
 
     return 0;
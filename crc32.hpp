@@ -0,0 +1,234 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+
+ * With parts of code:
+ * https://web.mit.edu/freebsd/head/sys/libkern/crc32.c
+ * https://chromium.googlesource.com/chromium/src/third_party/zlib/+/refs/heads/main/crc32_simd.c
+ */
+
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL 1
+#endif
+
+/*
+ * CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) of event records.
+ * Implementations work on the internal state (i.e. without the initial and
+ * final inversion) and give bit-identical results:
+ *  - bytewise: one table lookup per byte,
+ *  - slicing8: eight table lookups per 8 bytes,
+ *  - pclmul: folding 64 bytes at a time with carry-less multiplication
+ *    (Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ *    Instruction"), the rest is done by slicing8.
+ * The fastest implementation supported by the CPU is chosen at the first call
+ * of crc32 on a buffer long enough to be folded.
+ */
+namespace crc {
+    constexpr uint32_t POLYNOMIAL = 0xEDB88320;
+
+    using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+    constexpr Tables makeTables() {
+        Tables res{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ POLYNOMIAL : c >> 1;
+            }
+            res[0][i] = c;
+        }
+        for (int t = 1; t < 8; t++) {
+            for (int i = 0; i < 256; i++) {
+                res[t][i] = (res[t - 1][i] >> 8) ^ res[0][res[t - 1][i] & 0xFF];
+            }
+        }
+        return res;
+    }
+
+    /// tables[0] is the table of the bytewise algorithm, tables[t] advances a byte by t more bytes
+    constexpr Tables TABLES = makeTables();
+
+    inline uint32_t bytewise(uint32_t crc, const uint8_t *p, size_t size) {
+        while (size--)
+            crc = TABLES[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+    inline uint32_t slicing8(uint32_t crc, const uint8_t *p, size_t size) {
+        while (size >= 8) {
+            uint32_t lo, hi;
+            std::memcpy(&lo, p, 4);
+            std::memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            lo = __builtin_bswap32(lo);
+            hi = __builtin_bswap32(hi);
+#endif
+            lo ^= crc;
+            crc = TABLES[7][lo & 0xFF] ^ TABLES[6][(lo >> 8) & 0xFF] ^
+                  TABLES[5][(lo >> 16) & 0xFF] ^ TABLES[4][lo >> 24] ^
+                  TABLES[3][hi & 0xFF] ^ TABLES[2][(hi >> 8) & 0xFF] ^
+                  TABLES[1][(hi >> 16) & 0xFF] ^ TABLES[0][hi >> 24];
+            p += 8;
+            size -= 8;
+        }
+        return bytewise(crc, p, size);
+    }
+
+#ifdef CRC32_HAVE_PCLMUL
+    /// Folds @p size bytes (at least 64, a multiple of 16), constants of the paper
+    /// are for the bit-reflected domain.
+    __attribute__((target("pclmul,sse4.1")))
+    inline uint32_t foldPclmul(uint32_t crc, const uint8_t *buf, size_t size) {
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+        x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+        x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+        x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+        x0 = _mm_load_si128((const __m128i *) k1k2);
+
+        buf += 64;
+        size -= 64;
+
+        // fold four blocks of 16 bytes in parallel
+        while (size >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            y5 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+            y6 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+            y7 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+            y8 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+            buf += 64;
+            size -= 64;
+        }
+
+        // fold into 128 bits
+        x0 = _mm_load_si128((const __m128i *) k3k4);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // fold the remaining blocks of 16 bytes
+        while (size >= 16) {
+            x2 = _mm_loadu_si128((const __m128i *) buf);
+
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+            buf += 16;
+            size -= 16;
+        }
+
+        // fold 128 bits to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128((const __m128i *) poly);
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (uint32_t) _mm_extract_epi32(x1, 1);
+    }
+
+    inline uint32_t pclmul(uint32_t crc, const uint8_t *p, size_t size) {
+        if (size >= 64) {
+            size_t folded = size & ~(size_t) 15;
+            crc = foldPclmul(crc, p, folded);
+            p += folded;
+            size -= folded;
+        }
+        return slicing8(crc, p, size);
+    }
+#endif
+
+    inline bool hasPclmul() {
+#ifdef CRC32_HAVE_PCLMUL
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+        return false;
+#endif
+    }
+
+    using update_t = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+
+    /// The implementation chosen for this CPU.
+    inline update_t update() {
+        static const update_t chosen = [] {
+#ifdef CRC32_HAVE_PCLMUL
+            if (hasPclmul()) return (update_t) pclmul;
+#endif
+            return (update_t) slicing8;
+        }();
+        return chosen;
+    }
+
+    /// Short buffers (most of event records) cannot be folded, they skip the dispatch.
+    inline uint32_t dispatched(uint32_t crc, const uint8_t *p, size_t size) {
+        if (size < 64) {
+            return slicing8(crc, p, size);
+        }
+        return update()(crc, p, size);
+    }
+}
+
+inline uint32_t crc32(const void *buf, size_t size) {
+    return ~crc::dispatched(~0U, (const uint8_t *) buf, size);
+}
+
+#endif //CRC32_HPP
@@ -0,0 +1,240 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef MULTICAST_HPP
+#define MULTICAST_HPP
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+/*
+ * Multicast group to which a server sends new events of its game once for
+ * all clients of a segment (see CAPABILITY_MULTICAST). A group is given as
+ * "address[:port]": an IPv4 address (e.g. 239.255.0.1:2023) or an IPv6 one in
+ * brackets, which may name the interface after % (e.g. [ff02::1%eth0]:2023).
+ * IPv4 groups are kept mapped to IPv6, as the sockets of the server are
+ * dual-stack. A link-local IPv6 group (ff02::/16) has to name the interface
+ * for clients.
+ *
+ * Anybody on the segment may send to a group, so clients take datagrams of
+ * the group only from the game server (see serverSources).
+ */
+
+constexpr uint16_t DEFAULT_MULTICAST_PORT = 2023;
+
+/// Parses group @p spec, exits on a malformed one.
+inline struct sockaddr_in6 parseGroup(const std::string &spec) {
+    std::string address = spec, port;
+    if (!spec.empty() && spec[0] == '[') {
+        size_t end = spec.find(']');
+        if (end == std::string::npos) {
+            syserr("Provided multicast group is malformed (missing ']').");
+        }
+        address = spec.substr(1, end - 1);
+        if (end + 1 < spec.size()) {
+            if (spec[end + 1] != ':') {
+                syserr("Provided multicast group is malformed (port should follow ':').");
+            }
+            port = spec.substr(end + 2);
+        }
+    } else if (spec.find(':') != std::string::npos && spec.find(':') == spec.rfind(':')) {
+        address = spec.substr(0, spec.find(':'));
+        port = spec.substr(spec.find(':') + 1);
+    }
+
+    struct sockaddr_in6 res{};
+    res.sin6_family = AF_INET6;
+    res.sin6_port = htons(DEFAULT_MULTICAST_PORT);
+    if (!port.empty()) {
+        int value = parseNumericParam(port.c_str());
+        if (value <= 0 || value > 65535) {
+            syserr("Provided port of the multicast group is unreasonable.");
+        }
+        res.sin6_port = htons(value);
+    }
+
+    size_t percent = address.find('%');
+    if (percent != std::string::npos) {
+        res.sin6_scope_id = if_nametoindex(address.substr(percent + 1).c_str());
+        if (res.sin6_scope_id == 0) {
+            syserr("Provided interface of the multicast group does not exist.");
+        }
+        address.resize(percent);
+    }
+
+    struct in_addr v4{};
+    if (inet_pton(AF_INET, address.c_str(), &v4) == 1) {
+        // ::ffff:a.b.c.d
+        res.sin6_addr.s6_addr[10] = 0xff;
+        res.sin6_addr.s6_addr[11] = 0xff;
+        std::memcpy(res.sin6_addr.s6_addr + 12, &v4, 4);
+    } else if (inet_pton(AF_INET6, address.c_str(), &res.sin6_addr) != 1) {
+        syserr("Provided multicast group is not an IPv4 nor IPv6 address.");
+    }
+
+    bool multicast = IN6_IS_ADDR_V4MAPPED(&res.sin6_addr) ? IN_MULTICAST(ntohl(v4.s_addr))
+                                                          : IN6_IS_ADDR_MULTICAST(&res.sin6_addr);
+    if (!multicast) {
+        syserr("Provided group is not a multicast address.");
+    }
+    return res;
+}
+
+/// Makes datagrams to @p group sent with @p sock leave by its interface (if
+/// named) and loop back to the host, so that local clients get them too.
+inline void setMulticastSender(int sock, const struct sockaddr_in6 &group) {
+    int loop = 1;
+    if (IN6_IS_ADDR_V4MAPPED(&group.sin6_addr)) {
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0)
+            syserr("setsockopt IP_MULTICAST_LOOP");
+        return;
+    }
+
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop, sizeof(loop)) != 0)
+        syserr("setsockopt IPV6_MULTICAST_LOOP");
+    unsigned int interface = group.sin6_scope_id;
+    if (interface != 0 && setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &interface, sizeof(interface)) != 0)
+        syserr("setsockopt IPV6_MULTICAST_IF");
+}
+
+/// Address @p addr (IPv4 or IPv6) as IPv6, an IPv4 one mapped.
+inline struct sockaddr_in6 mappedAddress(const struct sockaddr *addr) {
+    if (addr->sa_family == AF_INET6) {
+        return *(const struct sockaddr_in6 *) addr;
+    }
+    const auto *v4 = (const struct sockaddr_in *) addr;
+    struct sockaddr_in6 res{};
+    res.sin6_family = AF_INET6;
+    res.sin6_port = v4->sin_port;
+    res.sin6_addr.s6_addr[10] = 0xff;
+    res.sin6_addr.s6_addr[11] = 0xff;
+    std::memcpy(res.sin6_addr.s6_addr + 12, &v4->sin_addr, 4);
+    return res;
+}
+
+/**
+ * Addresses from which the game server at @p server sends datagrams of its
+ * group: its own one or, for a server on this host (reached by a loopback
+ * address), any address of the host, as datagrams of a group leave by
+ * another interface. All of them with the port of the server.
+ */
+inline std::vector<struct sockaddr_in6> serverSources(const struct sockaddr *server) {
+    std::vector<struct sockaddr_in6> res = {mappedAddress(server)};
+    const struct in6_addr &address = res[0].sin6_addr;
+    bool loopback = IN6_IS_ADDR_LOOPBACK(&address) ||
+                    (IN6_IS_ADDR_V4MAPPED(&address) && address.s6_addr[12] == 127);
+    if (!loopback) {
+        return res;
+    }
+
+    struct ifaddrs *interfaces;
+    if (getifaddrs(&interfaces) != 0) {
+        syserr("getifaddrs");
+    }
+    for (struct ifaddrs *i = interfaces; i != nullptr; i = i->ifa_next) {
+        if (i->ifa_addr != nullptr && (i->ifa_addr->sa_family == AF_INET || i->ifa_addr->sa_family == AF_INET6)) {
+            res.push_back(mappedAddress(i->ifa_addr));
+            res.back().sin6_port = res[0].sin6_port;
+        }
+    }
+    freeifaddrs(interfaces);
+    return res;
+}
+
+/// Addresses from which the game server that @p sock is connected to sends datagrams of its group.
+inline std::vector<struct sockaddr_in6> serverSources(int sock) {
+    struct sockaddr_storage server{};
+    socklen_t len = sizeof(server);
+    if (getpeername(sock, (struct sockaddr *) &server, &len) != 0) {
+        syserr("getpeername");
+    }
+    return serverSources((const struct sockaddr *) &server);
+}
+
+/**
+ * Reads the next datagram of the group from @p sock into @p buffer of @p size
+ * bytes. Datagrams from addresses other than @p sources (see serverSources)
+ * are dropped, so that nobody else on the segment can inject events.
+ * @return      length of the datagram, -1 if there are no more.
+ */
+inline ssize_t receiveFromServer(int sock, char *buffer, size_t size, const std::vector<struct sockaddr_in6> &sources) {
+    while (true) {
+        struct sockaddr_storage from{};
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(sock, buffer, size, 0, (struct sockaddr *) &from, &from_len);
+        if (len < 0) {
+            return len;
+        }
+        struct sockaddr_in6 source = mappedAddress((const struct sockaddr *) &from);
+        for (auto &allowed: sources) {
+            if (allowed.sin6_port == source.sin6_port &&
+                std::memcmp(&allowed.sin6_addr, &source.sin6_addr, sizeof(source.sin6_addr)) == 0) {
+                return len;
+            }
+        }
+    }
+}
+
+/// Opens a non-blocking socket receiving datagrams sent to @p group. Other
+/// sockets of the host (e.g. other clients) may join the same group. The
+/// socket is bound to the group, so it gets neither datagrams sent to the
+/// port of the host nor those of other groups the host has joined.
+inline int joinGroup(const struct sockaddr_in6 &group) {
+    bool v4 = IN6_IS_ADDR_V4MAPPED(&group.sin6_addr);
+    int sock = socket(v4 ? AF_INET : AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) syserr("Failed to open multicast socket.");
+
+    int reuse = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0)
+        syserr("setsockopt SO_REUSEADDR");
+
+    int rv;
+    if (v4) {
+        struct sockaddr_in address{};
+        address.sin_family = AF_INET;
+        std::memcpy(&address.sin_addr, group.sin6_addr.s6_addr + 12, 4);
+        address.sin_port = group.sin6_port;
+        rv = bind(sock, (struct sockaddr *) &address, sizeof(address));
+
+        struct ip_mreq request{};
+        std::memcpy(&request.imr_multiaddr, group.sin6_addr.s6_addr + 12, 4);
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (rv == 0 && setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0)
+            syserr("setsockopt IP_ADD_MEMBERSHIP");
+    } else {
+        if (IN6_IS_ADDR_MC_LINKLOCAL(&group.sin6_addr) && group.sin6_scope_id == 0) {
+            syserr("Provided link-local multicast group should name the interface (e.g. [ff02::1%eth0]).");
+        }
+        struct sockaddr_in6 address = group;
+        rv = bind(sock, (struct sockaddr *) &address, sizeof(address));
+
+        struct ipv6_mreq request{};
+        request.ipv6mr_multiaddr = group.sin6_addr;
+        request.ipv6mr_interface = group.sin6_scope_id;
+        if (rv == 0 && setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &request, sizeof(request)) != 0)
+            syserr("setsockopt IPV6_JOIN_GROUP");
+    }
+    if (rv < 0) syserr("bind of multicast socket");
+
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) != 0) {
+        syserr("fctl failed.");
+    }
+    return sock;
+}
+
+#endif //MULTICAST_HPP
@@ -0,0 +1,136 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Extensions of the protocol shared by the server and the client.
+ *
+ * A client announces extensions it understands with a trailer of its
+ * datagram: the player name is followed by a zero byte and a byte of
+ * capability flags. Old clients send no trailer and get events only.
+ *
+ * BOARD_SNAPSHOT records (event type 4) are sent only to clients with
+ * CAPABILITY_SNAPSHOT. Their event_no is the first event that the snapshot
+ * does not cover (pixels eaten by later events may be shown already), their
+ * data is:
+ *  - x, y (4 bytes each): the pixel the record starts with,
+ *  - flags (1 byte): SNAPSHOT_LAST if it is the last record of the snapshot,
+ *    SNAPSHOT_ELIMINATED if a list of eliminated players follows,
+ *  - [count (1 byte) and numbers of eliminated players (1 byte each)],
+ *  - runs of pixels in row-major order up to the end of the record, each of
+ *    them a length (LEB128) and an owner (1 byte, 0 for free pixels and
+ *    player_number + 1 for eaten ones).
+ * The first datagram of a snapshot starts with the NEW_GAME event.
+ *
+ * Clients with CAPABILITY_INPUTS get the input stream of a game instead of
+ * its events: records numbered on their own, from which the client computes
+ * the events by running the rounds itself (see playRound in Player.hpp):
+ *  - NEW_GAME (0), the same as in the events,
+ *  - SPAWN (5): movement mode (1 byte, MovementMode), turning speed (1 byte,
+ *    signed) and x, y (4 bytes each) and direction (2 bytes) of every player,
+ *  - TICK (6), one per round: turn directions of all players, 2 bits each,
+ *    four players in a byte from the lowest bits (TURN_NONE for values that
+ *    are not valid turn directions, such player does not move),
+ *  - CHECKSUM (7), every CHECKSUM_INTERVAL rounds: stateChecksum (4 bytes)
+ *    of the game after the last TICK; a client that computes another one
+ *    falls back to events,
+ *  - GAME_OVER (3).
+ *
+ * Protocol v2 (CAPABILITY_WIDE) lets games have more players than the names
+ * of NEW_GAME fit in a datagram and than 1-byte player numbers can tell. Games
+ * of at most V1_MAX_PLAYERS players are sent as before, larger ones and those
+ * whose names do not fit in NEW_GAME (wide games) differ in:
+ *  - NEW_GAME_WIDE (8) instead of NEW_GAME: maxx, maxy (4 bytes each) and
+ *    the number of players (2 bytes), followed by PLAYER_NAMES (9) records
+ *    with consecutive zero-terminated names, as many as fit in a datagram,
+ *  - player numbers of PIXEL and PLAYER_ELIMINATED of 2 bytes,
+ *  - SPAWN records, as many as needed, with the number of the first player
+ *    they place (2 bytes) after the turning speed,
+ *  - BOARD_SNAPSHOT records with owners of runs in LEB128 and eliminated
+ *    players as a bitmap of all players (the lowest bit of the first byte
+ *    for player 0),
+ *  - the first datagrams of a snapshot, which start with NEW_GAME_WIDE and
+ *    all PLAYER_NAMES.
+ * A room for more than V1_MAX_PLAYERS clients admits only clients with
+ * CAPABILITY_WIDE, older ones are not answered as if the server was full.
+ *
+ * A client with CAPABILITY_MULTICAST has joined the multicast group of the
+ * server (see multicast.hpp). A server sending to a group sends new events
+ * there once per datagram instead of to every such client, the datagrams are
+ * the same. Missed events are still sent to the client itself.
+ */
+
+constexpr uint8_t CAPABILITY_SNAPSHOT  = 1;
+constexpr uint8_t CAPABILITY_INPUTS    = 2;
+constexpr uint8_t CAPABILITY_WIDE      = 4;
+constexpr uint8_t CAPABILITY_MULTICAST = 8;
+
+constexpr uint8_t EVENT_BOARD_SNAPSHOT = 4;
+constexpr uint8_t EVENT_SPAWN          = 5;
+constexpr uint8_t EVENT_TICK           = 6;
+constexpr uint8_t EVENT_CHECKSUM       = 7;
+constexpr uint8_t EVENT_NEW_GAME_WIDE  = 8;
+constexpr uint8_t EVENT_PLAYER_NAMES   = 9;
+
+/// the greatest datagram with events, with game_id
+constexpr int MAX_DATAGRAM_SIZE = 548;
+/// the greatest data of a record that fits in a datagram
+constexpr uint32_t MAX_RECORD_DATA = MAX_DATAGRAM_SIZE - 4 - 13;
+
+/// players whose names fit in NEW_GAME, more make a wide game
+constexpr int V1_MAX_PLAYERS = 25;
+/// players of a wide game, TICK has to fit in a datagram
+constexpr int MAX_PLAYERS = 2048;
+
+constexpr uint8_t TURN_NONE = 3;
+constexpr int CHECKSUM_INTERVAL = 25;
+
+constexpr uint8_t SNAPSHOT_LAST       = 1;
+constexpr uint8_t SNAPSHOT_ELIMINATED = 2;
+
+/// Length of the longest encoded run, in games and in wide games.
+constexpr size_t MAX_RUN_SIZE      = 6;
+constexpr size_t MAX_WIDE_RUN_SIZE = 8;
+
+/// Whether a game of @p players players, whose names (with their terminating
+/// zeros) take @p names_size bytes, is a wide one: NEW_GAME has to fit in a datagram.
+inline bool isWideGame(size_t players, size_t names_size) {
+    // maxx and maxy precede the names
+    return players > V1_MAX_PLAYERS || 8 + names_size > MAX_RECORD_DATA;
+}
+
+/// Writes @p value in LEB128.
+/// @return     number of bytes written.
+inline size_t putVarint(char *dst, uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        dst[len++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+    dst[len++] = (char) value;
+    return len;
+}
+
+/// Reads LEB128 from [@p src, @p end).
+/// @return     number of bytes read, 0 if the value is malformed.
+inline size_t getVarint(const char *src, const char *end, uint32_t &value) {
+    value = 0;
+    for (size_t len = 0; len < 5 && src + len < end; len++) {
+        auto byte = (uint8_t) src[len];
+        value |= (uint32_t) (byte & 0x7F) << (7 * len);
+        if ((byte & 0x80) == 0) {
+            return len + 1;
+        }
+    }
+    return 0;
+}
+
+#endif //PROTOCOL_HPP
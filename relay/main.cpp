@@ -0,0 +1,334 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Relay of a game server for spectators. It joins the server as a single
+ * observer (a standard client with ClientState) and keeps the events of the
+ * current game, which it serves to any number of standard clients as the
+ * server would: new events are broadcast as they come, missed ones are sent
+ * by CatchUp with its budgets and retransmission timeouts. The server pays
+ * for one observer however many people watch. A relay talks to its clients
+ * like a server, so relays can be chained.
+ *
+ * Usage: ./screen-worms-relay game_server [-p n] [-l n] [-v n] [-e backend] [-b n] [-B n] [-C n] [-S n]
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "../client/ClientState.hpp"
+#include "../server/BatchIO.hpp"
+#include "../server/CatchUp.hpp"
+#include "../server/ClientKey.hpp"
+#include "../server/EventLoop.hpp"
+#include "../server/Game.hpp"
+#include "../server/UringLoop.hpp"
+#include "../server/convertions.hpp"
+
+#define BUFFER_SIZE         600
+#define DEFAULT_MAX_CLIENTS 65536
+#define USAGE "Usage: ./screen-worms-relay game_server [-p n] [-l n] [-v n] [-e backend] [-b n] [-B n] [-C n] [-S n]"
+
+/// Opens the socket the relay is reached at, it talks to the server as well.
+int initRelaySocket(const char *port) {
+    int sock = socket(PF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) syserr("socket");
+
+    struct sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(atoi(port));
+
+    int v6OnlyEnabled = 0;
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &v6OnlyEnabled, sizeof(v6OnlyEnabled)) != 0)
+        syserr("setsockopt");
+
+    int rxqOvflEnabled = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &rxqOvflEnabled, sizeof(rxqOvflEnabled)) != 0)
+        syserr("setsockopt SO_RXQ_OVFL");
+
+    if (bind(sock, (struct sockaddr *) &address, (socklen_t) sizeof(address)) < 0)
+        syserr("bind");
+
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) != 0)
+        syserr("fctl failed.");
+
+    return sock;
+}
+
+/// Address of the game server as seen by a dual-stack socket (IPv4 mapped to IPv6).
+struct sockaddr_in6 resolveServer(const char *name, const char *port) {
+    struct addrinfo addr_hints{}, *addr_result;
+
+    addr_hints.ai_family = AF_INET6;
+    addr_hints.ai_flags = AI_V4MAPPED;
+    addr_hints.ai_socktype = SOCK_DGRAM;
+    addr_hints.ai_protocol = IPPROTO_UDP;
+
+    if (getaddrinfo(name, port, &addr_hints, &addr_result) != 0) {
+        syserr("getaddrinfo");
+    }
+
+    struct sockaddr_in6 res{};
+    std::memcpy(&res, addr_result->ai_addr, sizeof(res));
+    freeaddrinfo(addr_result);
+    return res;
+}
+
+/**
+ * Events of the game come from the server instead of being played: the
+ * relay's Game holds no players, its event log is filled by ClientState and
+ * its clients are all observers. Everything else (admission of clients,
+ * their inactivity, packing events into datagrams, catching up) is the code
+ * of the server.
+ */
+class RelayHandler : public EventLoop::Handler {
+    const struct sockaddr_in6 server;
+    const ClientKey server_key;
+    const int stats_interval;
+
+    ClientState upstream;
+    Game game;
+    CatchUp catch_up;
+    Sender &sender;
+    IOStats &io;
+
+    char buffer[BUFFER_SIZE];
+    std::vector<ClientKey> dropped;
+
+    uint64_t upstream_datagrams;
+    uint64_t upstream_printed;
+    uint64_t games;
+    IOStats io_printed;
+    std::chrono::steady_clock::time_point next_stats;
+
+    /// The server has started game upstream.gameId(), its first records are in the log already.
+    void newGame() {
+        game.game_id = upstream.gameId();
+        game.datagrams.reset(game.game_id);
+        game.board->event_to_broadcast = 0;
+        games++;
+
+        // clients of protocol v1 could not parse records of a wide game
+        game.v2_only = game.board->events.isWide();
+        dropped.clear();
+        for (auto &it: game.client_map) {
+            it.second->resetEvents();
+            if (game.v2_only && !(it.second->capabilities & CAPABILITY_WIDE)) {
+                dropped.push_back(it.first);
+            }
+        }
+        for (auto &key: dropped) {
+            game.eraseClient(key);
+        }
+    }
+
+    void handleServer(char *data, int len) {
+        upstream_datagrams++;
+        upstream.parseMessage(data, len);
+        if (upstream.gameId() != game.game_id) {
+            newGame();
+        }
+        // at once, so that the events of a game are out before the next game clears the log
+        broadcastNewEvents(game, sender, buffer);
+    }
+
+    void handleClient(char *data, int len, struct sockaddr_in6 *addr) {
+        if (is_client_mess_ok(len) != 1) {
+            return;
+        }
+        auto mess = convert(data, len, addr);
+        // everybody watches, in the stream of events
+        mess.player_name.clear();
+        mess.capabilities &= CAPABILITY_WIDE;
+
+        ClientKey client_id(addr);
+        int64_t now = CatchUp::now();
+        if (!game.handleClient(client_id, mess, now)) {
+            return;
+        }
+
+        Client &client = **game.client_map.find(client_id);
+        if (game.setCapabilities(client, mess.capabilities)) {
+            client.resetEvents();
+        }
+        catch_up.request(game, client, mess.next_expected_event_no, now);
+        catch_up.serve(game, client, sender, buffer, now);
+    }
+
+    void printStats() {
+        IOStats diff = io.since(io_printed);
+        char id[16];
+        std::snprintf(id, sizeof(id), "%08x", game.game_id);
+        std::cout << "Relay: game " << id << " (" << games << " so far), events " << game.board->events.size()
+                  << ", clients " << game.client_map.size()
+                  << ", server datagrams/s " << (upstream_datagrams - upstream_printed) / stats_interval
+                  << ", datagrams out/s " << diff.datagrams_out / stats_interval
+                  << ", KiB out/s " << diff.bytes_out / stats_interval / 1024
+                  << ", catch-up KiB/s " << catch_up.bytes_sent / stats_interval / 1024
+                  << ", retransmissions " << catch_up.retransmissions << std::endl;
+        io_printed = io;
+        upstream_printed = upstream_datagrams;
+        catch_up.bytes_sent = catch_up.datagrams_sent = catch_up.retransmissions = 0;
+    }
+
+public:
+    RelayHandler(const struct sockaddr_in6 &server_p, Sender &sender_p, IOStats &io_p, int max_clients,
+                 const CatchUpBudget &budget, int stats_interval_p) :
+            server(server_p), server_key(&server), stats_interval(stats_interval_p),
+            upstream("", time(nullptr), CAPABILITY_WIDE),
+            game(0, 1, 1, 0, MovementMode::FIXED, max_clients),
+            catch_up(budget), sender(sender_p), io(io_p), buffer(),
+            upstream_datagrams(0), upstream_printed(0), games(0),
+            next_stats(std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval_p)) {
+        upstream.relayTo(&game.board->events);
+        game.v2_only = false;
+    }
+
+    void onTimer(size_t, const Tick &) override {
+        int64_t now = CatchUp::now();
+        game.disconnectInactiveClients(now);
+
+        int len = (int) upstream.generateServerMessage(buffer);
+        sender.send(buffer, len, server);
+
+        catch_up.tick(game, sender, buffer, now);
+    }
+
+    void onDatagram(char *data, int len, struct sockaddr_in6 *addr) override {
+        if (ClientKey(addr) == server_key) {
+            handleServer(data, len);
+        } else {
+            handleClient(data, len, addr);
+        }
+    }
+
+    void onWakeup() override {}
+
+    void onBatchEnd() override {
+        sender.flush();
+
+        if (stats_interval > 0 && std::chrono::steady_clock::now() >= next_stats) {
+            printStats();
+            next_stats += std::chrono::seconds(stats_interval);
+        }
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        syserr(USAGE);
+    }
+
+    std::string game_server = argv[1];
+    std::string port_server = "2021";
+    std::string port        = "2022";
+    std::string backend     = "poll";
+    long rounds_per_sec     = 50;
+    int max_clients         = DEFAULT_MAX_CLIENTS;
+    int stats_interval      = 0;
+    CatchUpBudget budget    = {4 * MAX_DATAGRAM_SIZE, 64 * 1024};
+    int c;
+
+    while ((c = getopt(argc - 1, argv + 1, "p:l:v:e:b:B:C:S:")) != -1)
+        switch (c) {
+            case 'p':
+                if (parseNumericParam(optarg) < 0) {
+                    syserr("Port number cannot be negative.");
+                }
+                port_server = (std::string) optarg;
+                break;
+            case 'l':
+                if (parseNumericParam(optarg) < 0) {
+                    syserr("Port number cannot be negative.");
+                }
+                port = (std::string) optarg;
+                break;
+            case 'v':
+                rounds_per_sec = parseNumericParam(optarg);
+                break;
+            case 'e':
+                backend = (std::string) optarg;
+                break;
+            case 'b':
+                budget.per_client = parseNumericParam(optarg);
+                break;
+            case 'B':
+                budget.global = parseNumericParam(optarg);
+                break;
+            case 'C':
+                max_clients = parseNumericParam(optarg);
+                break;
+            case 'S':
+                stats_interval = parseNumericParam(optarg);
+                break;
+            default:
+                syserr(USAGE);
+        }
+
+    if (rounds_per_sec <= 0 || rounds_per_sec > 500) {
+        syserr("Provided number of rounds per second is unreasonable (should be between 1 and 500).");
+    }
+
+    if (max_clients <= 0) {
+        syserr("Provided number of clients is unreasonable (should be positive).");
+    }
+
+    if (stats_interval < 0) {
+        syserr("Interval of statistics cannot be negative.");
+    }
+
+    if (budget.per_client < MAX_DATAGRAM_SIZE || budget.global < budget.per_client) {
+        syserr("Provided catch-up budgets are unreasonable (should be at least 548 bytes per tick "
+               "for a client and at least as much for the relay).");
+    }
+
+    if (backend != "poll" && backend != "io_uring") {
+        syserr("Provided event loop backend is unknown (should be poll or io_uring).");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_in6 server = resolveServer(game_server.c_str(), port_server.c_str());
+    int sock = initRelaySocket(port.c_str());
+    int event_fd = eventfd(0, EFD_NONBLOCK);
+    IOStats io;
+
+    std::unique_ptr<EventLoop> loop;
+    if (backend == "io_uring") {
+        loop = std::make_unique<UringLoop>(sock, event_fd, io);
+    } else {
+        loop = std::make_unique<PollLoop>(sock, event_fd, io);
+    }
+    Sender sender;
+    sender.init(loop.get(), &io);
+    loop->addTimer(SECOND / rounds_per_sec, CatchUpPolicy::DROP);
+
+    std::cout << "Relaying " << game_server << ":" << port_server << " on port: " << port << std::endl;
+    RelayHandler handler(server, sender, io, max_clients, budget, stats_interval);
+    loop->run(handler);
+
+    close(event_fd);
+    if (close(sock) < 0)
+        syserr("close");
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef BATCH_IO_HPP
+#define BATCH_IO_HPP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "DatagramCache.hpp"
+
+constexpr int RECV_BATCH_SIZE = 64;
+constexpr int SEND_BATCH_SIZE = 1024;
+constexpr int RECV_BUFFER_SIZE = 600;
+
+/// Counters of system calls and datagrams of a socket, since it has been opened.
+struct IOStats {
+    uint64_t recv_calls = 0;
+    uint64_t send_calls = 0;
+    uint64_t datagrams_in = 0;
+    uint64_t datagrams_out = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t send_errors = 0;
+    /// datagrams dropped by the kernel as the receive queue was full (SO_RXQ_OVFL)
+    uint64_t rx_queue_drops = 0;
+    /// datagrams the socket had no room for, put into outbound queues
+    uint64_t queued_out = 0;
+    /// of them, sent when the socket has become writable
+    uint64_t queued_sent = 0;
+    /// datagrams dropped as outbound queues were full
+    uint64_t queue_drops = 0;
+    /// datagrams waiting in outbound queues now
+    uint64_t queue_depth = 0;
+
+    /// Counters since @p earlier values.
+    [[nodiscard]] IOStats since(const IOStats &earlier) const {
+        IOStats res;
+        res.recv_calls = recv_calls - earlier.recv_calls;
+        res.send_calls = send_calls - earlier.send_calls;
+        res.datagrams_in = datagrams_in - earlier.datagrams_in;
+        res.datagrams_out = datagrams_out - earlier.datagrams_out;
+        res.bytes_in = bytes_in - earlier.bytes_in;
+        res.bytes_out = bytes_out - earlier.bytes_out;
+        res.send_errors = send_errors - earlier.send_errors;
+        res.rx_queue_drops = rx_queue_drops - earlier.rx_queue_drops;
+        res.queued_out = queued_out - earlier.queued_out;
+        res.queued_sent = queued_sent - earlier.queued_sent;
+        res.queue_drops = queue_drops - earlier.queue_drops;
+        res.queue_depth = queue_depth;
+        return res;
+    }
+};
+
+/// space for the SO_RXQ_OVFL control message of a received datagram
+constexpr size_t RECV_CONTROL_SIZE = CMSG_SPACE(sizeof(uint32_t));
+
+/// Takes the number of drops of the socket from control messages of a received
+/// datagram, present only once the kernel has dropped something.
+inline void recordRxQueueDrops(struct msghdr *hdr, IOStats &stats) {
+    if (hdr->msg_controllen == 0) {
+        return;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (drops > stats.rx_queue_drops) {
+                stats.rx_queue_drops = drops;
+            }
+        }
+    }
+}
+
+/// Receives up to RECV_BATCH_SIZE datagrams with a single recvmmsg.
+class Receiver {
+    std::array<struct mmsghdr, RECV_BATCH_SIZE> msgs{};
+    std::array<struct iovec, RECV_BATCH_SIZE> iovs{};
+    std::array<struct sockaddr_in6, RECV_BATCH_SIZE> addrs{};
+    std::array<std::array<char, RECV_BUFFER_SIZE>, RECV_BATCH_SIZE> buffers{};
+    std::array<std::array<char, RECV_CONTROL_SIZE>, RECV_BATCH_SIZE> controls{};
+
+public:
+    Receiver() {
+        for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+            iovs[i].iov_base = buffers[i].data();
+            iovs[i].iov_len = RECV_BUFFER_SIZE;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    /// Receives pending datagrams without blocking.
+    /// @return     number of received datagrams (0 on error).
+    int receive(int sock, IOStats &stats) {
+        for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_control = controls[i].data();
+            msgs[i].msg_hdr.msg_controllen = RECV_CONTROL_SIZE;
+        }
+
+        int res = recvmmsg(sock, msgs.data(), RECV_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        stats.recv_calls++;
+        if (res <= 0) {
+            return 0;
+        }
+
+        stats.datagrams_in += res;
+        for (int i = 0; i < res; i++) {
+            stats.bytes_in += msgs[i].msg_len;
+            recordRxQueueDrops(&msgs[i].msg_hdr, stats);
+        }
+        return res;
+    }
+
+    char *data(int i) { return buffers[i].data(); }
+    int len(int i) const { return (int) msgs[i].msg_len; }
+    struct sockaddr_in6 *addr(int i) { return &addrs[i]; }
+};
+
+/// Something that can send a batch of datagrams, e.g. an event loop.
+class BatchSink {
+public:
+    virtual ~BatchSink() = default;
+
+    /**
+     * Sends datagrams @p msgs, or keeps those the socket has no room for until
+     * it has. A datagram that cannot be sent to its client is skipped.
+     */
+    virtual void sendBatch(struct mmsghdr *msgs, unsigned int n, IOStats &stats) = 0;
+};
+
+/// Sends datagrams @p msgs with sendmmsg, indices of those the socket had no room for are appended to @p blocked.
+inline void sendBatchMmsg(int sock, struct mmsghdr *msgs, unsigned int n, IOStats &stats,
+                          std::vector<unsigned int> &blocked) {
+    unsigned int sent = 0;
+
+    while (sent < n) {
+        int res = sendmmsg(sock, msgs + sent, n - sent, 0);
+        stats.send_calls++;
+
+        if (res <= 0) {
+#ifdef DEBUG
+            std::cout << "Error on sending data to client " << errno << std::endl;
+#endif
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                for (unsigned int i = sent; i < n; i++) {
+                    blocked.push_back(i);
+                }
+                break;
+            }
+            stats.send_errors++;
+            sent++;
+            continue;
+        }
+
+        for (unsigned int i = sent; i < sent + res; i++) {
+            stats.bytes_out += msgs[i].msg_len;
+        }
+        stats.datagrams_out += res;
+        sent += res;
+    }
+}
+
+/**
+ * Datagrams waiting to be sent in one batch. A datagram is copied once
+ * (with store) and may then be addressed to any number of clients, which is
+ * how a broadcast of a tick costs a single system call. Datagrams in memory
+ * that outlives the batch (e.g. a mapped recording) are queued without being
+ * copied at all. The queue is flushed when it is full and at the end of every
+ * batch of work of the event loop.
+ */
+class Sender {
+    BatchSink *sink;
+
+    std::vector<std::unique_ptr<std::array<char, MAX_DATAGRAM_SIZE>>> slab;
+    size_t slab_used;
+
+    std::vector<struct mmsghdr> msgs;
+    std::vector<struct iovec> iovs;
+    std::vector<struct sockaddr_in6> addrs;
+    size_t queued;
+
+    void queue(const char *head, int head_len, const char *body, int body_len, const struct sockaddr_in6 &addr) {
+        addrs[queued] = addr;
+        struct iovec *iov = &iovs[2 * queued];
+        iov[0].iov_base = (void *) head;
+        iov[0].iov_len = head_len;
+        iov[1].iov_base = (void *) body;
+        iov[1].iov_len = body_len;
+
+        struct msghdr &hdr = msgs[queued].msg_hdr;
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &addrs[queued];
+        hdr.msg_namelen = sizeof(addrs[queued]);
+        hdr.msg_iov = iov;
+        hdr.msg_iovlen = body == nullptr ? 1 : 2;
+
+        queued++;
+    }
+
+public:
+    IOStats *stats;
+
+    Sender() : sink(nullptr), slab_used(0), msgs(SEND_BATCH_SIZE), iovs(2 * SEND_BATCH_SIZE),
+               addrs(SEND_BATCH_SIZE), queued(0), stats(nullptr) {}
+
+    void init(BatchSink *sink_p, IOStats *stats_p) {
+        sink = sink_p;
+        stats = stats_p;
+    }
+
+    /// Copies a datagram to the queue's memory, valid until the next flush.
+    const char *store(const char *data, int len) {
+        if (slab_used == SEND_BATCH_SIZE) {
+            flush();
+        }
+        if (slab_used == slab.size()) {
+            slab.emplace_back(new std::array<char, MAX_DATAGRAM_SIZE>);
+        }
+        char *res = slab[slab_used++]->data();
+        std::memcpy(res, data, len);
+        return res;
+    }
+
+    /// Queues datagram @p data, which must have been returned by store.
+    /// @return     where the datagram is now, it moves when the queue is flushed.
+    const char *add(const char *data, int len, const struct sockaddr_in6 &addr) {
+        if (queued == SEND_BATCH_SIZE) {
+            flush(data);
+            data = slab[0]->data();
+        }
+
+        queue(data, len, nullptr, 0, addr);
+        return data;
+    }
+
+    /**
+     * Queues a datagram of two parts, @p head followed by @p body, without
+     * copying them: both must stay valid until the queue is flushed, e.g. lie
+     * in a mapped file.
+     */
+    void addParts(const char *head, int head_len, const char *body, int body_len, const struct sockaddr_in6 &addr) {
+        if (queued == SEND_BATCH_SIZE) {
+            flush();
+        }
+        queue(head, head_len, body, body_len, addr);
+    }
+
+    /// Copies a datagram and queues it for a single client.
+    void send(const char *data, int len, const struct sockaddr_in6 &addr) {
+        add(store(data, len), len, addr);
+    }
+
+    /**
+     * Sends all queued datagrams.
+     * @param keep      a stored datagram that is still needed, after the flush it
+     *                  is moved to the beginning of the queue's memory.
+     */
+    void flush(const char *keep = nullptr) {
+        if (queued > 0) {
+            sink->sendBatch(msgs.data(), queued, *stats);
+        }
+        queued = 0;
+
+        if (keep != nullptr) {
+            std::memmove(slab[0]->data(), keep, MAX_DATAGRAM_SIZE);
+            slab_used = 1;
+        } else {
+            slab_used = 0;
+        }
+    }
+};
+
+#endif //BATCH_IO_HPP
@@ -1,57 +1,78 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef BOARD_HPP
-#define BOARD_HPP
-
-#include <unordered_set>
-#include <vector>
-#include "Event.hpp"
-
-struct Board;
-using board_ptr = std::shared_ptr<Board>;
-
-struct pair_hash {
-    template <class T1, class T2>
-    std::size_t operator() (std::pair<T1, T2> const &pair) const {
-        std::size_t h1 = std::hash<T1>()(pair.first);
-        std::size_t h2 = std::hash<T2>()(pair.second);
-        return h1 ^ h2;
-    }
-};
-
-struct Board {
-    const int max_x;
-    const int max_y;
-    std::unordered_set<std::pair<int, int>, pair_hash> eaten_pixels;
-
-    // adding elements to this container does not invalidate iterators.
-    std::vector<event_ptr> events;
-
-    int players_playing;
-
-    int event_to_broadcast;
-
-    Board(int max_x_p, int max_y_p) :
-            max_x(max_x_p),
-            max_y(max_y_p),
-            players_playing(0),
-            event_to_broadcast(0) {}
-
-    bool contains(std::pair<int, int> p) {
-        return eaten_pixels.find(p) != eaten_pixels.end();
-    }
-
-    void prepareNewGame(int players) {
-        eaten_pixels.clear();
-        events.clear();
-        players_playing = players;
-        event_to_broadcast = 0;
-    }
-
-};
-
-#endif //BOARD_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef BOARD_HPP
+#define BOARD_HPP
+
+#include <memory>
+#include "Event.hpp"
+#include "OccupancyGrid.hpp"
+#include "ClientKey.hpp"
+
+struct Board;
+using board_ptr = std::shared_ptr<Board>;
+
+struct Board {
+    const int max_x;
+    const int max_y;
+    OccupancyGrid eaten_pixels;
+    /// hash of the set of eaten pixels with their owners
+    uint64_t pixels_hash;
+
+    EventLog events;
+    /// input stream of the game (see protocol.hpp)
+    EventLog inputs;
+
+    int players_playing;
+
+    int event_to_broadcast;
+    int input_to_broadcast;
+
+    Board(int max_x_p, int max_y_p) :
+            max_x(max_x_p),
+            max_y(max_y_p),
+            eaten_pixels(max_x_p, max_y_p),
+            pixels_hash(0),
+            players_playing(0),
+            event_to_broadcast(0),
+            input_to_broadcast(0) {}
+
+    bool contains(std::pair<int, int> p) {
+        return eaten_pixels.contains(p);
+    }
+
+    void eat(std::pair<int, int> p, uint16_t owner) {
+        eaten_pixels.insert(p, owner);
+        pixels_hash ^= mixHash(((uint64_t) p.first << 40) ^ ((uint64_t) (owner >> 8) << 32) ^
+                               ((uint64_t) p.second << 8) ^ (owner & 0xFF));
+    }
+
+    /// Events or the input stream.
+    EventLog &log(bool input_stream) {
+        return input_stream ? inputs : events;
+    }
+
+    /// The first record of the events or the input stream that has not been broadcast.
+    int &toBroadcast(bool input_stream) {
+        return input_stream ? input_to_broadcast : event_to_broadcast;
+    }
+
+    /// Clears the board for a game of @p players players, a wide one if @p wide (see protocol.hpp).
+    void prepareNewGame(int players, bool wide) {
+        eaten_pixels.clear();
+        pixels_hash = 0;
+        events.clear();
+        inputs.clear();
+        events.setWide(wide);
+        inputs.setWide(wide);
+        players_playing = players;
+        event_to_broadcast = 0;
+        input_to_broadcast = 0;
+    }
+
+};
+
+#endif //BOARD_HPP
@@ -0,0 +1,359 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef CATCH_UP_HPP
+#define CATCH_UP_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../protocol.hpp"
+#include "Game.hpp"
+#include "BatchIO.hpp"
+#include "Snapshot.hpp"
+
+/// Limits of sending missed events, in bytes of datagrams per tick.
+struct CatchUpBudget {
+    /// for a single client
+    int64_t per_client;
+    /// for all clients of a room together
+    int64_t global;
+};
+
+/**
+ * Paced sending of events that a client has missed (an observer joining
+ * during a game, a client that lost datagrams). New events are broadcast to
+ * everybody on every tick; older ones are sent to a client only while its
+ * token bucket, refilled by per_client bytes every tick, and the budget of
+ * the room for the current tick allow. When the budget does not suffice for
+ * everybody, it is shared in turns by all lagging clients, starting from
+ * a different one every tick. Broadcasts are queued before missed events, so
+ * live players never wait behind a download of history.
+ *
+ * Events the client asks for again are not sent again while they may still be
+ * on their way: a client usually asks for an event that has just been
+ * broadcast, its datagram crossing ours. They are retransmitted only when the
+ * client has not acknowledged anything new for its retransmission timeout.
+ *
+ * A client understanding snapshots that misses more events than a snapshot
+ * of the board and the events after it take, is sent these instead. The
+ * snapshot is shared by the whole room and built again only when the events
+ * after it outweigh it. It is built a part per tick, meanwhile clients are
+ * sent events (and switch to the snapshot once it is complete).
+ *
+ * Clients of the input stream are sent its records in the same way, numbers
+ * they ask for refer to them.
+ *
+ * Lagging clients are kept on a list from their request until they have
+ * caught up (or left the room), so a tick costs nothing for the others.
+ */
+class CatchUp {
+    const CatchUpBudget budget;
+    int64_t global_tokens;
+    size_t round;
+    /// clients that may be catching up, the list holds them while they are on it
+    std::vector<client_ptr> lagging;
+    std::shared_ptr<const Snapshot> snapshot;
+    /// snapshot under construction, if any
+    std::shared_ptr<Snapshot> building;
+
+    /// Sends the next datagram of the snapshot being sent to @p client if budgets allow.
+    bool sendSnapshot(Client &client, Sender &sender, int64_t now) {
+        const Snapshot::Page &page = client.snapshot->pages[client.snapshot_page];
+        int len = (int) page.len;
+        if (len > client.catch_up_tokens || len > global_tokens) {
+            return false;
+        }
+
+        sender.send(page.data, len, client.addr);
+        client.catch_up_tokens -= len;
+        global_tokens -= len;
+        bytes_sent += len;
+        datagrams_sent++;
+
+        if (++client.snapshot_page == client.snapshot->pages.size()) {
+            client.recordSent(client.snapshot_from, client.snapshot->event_no, now);
+            client.snapshot.reset();
+        }
+        return true;
+    }
+
+    /// Whether @p snap shows the board of @p game, whose events it may be followed by.
+    static bool isOfGame(const Snapshot &snap, Game &game) {
+        return snap.game_id == game.game_id && snap.event_no <= game.board->events.size();
+    }
+
+    /// The last snapshot of the board of @p game, null if there is none yet. A new one
+    /// is started when sending the events after the last one costs more than it.
+    std::shared_ptr<const Snapshot> currentSnapshot(Game &game) {
+        bool usable = snapshot != nullptr && isOfGame(*snapshot, game);
+        if ((!usable || game.datagramsFrom(snapshot->event_no) > snapshot->pages.size()) &&
+            (building == nullptr || !isOfGame(*building, game))) {
+            building = std::make_shared<Snapshot>(game);
+        }
+        return usable ? snapshot : nullptr;
+    }
+
+    /// Builds the next part of the snapshot under construction, if any.
+    void buildSnapshot(Game &game) {
+        if (building == nullptr) {
+            return;
+        }
+        if (!isOfGame(*building, game)) {
+            building.reset();
+        } else if (building->build(*game.board, SNAPSHOT_PIXELS_PER_TICK)) {
+            snapshot = std::move(building);
+            snapshots_built++;
+        }
+    }
+
+    /// Starts sending a snapshot to @p client, which asks for events from @p from,
+    /// if it understands them and they are cheaper than the events.
+    bool startSnapshot(Game &game, Client &client, uint32_t from) {
+        if (!(client.capabilities & CAPABILITY_SNAPSHOT) || client.streamsInputs()) {
+            return false;
+        }
+        size_t replay = game.datagramsFrom(from);
+        if (replay < MIN_SNAPSHOT_DATAGRAMS) {
+            return false;
+        }
+
+        std::shared_ptr<const Snapshot> current = currentSnapshot(game);
+        if (current == nullptr || current->event_no <= from ||
+            current->pages.size() + game.datagramsFrom(current->event_no) >= replay) {
+            return false;
+        }
+
+        client.snapshot = current;
+        client.snapshot_page = 0;
+        client.snapshot_from = from;
+        client.catch_up_next = current->event_no;
+        snapshots_sent++;
+        return true;
+    }
+
+    /// Sends the next missed datagram to @p client if budgets allow.
+    /// @return     whether a datagram has been sent.
+    bool sendNext(Game &game, Client &client, Sender &sender, char *buffer, int64_t now) {
+        if (client.snapshot != nullptr) {
+            return sendSnapshot(client, sender, now);
+        }
+
+        unsigned int end = client.catch_up_end;
+        if (client.catch_up_next >= end) {
+            client.catching_up = false;
+            return false;
+        }
+
+        unsigned int from = client.catch_up_next;
+        int len;
+        const char *datagram = game.getDatagram(from, len, buffer, client.streamsInputs());
+        if (len <= 0 || len > client.catch_up_tokens || len > global_tokens) {
+            return false;
+        }
+
+        sender.send(datagram, len, client.addr);
+        client.recordSent(client.catch_up_next, from, now);
+        client.catch_up_tokens -= len;
+        global_tokens -= len;
+        bytes_sent += len;
+        datagrams_sent++;
+
+        client.catch_up_next = std::min(from, end);
+        if (client.catch_up_next >= end) {
+            client.catching_up = false;
+        }
+        return true;
+    }
+
+    /// Counts bytes of events [from, to) of the stream of @p client as not sent twice.
+    void avoided(Game &game, const Client &client, uint32_t from, uint32_t to) {
+        bytes_avoided += game.board->log(client.streamsInputs()).totalSize(from, to);
+    }
+
+public:
+    /// shorter replays are not worth a snapshot
+    static constexpr size_t MIN_SNAPSHOT_DATAGRAMS = 4;
+
+    uint64_t bytes_sent;
+    uint64_t datagrams_sent;
+    /// bytes of events asked for again but still in flight
+    uint64_t bytes_avoided;
+    /// requests that found the client's acknowledgement stalled
+    uint64_t retransmissions;
+    uint64_t snapshots_built;
+    uint64_t snapshots_sent;
+
+    explicit CatchUp(const CatchUpBudget &budget_p) :
+            budget(budget_p), global_tokens(budget_p.global), round(0), bytes_sent(0), datagrams_sent(0),
+            bytes_avoided(0), retransmissions(0), snapshots_built(0), snapshots_sent(0) {}
+
+    /// Current time for the timestamps of clients, in nanoseconds.
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// Events (or the input stream, if @p input_stream) [from, to) have been
+    /// broadcast to all clients of @p game that get them.
+    static void broadcast(Game &game, bool input_stream, uint32_t from, uint32_t to, int64_t now) {
+        if (from >= to) {
+            return;
+        }
+        for (int subscription = Game::EVENTS; subscription <= Game::INPUTS; subscription++) {
+            if ((subscription == Game::INPUTS) != input_stream) {
+                continue;
+            }
+            for (Client *client: game.subscribers[subscription]) {
+                client->recordSent(from, to, now);
+            }
+        }
+    }
+
+    /**
+     * Client @p client asks for events starting with @p from, i.e. it has got
+     * all earlier ones. Events that have not been broadcast yet will be
+     * broadcast at the next tick. A client that is already being sent missed
+     * events continues from where it is, unless it asks for later events.
+     * Events sent recently are not sent again until the client's
+     * acknowledgement stalls.
+     */
+    void request(Game &game, Client &client, uint32_t from, int64_t now) {
+        client.acknowledge(from, now);
+
+        uint32_t end = game.board->toBroadcast(client.streamsInputs());
+        if (from >= end) {
+            return;
+        }
+        if (client.catching_up) {
+            if (from > client.catch_up_next) {
+                client.catch_up_next = from;
+            } else {
+                avoided(game, client, from, client.catch_up_next);
+            }
+            if (client.snapshot == nullptr) {
+                // the snapshot may have been completed in the meantime
+                startSnapshot(game, client, client.catch_up_next);
+            }
+            return;
+        }
+
+        bool in_flight = from >= client.sent_begin && from < client.sent_end;
+        if (in_flight && !client.ackStalled(now)) {
+            avoided(game, client, from, std::min(client.sent_end, end));
+            return;
+        }
+        if (in_flight) {
+            // give the retransmission a whole timeout before the next one,
+            // its acknowledgement does not measure the round trip (Karn)
+            client.acked_time = now;
+            client.probe_time = -1;
+            retransmissions++;
+        }
+
+        client.catching_up = true;
+        if (!client.lagging) {
+            client.lagging = true;
+            lagging.push_back(*game.client_map.find(ClientKey(&client.addr)));
+        }
+        client.catch_up_next = from;
+        // events sent recently follow those that have never been sent
+        client.catch_up_end = !in_flight && from < client.sent_begin && !client.ackStalled(now) ?
+                              client.sent_begin : end;
+        client.catch_up_tokens = budget.per_client;
+        startSnapshot(game, client, from);
+    }
+
+    /// Sends missed events to @p client as far as budgets allow, right after its datagram.
+    void serve(Game &game, Client &client, Sender &sender, char *buffer, int64_t now) {
+        while (client.catching_up && sendNext(game, client, sender, buffer, now)) {}
+    }
+
+    /// Refills budgets and shares them among lagging clients, called every tick after broadcasting.
+    void tick(Game &game, Sender &sender, char *buffer, int64_t now) {
+        global_tokens = budget.global;
+        buildSnapshot(game);
+
+        for (size_t k = 0; k < lagging.size();) {
+            Client &client = *lagging[k];
+            client_ptr *current = game.client_map.find(ClientKey(&client.addr));
+            if (!client.catching_up || current == nullptr || current->get() != &client) {
+                // caught up, or dropped or replaced by a new session
+                client.lagging = false;
+                lagging[k] = std::move(lagging.back());
+                lagging.pop_back();
+                continue;
+            }
+            client.catch_up_tokens = std::min(client.catch_up_tokens + budget.per_client,
+                                              2 * budget.per_client);
+            k++;
+        }
+        if (lagging.empty()) {
+            return;
+        }
+
+        size_t start = round++ % lagging.size();
+        bool progress = true;
+        while (progress && global_tokens > 0) {
+            progress = false;
+            for (size_t k = 0; k < lagging.size(); k++) {
+                Client &client = *lagging[(start + k) % lagging.size()];
+                if (client.catching_up && sendNext(game, client, sender, buffer, now)) {
+                    progress = true;
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Queues datagrams with new events for all clients, every datagram is stored once.
+ * Only subscribers of a stream are looked at, a stream nobody gets costs nothing.
+ * @param group     multicast group (if not null) to which events are sent once
+ *                  for all clients that listen to it.
+ */
+inline void broadcastNewEvents(Game &game, Sender &sender, char *buffer,
+                               const struct sockaddr_in6 *group = nullptr) {
+    int64_t now = CatchUp::now();
+
+    for (bool input_stream: {false, true}) {
+        int &to_broadcast = game.board->toBroadcast(input_stream);
+        uint32_t end = game.board->log(input_stream).size();
+
+        // clients sent datagrams one by one, listeners of the group (if any) are sent them once
+        const std::vector<Client *> &unicast = game.subscribers[input_stream ? Game::INPUTS : Game::EVENTS];
+        const std::vector<Client *> &listeners = game.subscribers[Game::MULTICAST_EVENTS];
+        bool with_listeners = !input_stream && !listeners.empty();
+        bool multicast = with_listeners && group != nullptr;
+
+        int len;
+        unsigned int from = to_broadcast;
+        while (from < end && (!unicast.empty() || with_listeners)) {
+
+            const char *datagram = game.getDatagram(from, len, buffer, input_stream);
+            if (len <= 0) break;
+
+            const char *stored = sender.store(datagram, len);
+            if (multicast) {
+                stored = sender.add(stored, len, *group);
+            } else if (with_listeners) {
+                for (Client *client: listeners) {
+                    stored = sender.add(stored, len, client->addr);
+                }
+            }
+            for (Client *client: unicast) {
+                stored = sender.add(stored, len, client->addr);
+            }
+
+        }
+        CatchUp::broadcast(game, input_stream, to_broadcast, end, now);
+        to_broadcast = end;
+    }
+}
+
+#endif //CATCH_UP_HPP
@@ -1,42 +1,162 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef CLIENT_HPP
-#define CLIENT_HPP
-
-#include <atomic>
-#include <utility>
-#include <memory>
-
-struct Client;
-using client_ptr = std::shared_ptr<Client>;
-
-
-enum ClientState {
-    OBSERVER,
-    LOST,
-    JOINED,
-    PLAYING,
-    READY
-};
-
-struct Client {
-    ClientState state;
-    std::string player_name;
-    uint64_t session_id;
-    time_t last_datagram_time;
-    uint8_t last_turn_direction;
-    struct sockaddr_in6 addr;
-
-    Client(ClientState state, std::string playerName, uint64_t sessionId, time_t lastDatagramTime,
-           uint8_t lastTurnDirection, struct sockaddr_in6 *addr_p) : state(state), player_name(std::move(playerName)), session_id(sessionId),
-                                                              last_datagram_time(lastDatagramTime), last_turn_direction(lastTurnDirection), addr() {
-        addr = *addr_p;
-    }
-};
-
-
-#endif //CLIENT_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef CLIENT_HPP
+#define CLIENT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <memory>
+
+#include "../protocol.hpp"
+
+struct Client;
+using client_ptr = std::shared_ptr<Client>;
+
+class Snapshot;
+
+/// bounds of the retransmission timeout of events, in nanoseconds
+constexpr int64_t MIN_RTO     = 10'000'000;
+constexpr int64_t INITIAL_RTO = 100'000'000;
+constexpr int64_t MAX_RTO     = 1'000'000'000;
+
+
+enum ClientStatus {
+    OBSERVER,
+    LOST,
+    JOINED,
+    PLAYING,
+    READY
+};
+
+struct Client {
+    ClientStatus state;
+    std::string player_name;
+    uint64_t session_id;
+    /// in nanoseconds of a monotonic clock
+    int64_t last_datagram_time;
+    uint8_t last_turn_direction;
+    struct sockaddr_in6 addr;
+
+    /// whether the client is sent events it has missed (see CatchUp)
+    bool catching_up = false;
+    /// whether the client is on the list of lagging clients of CatchUp
+    bool lagging = false;
+    /// the next missed event to send
+    uint32_t catch_up_next = 0;
+    /// the first event that is not missed, later ones are broadcast
+    uint32_t catch_up_end = 0;
+    /// bytes that can be sent to the client (token bucket)
+    int64_t catch_up_tokens = 0;
+
+    /// extensions of the protocol understood by the client (see protocol.hpp)
+    uint8_t capabilities = 0;
+    /// extensions asked for, capabilities lack CAPABILITY_INPUTS while the game
+    /// does not build the input stream (see Game::setCapabilities)
+    uint8_t requested_capabilities = 0;
+    /// position of the client in the list of Game::subscribers of its stream
+    size_t subscriber_index = 0;
+
+    /// snapshot of the board being sent instead of events [snapshot_from, its event_no)
+    std::shared_ptr<const Snapshot> snapshot;
+    size_t snapshot_page = 0;
+    uint32_t snapshot_from = 0;
+
+    /// events [sent_begin, sent_end) of the current game have been sent to the client
+    uint32_t sent_begin = 0;
+    uint32_t sent_end = 0;
+
+    /// the next event expected by the client and since when (in ns) it has
+    /// been expected, i.e. how long the client's acknowledgement has stalled
+    uint32_t acked = 0;
+    int64_t acked_time = 0;
+
+    /// smoothed round trip time and its variation (in ns, as in TCP)
+    int64_t srtt = 0;
+    int64_t rttvar = 0;
+    /// measurement in progress: the time event probe_event - 1 was sent (or -1)
+    uint32_t probe_event = 0;
+    int64_t probe_time = -1;
+
+    Client(ClientStatus state, std::string playerName, uint64_t sessionId, int64_t lastDatagramTime,
+           uint8_t lastTurnDirection, struct sockaddr_in6 *addr_p) : state(state), player_name(std::move(playerName)), session_id(sessionId),
+                                                              last_datagram_time(lastDatagramTime), last_turn_direction(lastTurnDirection), addr() {
+        addr = *addr_p;
+    }
+
+    /// Events [from, to) have been sent to the client at @p now.
+    void recordSent(uint32_t from, uint32_t to, int64_t now) {
+        if (from >= to) return;
+        if (sent_end <= acked) {
+            // nothing was in flight, the acknowledgement is awaited from now on
+            acked_time = now;
+        }
+        if (from <= sent_end && to >= sent_begin && sent_end > sent_begin) {
+            sent_begin = std::min(sent_begin, from);
+            sent_end = std::max(sent_end, to);
+        } else if (to > sent_end) {
+            // keep the most recent range
+            sent_begin = from;
+            sent_end = to;
+        }
+
+        if (probe_time < 0) {
+            probe_event = to;
+            probe_time = now;
+        }
+    }
+
+    /// The client expects event @p next at @p now, so it has got all earlier ones.
+    void acknowledge(uint32_t next, int64_t now) {
+        if (probe_time >= 0 && next >= probe_event) {
+            int64_t sample = now - probe_time;
+            if (srtt == 0) {
+                srtt = sample;
+                rttvar = sample / 2;
+            } else {
+                rttvar = (3 * rttvar + std::abs(srtt - sample)) / 4;
+                srtt = (7 * srtt + sample) / 8;
+            }
+            probe_time = -1;
+        }
+
+        if (next > acked) {
+            acked = next;
+            acked_time = now;
+        }
+    }
+
+    /// Whether the client gets the input stream instead of events.
+    [[nodiscard]] bool streamsInputs() const {
+        return capabilities & CAPABILITY_INPUTS;
+    }
+
+    /// Time after which unacknowledged events are sent again (in ns).
+    [[nodiscard]] int64_t retransmissionTimeout() const {
+        if (srtt == 0) return INITIAL_RTO;
+        return std::clamp(srtt + 4 * rttvar, MIN_RTO, MAX_RTO);
+    }
+
+    /// Whether the client has not acknowledged anything for longer than the timeout.
+    [[nodiscard]] bool ackStalled(int64_t now) const {
+        return now - acked_time >= retransmissionTimeout();
+    }
+
+    /// Forgets events sent in the previous game (the round trip time estimate stays).
+    void resetEvents() {
+        catching_up = false;
+        snapshot.reset();
+        sent_begin = sent_end = 0;
+        acked = 0;
+        probe_time = -1;
+    }
+};
+
+
+#endif //CLIENT_HPP
@@ -0,0 +1,95 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef CLIENT_KEY_HPP
+#define CLIENT_KEY_HPP
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "misc.hpp"
+
+constexpr int MAX_PLAYER_NAME_LENGTH = 20;
+
+/// Mixes bits of @p x, so that every bit of the result depends on every bit of @p x.
+inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * Identifies a client by its address, port and scope. The server socket is
+ * dual-stack, so IPv4 clients have IPv4-mapped addresses (::ffff:a.b.c.d)
+ * and are never confused with IPv6 ones. Padding is zeroed, so keys are
+ * compared as bytes.
+ */
+struct ClientKey {
+    uint8_t addr[16];
+    uint32_t scope;
+    uint16_t port;
+    uint16_t padding;
+
+    ClientKey() : addr(), scope(0), port(0), padding(0) {}
+
+    explicit ClientKey(const struct sockaddr_in6 *address) : scope(address->sin6_scope_id),
+                                                             port(address->sin6_port), padding(0) {
+        std::memcpy(addr, &address->sin6_addr, sizeof(addr));
+    }
+
+    bool operator==(const ClientKey &other) const {
+        return std::memcmp(this, &other, sizeof(ClientKey)) == 0;
+    }
+
+    [[nodiscard]] uint64_t hash() const {
+        uint64_t a, b;
+        std::memcpy(&a, addr, 8);
+        std::memcpy(&b, addr + 8, 8);
+        return mixHash(a ^ mixHash(b ^ ((uint64_t) port << 32 | scope)));
+    }
+
+    /// Address and port in text form, for debugging.
+    [[nodiscard]] std::string toString() const {
+        char peer_addr[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, addr, peer_addr, sizeof(peer_addr));
+        return toSocket(peer_addr, ntohs(port));
+    }
+};
+
+/// Name of a player stored inline, for sets of names that do not allocate.
+struct NameKey {
+    char name[MAX_PLAYER_NAME_LENGTH];
+    uint8_t len;
+
+    NameKey() : name(), len(0) {}
+
+    explicit NameKey(const std::string &name_p) : name(), len(name_p.size()) {
+        std::memcpy(name, name_p.data(), len);
+    }
+
+    bool operator==(const NameKey &other) const {
+        return len == other.len && std::memcmp(name, other.name, len) == 0;
+    }
+
+    [[nodiscard]] uint64_t hash() const {
+        uint64_t res = len;
+        for (int i = 0; i < MAX_PLAYER_NAME_LENGTH; i += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, name + i, std::min(8, MAX_PLAYER_NAME_LENGTH - i));
+            res = mixHash(res ^ word);
+        }
+        return res;
+    }
+};
+
+#endif //CLIENT_KEY_HPP
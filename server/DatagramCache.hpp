@@ -0,0 +1,142 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef DATAGRAM_CACHE_HPP
+#define DATAGRAM_CACHE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "Event.hpp"
+
+/**
+ * Datagrams with events of the current game, packed in advance. Events are
+ * laid out greedily into pages of at most MAX_DATAGRAM_SIZE bytes, each
+ * starting with game_id, so that a response starting at the first event of
+ * a page is the page itself. The last page is filled up as new events come.
+ * For every event the cache remembers the page it lies in and its position
+ * in the page, so a response starting in the middle of a page is its tail.
+ */
+class DatagramCache {
+public:
+    struct Page {
+        uint32_t len;
+        /// events [first_event, end_event) are in the page
+        uint32_t first_event;
+        uint32_t end_event;
+        char data[MAX_DATAGRAM_SIZE];
+    };
+
+private:
+    static constexpr uint32_t OFFSET_BITS = 10;
+
+    /// pages are reused by the following games, only the first used_pages
+    /// of them belong to the current game
+    std::vector<std::unique_ptr<Page>> pages;
+    size_t used_pages;
+
+    /// location[i] = (page << OFFSET_BITS) + position of i-th event in page
+    std::vector<uint32_t> location;
+
+    uint32_t game_id;
+
+    Page &newPage(uint32_t first_event) {
+        if (used_pages == pages.size()) {
+            pages.emplace_back(new Page);
+        }
+        Page &page = *pages[used_pages++];
+        put_uint32(page.data, game_id);
+        page.len = 4;
+        page.first_event = first_event;
+        page.end_event = first_event;
+        return page;
+    }
+
+public:
+    DatagramCache() : used_pages(0), game_id(0) {}
+
+    /// Forgets all pages, the next events belong to game @p game_id_p.
+    void reset(uint32_t game_id_p) {
+        game_id = game_id_p;
+        used_pages = 0;
+        location.clear();
+    }
+
+    /// Packs events from @p log that are not in the cache yet, every record has to fit in a datagram.
+    void sync(const EventLog &log) {
+        for (uint32_t event_no = location.size(); event_no < log.size(); event_no++) {
+            uint32_t size = log.totalSize(event_no);
+            if (size > MAX_DATAGRAM_SIZE - 4) {
+                syserr("Record " + std::to_string(event_no) + " does not fit in a datagram.");
+            }
+
+            Page *page = used_pages == 0 ? nullptr : pages[used_pages - 1].get();
+            if (page == nullptr || page->len + size > MAX_DATAGRAM_SIZE) {
+                page = &newPage(event_no);
+            }
+
+            location.push_back(((used_pages - 1) << OFFSET_BITS) + page->len);
+            std::memcpy(page->data + page->len, log.data(event_no), size);
+            page->len += size;
+            page->end_event++;
+        }
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return location.size();
+    }
+
+    /**
+     * Finds the datagram with events starting from @p from.
+     * @param from      number of the first event to send, on return the number
+     *                  of the first event that was not included,
+     * @param len       output parameter - length of the datagram, 0 if there are
+     *                  no events to send,
+     * @param buffer    at least MAX_DATAGRAM_SIZE long, used if @p from is not
+     *                  the first event of a page,
+     * @return          pointer to the datagram - either to a page of the cache
+     *                  or to @p buffer.
+     */
+    const char *datagram(unsigned int &from, int &len, char *buffer) const {
+        if (from >= location.size()) {
+            len = 0;
+            return buffer;
+        }
+
+        const Page &page = *pages[location[from] >> OFFSET_BITS];
+        uint32_t offset = location[from] & ((1u << OFFSET_BITS) - 1);
+        from = page.end_event;
+
+        if (offset == 4) {
+            len = (int) page.len;
+            return page.data;
+        }
+
+        put_uint32(buffer, game_id);
+        std::memcpy(buffer + 4, page.data + offset, page.len - offset);
+        len = (int) (page.len - offset + 4);
+        return buffer;
+    }
+
+    /// Number of datagrams needed to send events starting from @p from.
+    [[nodiscard]] size_t datagramsFrom(uint32_t from) const {
+        if (from >= location.size()) {
+            return 0;
+        }
+        return used_pages - (location[from] >> OFFSET_BITS);
+    }
+
+    [[nodiscard]] size_t memoryUsage() const {
+        return pages.size() * sizeof(Page) + location.capacity() * sizeof(uint32_t);
+    }
+};
+
+#endif //DATAGRAM_CACHE_HPP
@@ -1,104 +1,287 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef EVENT_HPP
-#define EVENT_HPP
-
-#include <vector>
-#include <cstring>
-#include <arpa/inet.h>
-#include <memory>
-
-#include "../utils.hpp"
-
-struct Event;
-using event_ptr = std::shared_ptr<Event>;
-
-struct Event {
-    uint32_t total_size;
-    char *content;
-
-    /// New game constructor
-    Event(  uint32_t event_num,
-            const std::vector<std::string> &names,
-            uint32_t maxx,
-            uint32_t maxy) {
-
-        uint32_t len = 13;
-
-        for (auto &name: names) {
-            len += name.size() + 1;
-        }
-
-        total_size = len + 8;
-        content = new char[total_size];
-
-        put_uint32(content, len);
-        put_uint32(content + 4, event_num);
-        put_uint8(content + 8, 0);
-        put_uint32(content + 9, maxx);
-        put_uint32(content + 13, maxy);
-
-        uint32_t ind = 17;
-        for (auto &name: names) {
-            std::strcpy(content + ind, name.c_str());
-            ind += name.size() + 1;
-        }
-
-        put_uint32(content + ind, crc32(content, ind));
-
-    }
-
-    /// Pixel constructor
-    Event(uint32_t event_num, uint8_t player_number, uint32_t x, uint32_t y) {
-        uint32_t len = 14;
-        total_size = len + 8;
-        content = new char[total_size];
-
-        put_uint32(content, len);
-        put_uint32(content + 4, event_num);
-        put_uint8(content + 8, 1);
-        put_uint8(content + 9, player_number);
-        put_uint32(content + 10, x);
-        put_uint32(content + 14, y);
-        put_uint32(content + 18, crc32(content, 18));
-
-    }
-
-    /// Player eliminated constructor
-    Event(uint32_t event_num, uint8_t player_number) {
-        uint32_t len = 6;
-        total_size = len + 8;
-        content = new char[total_size];
-
-        put_uint32(content, len);
-        put_uint32(content + 4, event_num);
-        put_uint8(content + 8, 2);
-        put_uint8(content + 9, player_number);
-        put_uint32(content + 10, crc32(content, 10));
-    }
-
-
-    /// Game over constructor
-    explicit Event(uint32_t event_num) {
-        uint32_t len = 5;
-        total_size = len + 8;
-        content = new char[total_size];
-
-        put_uint32(content, len);
-        put_uint32(content + 4, event_num);
-        put_uint8(content + 8, 3);
-        put_uint32(content + 9, crc32(content, 9));
-
-    }
-
-    ~Event() {
-        delete[] content;
-    }
-
-};
-
-#endif //EVENT_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef EVENT_HPP
+#define EVENT_HPP
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <arpa/inet.h>
+#include <memory>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+
+/**
+ * Append-only log of the serialized events of a game. Records are packed
+ * one after another into fixed-size chunks (a record never straddles two
+ * chunks) and each of them is located by a single 32-bit offset. Chunks are
+ * never freed nor moved, so clearing the log for a new game costs nothing
+ * and pointers to records stay valid until then. The log also keeps where
+ * every record starts in the bytes of the game, so that the size of any
+ * range of records is known at once.
+ */
+class EventLog {
+public:
+    static constexpr uint32_t CHUNK_BITS = 16;
+    static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks;
+
+    /// offsets[i] = (chunk << CHUNK_BITS) + position of i-th record in chunk
+    std::vector<uint32_t> offsets;
+    /// starts[i] = bytes of records before the i-th one
+    std::vector<uint64_t> starts;
+
+    /// index of the chunk that is being filled and number of bytes used in it
+    uint32_t curr_chunk;
+    uint32_t chunk_fill;
+
+    uint64_t bytes_used;
+    uint64_t chunk_allocations;
+
+    /// records of a wide game (see protocol.hpp)
+    bool wide;
+
+    /// Returns place for a new record of length @p size.
+    char *reserve(uint32_t size) {
+        if (chunks.empty() || chunk_fill + size > CHUNK_SIZE) {
+            if (!chunks.empty()) {
+                curr_chunk++;
+            }
+            if (curr_chunk == chunks.size()) {
+                chunks.emplace_back(new char[CHUNK_SIZE]);
+                chunk_allocations++;
+            }
+            chunk_fill = 0;
+        }
+
+        offsets.push_back((curr_chunk << CHUNK_BITS) + chunk_fill);
+        starts.push_back(bytes_used);
+        char *res = chunks[curr_chunk].get() + chunk_fill;
+        chunk_fill += size;
+        bytes_used += size;
+        return res;
+    }
+
+    [[nodiscard]] inline uint32_t nextEventNo() const {
+        return offsets.size();
+    }
+
+public:
+    EventLog() : curr_chunk(0), chunk_fill(0), bytes_used(0), chunk_allocations(0), wide(false) {}
+
+    [[nodiscard]] inline size_t size() const {
+        return offsets.size();
+    }
+
+    /// Returns the record of event number @p event_no.
+    [[nodiscard]] inline const char *data(uint32_t event_no) const {
+        uint32_t off = offsets[event_no];
+        return chunks[off >> CHUNK_BITS].get() + (off & (CHUNK_SIZE - 1));
+    }
+
+    /// Returns the length of the whole record (with len and crc32 fields).
+    [[nodiscard]] inline uint32_t totalSize(uint32_t event_no) const {
+        return get_uint32(data(event_no)) + 8;
+    }
+
+    /// Returns the length of records [@p from, @p to) together, @p to is at most size().
+    [[nodiscard]] inline uint64_t totalSize(uint32_t from, uint32_t to) const {
+        if (from >= to) {
+            return 0;
+        }
+        return (to < size() ? starts[to] : bytes_used) - starts[from];
+    }
+
+    /**
+     * Copies as many consecutive records, starting from @p from, as fit into
+     * @p capacity bytes. Records lying in one chunk are copied at once.
+     * @param from      number of the first event to copy, on return the number
+     *                  of the first event that was not copied,
+     * @return          number of bytes copied.
+     */
+    uint32_t copy(unsigned int &from, char *dst, uint32_t capacity) const {
+        uint32_t copied = 0;
+
+        while (from < size()) {
+            const char *begin = data(from);
+            uint32_t chunk = offsets[from] >> CHUNK_BITS;
+            uint32_t span = 0;
+
+            while (from < size() && offsets[from] >> CHUNK_BITS == chunk) {
+                uint32_t len = totalSize(from);
+                if (copied + span + len > capacity) break;
+                span += len;
+                from++;
+            }
+
+            if (span == 0) break;
+            std::memcpy(dst + copied, begin, span);
+            copied += span;
+        }
+
+        return copied;
+    }
+
+    /// Appends NEW_GAME, or NEW_GAME_WIDE and PLAYER_NAMES in a wide game.
+    void pushNewGame(const std::vector<std::string> &names, uint32_t maxx, uint32_t maxy) {
+        if (wide) {
+            pushNewGameWide(names, maxx, maxy);
+            return;
+        }
+        uint32_t len = 13;
+
+        for (auto &name: names) {
+            len += name.size() + 1;
+        }
+
+        uint32_t event_num = nextEventNo();
+        char *content = reserve(len + 8);
+
+        put_uint32(content, len);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, 0);
+        put_uint32(content + 9, maxx);
+        put_uint32(content + 13, maxy);
+
+        uint32_t ind = 17;
+        for (auto &name: names) {
+            std::strcpy(content + ind, name.c_str());
+            ind += name.size() + 1;
+        }
+
+        put_uint32(content + ind, crc32(content, ind));
+    }
+
+    void pushNewGameWide(const std::vector<std::string> &names, uint32_t maxx, uint32_t maxy) {
+        char data[MAX_RECORD_DATA];
+        put_uint32(data, maxx);
+        put_uint32(data + 4, maxy);
+        put_uint16(data + 8, names.size());
+        pushRecord(EVENT_NEW_GAME_WIDE, data, 10);
+
+        uint32_t len = 0;
+        for (auto &name: names) {
+            if (len + name.size() + 1 > MAX_RECORD_DATA) {
+                pushRecord(EVENT_PLAYER_NAMES, data, len);
+                len = 0;
+            }
+            std::memcpy(data + len, name.c_str(), name.size() + 1);
+            len += name.size() + 1;
+        }
+        if (len > 0) {
+            pushRecord(EVENT_PLAYER_NAMES, data, len);
+        }
+    }
+
+    void pushPixel(uint16_t player_number, uint32_t x, uint32_t y) {
+        if (wide) {
+            char data[10];
+            put_uint16(data, player_number);
+            put_uint32(data + 2, x);
+            put_uint32(data + 6, y);
+            pushRecord(1, data, 10);
+            return;
+        }
+        uint32_t event_num = nextEventNo();
+        char *content = reserve(22);
+
+        put_uint32(content, 14);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, 1);
+        put_uint8(content + 9, player_number);
+        put_uint32(content + 10, x);
+        put_uint32(content + 14, y);
+        put_uint32(content + 18, crc32(content, 18));
+    }
+
+    void pushPlayerEliminated(uint16_t player_number) {
+        if (wide) {
+            char data[2];
+            put_uint16(data, player_number);
+            pushRecord(2, data, 2);
+            return;
+        }
+        uint32_t event_num = nextEventNo();
+        char *content = reserve(14);
+
+        put_uint32(content, 6);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, 2);
+        put_uint8(content + 9, player_number);
+        put_uint32(content + 10, crc32(content, 10));
+    }
+
+    void pushGameOver() {
+        uint32_t event_num = nextEventNo();
+        char *content = reserve(13);
+
+        put_uint32(content, 5);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, 3);
+        put_uint32(content + 9, crc32(content, 9));
+    }
+
+    /// Appends a record of type @p type with @p len bytes of @p data.
+    void pushRecord(uint8_t type, const char *data, uint32_t len) {
+        uint32_t event_num = nextEventNo();
+        char *content = reserve(len + 13);
+
+        put_uint32(content, len + 5);
+        put_uint32(content + 4, event_num);
+        put_uint8(content + 8, type);
+        std::memcpy(content + 9, data, len);
+        put_uint32(content + 9 + len, crc32(content, 9 + len));
+    }
+
+    /**
+     * Appends a record serialized elsewhere (e.g. received from another
+     * server) as it is, its event_no must be the next one of the log.
+     * @param len       length of the whole record (with len and crc32 fields).
+     */
+    void pushSerialized(const char *record, uint32_t len) {
+        std::memcpy(reserve(len), record, len);
+    }
+
+    /// Records of the next game are of a wide one (or not).
+    void setWide(bool wide_p) {
+        wide = wide_p;
+    }
+
+    [[nodiscard]] bool isWide() const {
+        return wide;
+    }
+
+    /// Forgets all events, but keeps the memory for the next game.
+    void clear() {
+        offsets.clear();
+        starts.clear();
+        curr_chunk = 0;
+        chunk_fill = 0;
+        bytes_used = 0;
+    }
+
+    /// Bytes of records of the current game.
+    [[nodiscard]] uint64_t bytesUsed() const {
+        return bytes_used;
+    }
+
+    /// Bytes held by the log, including the index.
+    [[nodiscard]] size_t memoryUsage() const {
+        return chunks.size() * CHUNK_SIZE + offsets.capacity() * sizeof(uint32_t) +
+               starts.capacity() * sizeof(uint64_t);
+    }
+
+    /// Number of chunks allocated since the log has been created.
+    [[nodiscard]] uint64_t chunkAllocations() const {
+        return chunk_allocations;
+    }
+};
+
+#endif //EVENT_HPP
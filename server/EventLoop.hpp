@@ -0,0 +1,250 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/poll.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../utils.hpp"
+#include "BatchIO.hpp"
+#include "OutboundQueue.hpp"
+#include "TickScheduler.hpp"
+
+#define SECOND        1'000'000'000
+
+/**
+ * Event loop of a shard: waits for datagrams on the shard's socket, for
+ * ticks of periodic timers (one for each room) and for wakeups by other
+ * shards, and passes them to a handler. Sending is done in batches through
+ * the loop as well, so that the game logic does not depend on the backend.
+ * Datagrams that the socket has no room for wait in outbound queues of their
+ * clients, the loop waits for the socket to become writable and drains them
+ * before anything else is sent.
+ */
+class EventLoop : public BatchSink {
+protected:
+    bool stopped = false;
+
+    OutboundQueues outbound;
+    std::vector<unsigned int> blocked;
+
+    /// Sends datagrams @p msgs at once, appends indices of those the socket had no room for to @p blocked_p,
+    /// in increasing order (datagrams of a client are queued in it).
+    virtual void transmit(struct mmsghdr *msgs, unsigned int n, IOStats &stats_p,
+                          std::vector<unsigned int> &blocked_p) = 0;
+
+    /// Makes the loop call drainOutbound when the socket becomes writable.
+    virtual void waitWritable() = 0;
+
+    /// Sends queued datagrams while the socket has room for them.
+    void drainOutbound(IOStats &stats_p) {
+        while (!outbound.empty()) {
+            unsigned int n = outbound.take();
+            blocked.clear();
+            transmit(outbound.batch(), n, stats_p, blocked);
+            outbound.settle(blocked, stats_p);
+            if (!blocked.empty()) {
+                waitWritable();
+                return;
+            }
+        }
+    }
+
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        /// Tick @p tick of timer @p id is due.
+        virtual void onTimer(size_t id, const Tick &tick) = 0;
+
+        /// A datagram has been received, @p data is valid only during the call.
+        virtual void onDatagram(char *data, int len, struct sockaddr_in6 *addr) = 0;
+
+        /// Another shard has signalled the shard's eventfd.
+        virtual void onWakeup() = 0;
+
+        /// Called after every batch of events, e.g. to flush queued datagrams.
+        virtual void onBatchEnd() = 0;
+    };
+
+    /// Adds a periodic timer treating late ticks by @p policy, returns its id.
+    virtual size_t addTimer(long period, CatchUpPolicy policy) = 0;
+
+    /// Starts counting the period of timer @p id anew.
+    virtual void restartTimer(size_t id) = 0;
+
+    /// Runs the loop until it is stopped or an unrecoverable error.
+    virtual void run(Handler &handler) = 0;
+
+    /// Makes run return after the current batch of events.
+    void stop() { stopped = true; }
+
+    /// Sets the length of the outbound queue of a client and what to drop from a full one.
+    void limitQueues(uint32_t limit, QueuePolicy policy) {
+        outbound.setLimit(limit, policy);
+    }
+
+    void sendBatch(struct mmsghdr *msgs, unsigned int n, IOStats &stats_p) final {
+        outbound.beginBatch();
+        if (!outbound.empty()) {
+            // the socket is full, datagrams go after those waiting already
+            for (unsigned int i = 0; i < n; i++) {
+                outbound.push(msgs[i].msg_hdr, stats_p);
+            }
+            return;
+        }
+
+        blocked.clear();
+        transmit(msgs, n, stats_p, blocked);
+        for (auto i: blocked) {
+            outbound.push(msgs[i].msg_hdr, stats_p);
+        }
+        if (!outbound.empty()) {
+            waitWritable();
+        }
+    }
+};
+
+/// The default backend, built on poll over one-shot timerfds, recvmmsg and sendmmsg.
+class PollLoop : public EventLoop {
+    int sock;
+    int event_fd;
+    IOStats &stats;
+
+    struct Timer {
+        int fd;
+        TickScheduler scheduler;
+    };
+    std::vector<Timer> timers;
+
+    /// Arms timer @p id at the deadline of its scheduler.
+    void arm(size_t id) {
+        struct itimerspec timerValue{};
+        int64_t deadline = timers[id].scheduler.deadline();
+        timerValue.it_value.tv_sec = deadline / SECOND;
+        timerValue.it_value.tv_nsec = deadline % SECOND;
+
+        if (timerfd_settime(timers[id].fd, TFD_TIMER_ABSTIME, &timerValue, nullptr) < 0)
+            syserr("timerfd_settime");
+    }
+
+    Receiver receiver;
+
+public:
+    PollLoop(int sock_p, int event_fd_p, IOStats &stats_p) :
+            sock(sock_p), event_fd(event_fd_p), stats(stats_p) {}
+
+    ~PollLoop() override {
+        for (auto &timer: timers) {
+            close(timer.fd);
+        }
+    }
+
+    size_t addTimer(long period, CatchUpPolicy policy) override {
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+        if (timer_fd < 0)
+            syserr("failed to create timer fd");
+
+        timers.push_back({timer_fd, TickScheduler(period, policy, TickScheduler::now())});
+        arm(timers.size() - 1);
+        return timers.size() - 1;
+    }
+
+    void restartTimer(size_t id) override {
+        // setting a new expiration replaces the pending one
+        timers[id].scheduler.restart(TickScheduler::now());
+        arm(id);
+    }
+
+    void run(Handler &handler) override {
+        uint64_t expirations;
+
+        // p[0] is the socket, p[1] the eventfd, p[i + 2] the i-th timer
+        std::vector<struct pollfd> p(timers.size() + 2);
+
+        p[0].fd = sock;
+        p[1].fd = event_fd;
+        p[1].events = POLLIN;
+        for (size_t i = 0; i < timers.size(); i++) {
+            p[i + 2].fd = timers[i].fd;
+            p[i + 2].events = POLLIN;
+        }
+
+        // wait for events
+        while (!stopped) {
+            for (auto &pfd: p) {
+                pfd.revents = 0;
+            }
+            p[0].events = outbound.empty() ? POLLIN : POLLIN | POLLOUT;
+
+            int rv = poll(p.data(), p.size(), -1);
+
+            if (rv <= 0) {
+                std::cout << "poll interrupted" << std::endl;
+                break;
+            }
+
+            // datagrams waiting for the socket go before new ones
+            if (p[0].revents & POLLOUT) {
+                drainOutbound(stats);
+            }
+
+            for (size_t i = 0; i < timers.size(); i++) {
+                if (p[i + 2].revents & POLLIN) {
+                    // the timer may have been restarted since it fired
+                    if (read(p[i + 2].fd, &expirations, 8) != 8) {
+                        continue;
+                    }
+                    int64_t now = TickScheduler::now();
+                    if (now < timers[i].scheduler.deadline()) {
+                        arm(i);
+                        continue;
+                    }
+                    Tick tick = timers[i].scheduler.expire(now);
+                    arm(i);
+                    handler.onTimer(i, tick);
+                }
+            }
+
+            if (p[1].revents & POLLIN) {
+                handler.onWakeup();
+            }
+
+            if (p[0].revents & (POLLIN | POLLERR)) {
+#ifdef DEBUG
+                std::cout << "Receiving datagrams from client socket" << std::endl;
+#endif
+                int received = receiver.receive(sock, stats);
+                for (int i = 0; i < received; i++) {
+                    handler.onDatagram(receiver.data(i), receiver.len(i), receiver.addr(i));
+                }
+            }
+
+            handler.onBatchEnd();
+        }
+    }
+
+protected:
+    void transmit(struct mmsghdr *msgs, unsigned int n, IOStats &stats_p,
+                  std::vector<unsigned int> &blocked_p) override {
+        sendBatchMmsg(sock, msgs, n, stats_p, blocked_p);
+    }
+
+    void waitWritable() override {
+        // POLLOUT is polled for while outbound queues are not empty
+    }
+};
+
+#endif //EVENT_LOOP_HPP
@@ -0,0 +1,169 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef FLAT_TABLE_HPP
+#define FLAT_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash table with open addressing and linear probing, for small keys of
+ * fixed size. Keys must provide hash() and operator==. Entries live in a
+ * single array, so a lookup touches one or two cache lines and never
+ * allocates; memory is allocated only when the table grows.
+ * Erased entries leave tombstones, so erasing does not move other entries and
+ * may be done while iterating (see erase(iterator)). Tombstones are dropped
+ * when the table is rebuilt.
+ */
+template <class Key, class Value>
+class FlatTable {
+public:
+    struct Slot {
+        Key first;
+        Value second;
+    };
+
+private:
+    enum ctrl_t : uint8_t { EMPTY, FULL, DELETED };
+
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    std::vector<Slot> slots;
+    std::vector<uint8_t> ctrl;
+    size_t mask;
+    size_t used;        // full entries
+    size_t tombstones;
+
+    /// Index of the slot holding @p key, or of the slot where it should be inserted.
+    size_t probe(const Key &key, bool &found) const {
+        size_t i = key.hash() & mask;
+        size_t insert_at = SIZE_MAX;
+
+        while (true) {
+            if (ctrl[i] == EMPTY) {
+                found = false;
+                return insert_at != SIZE_MAX ? insert_at : i;
+            }
+            if (ctrl[i] == DELETED) {
+                if (insert_at == SIZE_MAX) insert_at = i;
+            } else if (slots[i].first == key) {
+                found = true;
+                return i;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    void rebuild(size_t capacity) {
+        std::vector<Slot> old_slots(capacity);
+        std::vector<uint8_t> old_ctrl(capacity, EMPTY);
+        old_slots.swap(slots);
+        old_ctrl.swap(ctrl);
+        mask = capacity - 1;
+        tombstones = 0;
+
+        for (size_t i = 0; i < old_ctrl.size(); i++) {
+            if (old_ctrl[i] == FULL) {
+                size_t j = old_slots[i].first.hash() & mask;
+                while (ctrl[j] != EMPTY) {
+                    j = (j + 1) & mask;
+                }
+                ctrl[j] = FULL;
+                slots[j] = std::move(old_slots[i]);
+            }
+        }
+    }
+
+public:
+    class iterator {
+        FlatTable *table;
+        size_t i;
+
+        void skip() {
+            while (i < table->ctrl.size() && table->ctrl[i] != FULL) i++;
+        }
+
+        friend class FlatTable;
+
+    public:
+        iterator(FlatTable *table_p, size_t i_p) : table(table_p), i(i_p) { skip(); }
+
+        Slot &operator*() const { return table->slots[i]; }
+        Slot *operator->() const { return &table->slots[i]; }
+        iterator &operator++() { i++; skip(); return *this; }
+        bool operator==(const iterator &other) const { return i == other.i; }
+        bool operator!=(const iterator &other) const { return i != other.i; }
+    };
+
+    FlatTable() : slots(MIN_CAPACITY), ctrl(MIN_CAPACITY, EMPTY), mask(MIN_CAPACITY - 1),
+                  used(0), tombstones(0) {}
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, ctrl.size()); }
+
+    [[nodiscard]] size_t size() const { return used; }
+    [[nodiscard]] bool empty() const { return used == 0; }
+
+    /// @return     pointer to the value of @p key, or nullptr.
+    Value *find(const Key &key) {
+        bool found;
+        size_t i = probe(key, found);
+        return found ? &slots[i].second : nullptr;
+    }
+
+    [[nodiscard]] bool contains(const Key &key) const {
+        bool found;
+        probe(key, found);
+        return found;
+    }
+
+    /// Inserts @p key with @p value or overwrites the value of present @p key.
+    Value &insert(const Key &key, Value value) {
+        // keep at least a quarter of slots empty, so that probing terminates fast
+        if ((used + tombstones + 1) * 4 > ctrl.size() * 3) {
+            rebuild(used * 2 + 2 > ctrl.size() / 2 ? ctrl.size() * 2 : ctrl.size());
+        }
+
+        bool found;
+        size_t i = probe(key, found);
+        if (!found) {
+            if (ctrl[i] == DELETED) tombstones--;
+            ctrl[i] = FULL;
+            slots[i].first = key;
+            used++;
+        }
+        slots[i].second = std::move(value);
+        return slots[i].second;
+    }
+
+    /// @return     whether @p key was present.
+    bool erase(const Key &key) {
+        bool found;
+        size_t i = probe(key, found);
+        if (found) erase(iterator(this, i));
+        return found;
+    }
+
+    /// Erases the entry at @p it, returns the iterator to the next one.
+    iterator erase(iterator it) {
+        ctrl[it.i] = DELETED;
+        slots[it.i].second = Value();
+        used--;
+        tombstones++;
+        return ++it;
+    }
+
+    void clear() {
+        std::fill(ctrl.begin(), ctrl.end(), EMPTY);
+        for (auto &slot: slots) slot.second = Value();
+        used = tombstones = 0;
+    }
+};
+
+#endif //FLAT_TABLE_HPP
@@ -1,323 +1,524 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef GAME_HPP
-#define GAME_HPP
-
-#include "../utils.hpp"
-#include "Board.hpp"
-#include "misc.hpp"
-#include "Player.hpp"
-#include "Client.hpp"
-#include "convertions.hpp"
-#include "Event.hpp"
-
-#include <vector>
-
-#include <unordered_map>
-#include <unordered_set>
-#include <algorithm>
-
-constexpr int MAX_DATAGRAM_SIZE = 548;
-constexpr int MIN_NUMBER_OF_PLAYERS = 2;
-constexpr int MAX_TIME_OF_INACTIVITY = 2;
-constexpr int MAX_CLIENTS = 25;
-
-
-class Game {
-private:
-public:
-    uint32_t game_id;
-
-    std::vector<player_ptr> players;
-    board_ptr board;
-
-    enum state_t {GAME_IN_PROGRESS, WAITING_ROOM} state;
-
-    const int turning_speed;
-
-    /// map user_id's (= address:port) to client
-    std::unordered_map<std::string, client_ptr> client_map;
-
-    /// set of usernames that are used by others so that new clients cannot
-    /// reuse them
-    std::unordered_set<std::string> used_usernames;
-
-    int num_non_observers;
-    int num_players_ready;
-
-
-
-    Game(int turning_speed_p, int max_x_p, int max_y_p) :
-            turning_speed(turning_speed_p) {
-
-        board = std::make_shared<Board>(max_x_p, max_y_p);
-        game_id = 0;
-        state = WAITING_ROOM;
-        num_non_observers = 0;
-        num_players_ready = 0;
-
-
-    }
-
-    void initGame() {
-
-        game_id = Random::rand();
-
-        players.clear();
-        players.reserve(num_non_observers);
-        uint8_t player_num = 0;
-
-        std::vector<std::string> player_names_list;
-
-
-        std::vector< std::pair<std::string, std::string> > client_ids_temp;
-        for (auto &client: client_map) {
-            if (client.second->state != OBSERVER) {
-                client_ids_temp.emplace_back(client.second->player_name, client.first);
-            }
-            //client.second->last_turn_direction = 0;
-        }
-        std::sort(client_ids_temp.begin(), client_ids_temp.end());
-        for (auto &client: client_ids_temp) {
-            players.push_back(std::make_shared<Player>(client_map[client.second], board, player_num++));
-            client_map[client.second]->state = PLAYING;
-            player_names_list.emplace_back(client.first);
-
-        }
-
-        state = GAME_IN_PROGRESS;
-        board->prepareNewGame(player_num);
-        board->events.push_back(std::make_shared<Event>(0, player_names_list, board->max_x, board->max_y));
-        num_players_ready = 0;
-
-        for (auto &player: players) {
-            player->init();
-        }
-    }
-
-    bool handleUnrecognisedClient(
-            const std::string &client_id,
-            const client_mess &mess) {
-
-        if (client_map.size() >= MAX_CLIENTS) {
-            // Too many connected clients
-            return false;
-        }
-
-        if (used_usernames.find(mess.player_name) != used_usernames.end()) {
-            // new client tries to impersonate other user, ignore him
-            return false;
-        }
-
-        for (char c : mess.player_name) {
-            if (c < 33 || c > 126) {
-                // player name contains incorrect character
-                return false;
-            }
-        }
-
-
-        client_map.insert({
-                  client_id,
-                  std::make_shared<Client>(
-                          OBSERVER,
-                          mess.player_name,
-                          mess.session_id,
-                          time(nullptr),
-                          mess.turn_direction,
-                          mess.addr)
-        });
-
-        if (!mess.player_name.empty()) {
-            client_map[client_id]->state = JOINED;
-            used_usernames.emplace(mess.player_name);
-            num_non_observers++;
-        }
-
-        return true;
-    }
-
-
-    bool handleClient(
-            const std::string &client_id,
-            const client_mess &mess) {
-
-        auto client = client_map.find(client_id);
-
-        if (client == client_map.end()) {
-
-            if (!handleUnrecognisedClient(client_id, mess))
-                return false;
-
-        } else {
-            // socket has been recognised
-            if (client->second->session_id > mess.session_id) {
-                // datagram with lesser session_id, ignore it
-#ifdef DEBUG
-                std::cout << "Datagram from recognised source with incorrect (lesser) session_id, ignore it" << std::endl;
-#endif
-                return false;
-
-            }
-
-            else if (client->second->player_name != mess.player_name) {
-                // wrong username from connected client, ignore this datagram
-#ifdef DEBUG
-                std::cout << "wrong username from connected client, ignore this datagram" << std::endl;
-#endif
-                return false;
-            }
-
-            else if (client->second->session_id < mess.session_id) {
-                // datagram with greater session_id, disconnect previous client
-                // and join as a new one
-                client_map.erase(client);
-
-                client_map.insert({
-                    client_id,
-                    std::make_shared<Client>(
-                            JOINED,
-                            mess.player_name,
-                            mess.session_id,
-                            time(nullptr),
-                            mess.turn_direction,
-                            mess.addr
-                            )
-                });
-
-            }
-            else {
-                // session_id and socket recognised
-                client->second->last_datagram_time  = time(nullptr);
-                client->second->last_turn_direction = mess.turn_direction;
-            }
-        }
-
-
-        return true;
-
-    }
-
-    bool waitingRoomRoutine(const std::string &client_id) {
-        auto client = client_map.find(client_id);
-
-        switch (client->second->state) {
-            case JOINED:
-            case LOST:
-            case PLAYING:
-                if (client->second->last_turn_direction != 0) {
-                    client->second->state = READY;
-                    num_players_ready++;
-                }
-
-                break;
-
-            default:
-                ;
-        }
-
-        if (num_players_ready == num_non_observers && num_players_ready >= MIN_NUMBER_OF_PLAYERS) {
-            initGame();
-            return true;
-        }
-        return false;
-
-    }
-
-
-    void disconnectInactiveClients() {
-        unsigned curr_time = time(nullptr);
-
-        for (auto client_it = client_map.cbegin(); client_it != client_map.cend();) { // iterate and erase idiom
-
-            if (client_it->second->last_datagram_time + MAX_TIME_OF_INACTIVITY < curr_time) {
-
-                if (client_it->second->state != OBSERVER)
-                    num_non_observers--;
-
-#ifdef DEBUG
-                std::cout << "Disconnecting client " << client_it->second->player_name << std::endl;
-#endif
-                used_usernames.erase(client_it->second->player_name);
-                client_it = client_map.erase(client_it);
-
-            } else {
-                ++client_it;
-            }
-        }
-
-    }
-
-    /// Assumes that buffer is at least MAX_DATAGRAM_SIZE long.
-    /// Modifies arguments @p from and @p buffer.
-    /// @returns length of message.
-
-    int buildDatagram(unsigned int &from, char *buffer) {
-        int len = 4;
-
-        put_uint32(buffer, game_id);
-
-        while ( from < board->events.size() &&
-                len + board->events[from]->total_size <= MAX_DATAGRAM_SIZE) {
-
-            std::memcpy(buffer + len, board->events[from]->content, board->events[from]->total_size);
-
-            len += (int) board->events[from]->total_size;
-
-            from++;
-        }
-
-        if (len == 4) {
-            return 0;
-        }
-
-        return len;
-
-    }
-
-
-
-    bool doRound() {
-        for (auto &player: players) {
-            if (player->client->state == PLAYING) {
-                switch (player->client->last_turn_direction) {
-                    case 0:
-                        player->move(0);
-                        break;
-                    case 1:
-                        player->move(turning_speed);
-                        break;
-                    case 2:
-                        player->move(-turning_speed);
-                        break;
-                }
-
-            }
-
-            // check if the game has ended
-            if (board->players_playing <= 1) {
-                // generate event game over
-                board->events.push_back(std::make_shared<Event>(board->events.size()));
-                state = WAITING_ROOM;
-                return true;
-            }
-        }
-        return false;
-    }
-
-    /**
-     * Checks if the current state of the game is waiting for users to start a game.
-     * @return      proper logical value.
-     */
-    bool isWaitingRoom() const {
-        return state == WAITING_ROOM;
-    }
-
-};
-
-
-#endif //GAME_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef GAME_HPP
+#define GAME_HPP
+
+#include "../utils.hpp"
+#include "Board.hpp"
+#include "misc.hpp"
+#include "Player.hpp"
+#include "Client.hpp"
+#include "convertions.hpp"
+#include "Event.hpp"
+#include "DatagramCache.hpp"
+#include "ClientKey.hpp"
+#include "FlatTable.hpp"
+#include "InactivityWheel.hpp"
+
+#include <vector>
+
+#include <algorithm>
+
+constexpr int MIN_NUMBER_OF_PLAYERS = 2;
+constexpr int MAX_TIME_OF_INACTIVITY = 2;
+/// in nanoseconds
+constexpr int64_t MAX_INACTIVITY = MAX_TIME_OF_INACTIVITY * 1'000'000'000LL;
+/// clients of a room by default, rooms for more admit only clients of
+/// protocol v2 (see protocol.hpp)
+constexpr int V1_MAX_CLIENTS = V1_MAX_PLAYERS;
+constexpr int MAX_CLIENTS = 8192;
+
+
+class Game {
+private:
+public:
+    uint32_t game_id;
+
+    std::vector<player_ptr> players;
+    board_ptr board;
+
+    /// events and the input stream of the current game packed into datagrams
+    DatagramCache datagrams;
+    DatagramCache input_datagrams;
+
+    /// rounds of the current game and turn directions of its players in the last one
+    int round;
+    std::vector<uint8_t> turns;
+
+    /// whether the current game builds the input stream, only if a client asks
+    /// for it or keep_inputs is set
+    bool builds_inputs;
+    /// whether the input stream is built even if nobody streams it (for a journal)
+    bool keep_inputs;
+    std::vector<char> checksum_state;
+
+    enum state_t {GAME_IN_PROGRESS, WAITING_ROOM} state;
+
+    const int turning_speed;
+
+    /// clients of the room, at most V1_MAX_CLIENTS unless all of them understand protocol v2
+    const int max_clients;
+    /// whether only clients of protocol v2 are admitted
+    bool v2_only;
+
+    /// representation of positions of players
+    const MovementMode movement;
+
+    Random random;
+
+    /// map client keys (= address, port and scope) to client
+    FlatTable<ClientKey, client_ptr> client_map;
+
+    /// clients of the room by what they are broadcast: events, events that
+    /// may come from a multicast group (CAPABILITY_MULTICAST) and the input stream
+    enum subscription_t {EVENTS, MULTICAST_EVENTS, INPUTS};
+    std::vector<Client *> subscribers[3];
+
+    /// set of usernames that are used by others so that new clients cannot
+    /// reuse them
+    FlatTable<NameKey, bool> used_usernames;
+
+    /// deadlines of inactivity of clients and entries that have expired
+    InactivityWheel inactivity;
+    std::vector<InactivityWheel::Entry> inactivity_expired;
+
+    int num_non_observers;
+    int num_players_ready;
+
+
+
+    Game(int turning_speed_p, int max_x_p, int max_y_p, uint32_t seed,
+         MovementMode movement_p = MovementMode::FIXED, int max_clients_p = V1_MAX_CLIENTS) :
+            turning_speed(turning_speed_p),
+            max_clients(max_clients_p),
+            v2_only(max_clients_p > V1_MAX_CLIENTS),
+            movement(movement_p),
+            random(seed) {
+
+        board = std::make_shared<Board>(max_x_p, max_y_p);
+        game_id = 0;
+        round = 0;
+        builds_inputs = false;
+        keep_inputs = false;
+        state = WAITING_ROOM;
+        num_non_observers = 0;
+        num_players_ready = 0;
+
+
+    }
+
+    void initGame() {
+
+        game_id = random.rand();
+
+        players.clear();
+        players.reserve(num_non_observers);
+        uint16_t player_num = 0;
+
+        std::vector<std::string> player_names_list;
+        size_t names_size = 0;
+
+
+        builds_inputs = keep_inputs;
+        for (auto &client: client_map) {
+            builds_inputs |= (client.second->requested_capabilities & CAPABILITY_INPUTS) != 0;
+        }
+
+        std::vector< std::pair<std::string, client_ptr> > clients_temp;
+        for (auto &client: client_map) {
+            // event numbers start anew
+            client.second->resetEvents();
+            setCapabilities(*client.second, client.second->requested_capabilities);
+            if (client.second->state != OBSERVER) {
+                clients_temp.emplace_back(client.second->player_name, client.second);
+            }
+            //client.second->last_turn_direction = 0;
+        }
+        std::sort(clients_temp.begin(), clients_temp.end());
+        for (auto &client: clients_temp) {
+            players.push_back(std::make_shared<Player>(client.second, board, player_num++, movement));
+            client.second->state = PLAYING;
+            player_names_list.emplace_back(client.first);
+            names_size += client.first.size() + 1;
+
+        }
+
+        state = GAME_IN_PROGRESS;
+        board->prepareNewGame(player_num, isWideGame(player_num, names_size));
+        datagrams.reset(game_id);
+        input_datagrams.reset(game_id);
+        board->events.pushNewGame(player_names_list, board->max_x, board->max_y);
+        if (builds_inputs) {
+            board->inputs.pushNewGame(player_names_list, board->max_x, board->max_y);
+        }
+        num_players_ready = 0;
+        round = 0;
+
+        for (auto &player: players) {
+            player->init(random);
+        }
+        if (builds_inputs) {
+            pushSpawn();
+        }
+    }
+
+    /// What @p client is broadcast, by its capabilities.
+    static subscription_t subscriptionOf(const Client &client) {
+        if (client.streamsInputs()) {
+            return INPUTS;
+        }
+        return client.capabilities & CAPABILITY_MULTICAST ? MULTICAST_EVENTS : EVENTS;
+    }
+
+    /// Adds @p client to subscribers of what it is broadcast.
+    void subscribe(Client &client) {
+        std::vector<Client *> &list = subscribers[subscriptionOf(client)];
+        client.subscriber_index = list.size();
+        list.push_back(&client);
+    }
+
+    /// Removes @p client from subscribers, before its capabilities change or it is dropped.
+    void unsubscribe(Client &client) {
+        std::vector<Client *> &list = subscribers[subscriptionOf(client)];
+        list[client.subscriber_index] = list.back();
+        list[client.subscriber_index]->subscriber_index = client.subscriber_index;
+        list.pop_back();
+    }
+
+    /// Extensions of @p requested that the current game provides.
+    [[nodiscard]] uint8_t grantedCapabilities(uint8_t requested) const {
+        return builds_inputs ? requested : requested & ~CAPABILITY_INPUTS;
+    }
+
+    /**
+     * Sets extensions asked for by @p client, which streams inputs only if the
+     * current game builds them (otherwise it gets events until the next game).
+     * @return      whether capabilities of the client have changed.
+     */
+    bool setCapabilities(Client &client, uint8_t requested) {
+        client.requested_capabilities = requested;
+        uint8_t granted = grantedCapabilities(requested);
+        if (client.capabilities == granted) {
+            return false;
+        }
+        unsubscribe(client);
+        client.capabilities = granted;
+        subscribe(client);
+        return true;
+    }
+
+    /// Appends SPAWN to the input stream (as many records as needed in a wide
+    /// game), players have been placed on the board.
+    void pushSpawn() {
+        bool wide = board->inputs.isWide();
+        uint32_t header = wide ? 4 : 2;
+        size_t per_record = wide ? (MAX_RECORD_DATA - header) / 10 : players.size();
+        std::vector<char> data(header + 10 * std::min(per_record, players.size()));
+
+        for (size_t first = 0; first < players.size(); first += per_record) {
+            size_t count = std::min(per_record, players.size() - first);
+            put_uint8(data.data(), (uint8_t) movement);
+            put_uint8(data.data() + 1, (uint8_t) (int8_t) turning_speed);
+            if (wide) {
+                put_uint16(data.data() + 2, first);
+            }
+
+            char *p = data.data() + header;
+            for (size_t i = first; i < first + count; i++) {
+                auto pixel = players[i]->getPixel();
+                put_uint32(p, pixel.first);
+                put_uint32(p + 4, pixel.second);
+                put_uint8(p + 8, players[i]->direction / 256);
+                put_uint8(p + 9, players[i]->direction % 256);
+                p += 10;
+            }
+            board->inputs.pushRecord(EVENT_SPAWN, data.data(), header + 10 * count);
+        }
+    }
+
+    /// Appends TICK with the turn directions of the round to the input stream.
+    void pushTick() {
+        char data[(MAX_PLAYERS + 3) / 4] = {};
+        for (size_t i = 0; i < turns.size(); i++) {
+            uint8_t turn = turns[i] <= 2 ? turns[i] : TURN_NONE;
+            data[i / 4] = (char) (data[i / 4] | turn << (2 * (i % 4)));
+        }
+        board->inputs.pushRecord(EVENT_TICK, data, (turns.size() + 3) / 4);
+    }
+
+    bool handleUnrecognisedClient(
+            const ClientKey &client_id,
+            const client_mess &mess,
+            int64_t now) {
+
+        if ((int) client_map.size() >= max_clients) {
+            // Too many connected clients
+            return false;
+        }
+
+        if (v2_only && !(mess.capabilities & CAPABILITY_WIDE)) {
+            // the room may host a wide game, which the client could not follow
+            return false;
+        }
+
+        if (!mess.player_name.empty() && num_non_observers >= MAX_PLAYERS) {
+            return false;
+        }
+
+        if (mess.player_name.size() > MAX_PLAYER_NAME_LENGTH) {
+            // too long name without the capability trailer
+            return false;
+        }
+
+        if (used_usernames.contains(NameKey(mess.player_name))) {
+            // new client tries to impersonate other user, ignore him
+            return false;
+        }
+
+        for (char c : mess.player_name) {
+            if (c < 33 || c > 126) {
+                // player name contains incorrect character
+                return false;
+            }
+        }
+
+        if (!v2_only && !mess.player_name.empty() && !namesFitNewGame(mess.player_name)) {
+            // NEW_GAME would not fit in a datagram, clients of protocol v1 could not follow a wide game
+            return false;
+        }
+
+
+        client_ptr &client = client_map.insert(
+                  client_id,
+                  std::make_shared<Client>(
+                          OBSERVER,
+                          mess.player_name,
+                          mess.session_id,
+                          now,
+                          mess.turn_direction,
+                          mess.addr)
+        );
+        inactivity.schedule({client_id, mess.session_id}, now + MAX_INACTIVITY);
+        subscribe(*client);
+
+        if (!mess.player_name.empty()) {
+            client->state = JOINED;
+            used_usernames.insert(NameKey(mess.player_name), true);
+            num_non_observers++;
+        }
+
+        return true;
+    }
+
+
+    /// Whether names of players and @p player_name of a new one fit in NEW_GAME of protocol v1.
+    bool namesFitNewGame(const std::string &player_name) {
+        size_t names_size = player_name.size() + 1;
+        for (auto &client: client_map) {
+            if (client.second->state != OBSERVER) {
+                names_size += client.second->player_name.size() + 1;
+            }
+        }
+        return !isWideGame(num_non_observers + 1, names_size);
+    }
+
+    /// Handles a datagram of a client received at @p now (in nanoseconds of a monotonic clock).
+    bool handleClient(
+            const ClientKey &client_id,
+            const client_mess &mess,
+            int64_t now) {
+
+        client_ptr *client = client_map.find(client_id);
+
+        if (client == nullptr) {
+
+            if (!handleUnrecognisedClient(client_id, mess, now))
+                return false;
+
+        } else {
+            // socket has been recognised
+            if ((*client)->session_id > mess.session_id) {
+                // datagram with lesser session_id, ignore it
+#ifdef DEBUG
+                std::cout << "Datagram from recognised source with incorrect (lesser) session_id, ignore it" << std::endl;
+#endif
+                return false;
+
+            }
+
+            else if ((*client)->player_name != mess.player_name) {
+                // wrong username from connected client, ignore this datagram
+#ifdef DEBUG
+                std::cout << "wrong username from connected client, ignore this datagram" << std::endl;
+#endif
+                return false;
+            }
+
+            else if ((*client)->session_id < mess.session_id) {
+                // datagram with greater session_id, disconnect previous client
+                // and join as a new one
+                unsubscribe(**client);
+                *client = std::make_shared<Client>(
+                            JOINED,
+                            mess.player_name,
+                            mess.session_id,
+                            now,
+                            mess.turn_direction,
+                            mess.addr
+                            );
+                // the entry of the previous session is dropped when it expires
+                inactivity.schedule({client_id, mess.session_id}, now + MAX_INACTIVITY);
+                subscribe(**client);
+
+            }
+            else {
+                // session_id and socket recognised
+                (*client)->last_datagram_time  = now;
+                (*client)->last_turn_direction = mess.turn_direction;
+            }
+        }
+
+
+        return true;
+
+    }
+
+    bool waitingRoomRoutine(const ClientKey &client_id) {
+        client_ptr &client = *client_map.find(client_id);
+
+        switch (client->state) {
+            case JOINED:
+            case LOST:
+            case PLAYING:
+                if (client->last_turn_direction != 0) {
+                    client->state = READY;
+                    num_players_ready++;
+                }
+
+                break;
+
+            default:
+                ;
+        }
+
+        if (num_players_ready == num_non_observers && num_players_ready >= MIN_NUMBER_OF_PLAYERS) {
+            initGame();
+            return true;
+        }
+        return false;
+
+    }
+
+
+    /// Disconnects clients silent for longer than MAX_INACTIVITY at @p now.
+    /// Only clients whose deadlines have expired in the wheel are looked at.
+    void disconnectInactiveClients(int64_t now) {
+        inactivity_expired.clear();
+        inactivity.expire(now, inactivity_expired);
+
+        for (const auto &entry: inactivity_expired) {
+            client_ptr *client = client_map.find(entry.key);
+            if (client == nullptr || (*client)->session_id != entry.session_id) {
+                // replaced by a new session, which has its own entry
+                continue;
+            }
+
+            int64_t deadline = (*client)->last_datagram_time + MAX_INACTIVITY;
+            if (deadline >= now) {
+                inactivity.schedule(entry, deadline);
+                continue;
+            }
+
+            if ((*client)->state != OBSERVER)
+                num_non_observers--;
+
+#ifdef DEBUG
+            std::cout << "Disconnecting client " << (*client)->player_name << std::endl;
+#endif
+            used_usernames.erase(NameKey((*client)->player_name));
+            eraseClient(entry.key);
+        }
+    }
+
+    /// Drops client @p key of the room.
+    void eraseClient(const ClientKey &key) {
+        unsubscribe(**client_map.find(key));
+        client_map.erase(key);
+    }
+
+    /// Assumes that buffer is at least MAX_DATAGRAM_SIZE long.
+    /// Modifies arguments @p from and @p buffer.
+    /// @returns length of message.
+
+    int buildDatagram(unsigned int &from, char *buffer) {
+        int len;
+        const char *datagram = getDatagram(from, len, buffer);
+
+        if (datagram != buffer) {
+            std::memcpy(buffer, datagram, len);
+        }
+
+        return len;
+    }
+
+    /**
+     * Works like buildDatagram, but does not copy a datagram that is already
+     * packed in the cache.
+     * @return      pointer to the datagram (to a page of the cache or to @p buffer).
+     */
+    const char *getDatagram(unsigned int &from, int &len, char *buffer, bool input_stream = false) {
+        DatagramCache &cache = input_stream ? input_datagrams : datagrams;
+        cache.sync(board->log(input_stream));
+        return cache.datagram(from, len, buffer);
+    }
+
+    /// Number of datagrams needed to send events (or the input stream) starting from @p from.
+    size_t datagramsFrom(uint32_t from, bool input_stream = false) {
+        DatagramCache &cache = input_stream ? input_datagrams : datagrams;
+        cache.sync(board->log(input_stream));
+        return cache.datagramsFrom(from);
+    }
+
+
+
+    bool doRound() {
+        turns.resize(players.size());
+        for (size_t i = 0; i < players.size(); i++) {
+            turns[i] = players[i]->client->last_turn_direction;
+        }
+        if (builds_inputs) {
+            pushTick();
+        }
+        round++;
+
+        if (playRound(players, *board, turning_speed, turns.data())) {
+            if (builds_inputs) {
+                board->inputs.pushGameOver();
+            }
+            state = WAITING_ROOM;
+            return true;
+        }
+        if (builds_inputs && round % CHECKSUM_INTERVAL == 0) {
+            char data[4];
+            put_uint32(data, stateChecksum(players, *board, checksum_state));
+            board->inputs.pushRecord(EVENT_CHECKSUM, data, 4);
+        }
+        return false;
+    }
+
+    /**
+     * Checks if the current state of the game is waiting for users to start a game.
+     * @return      proper logical value.
+     */
+    bool isWaitingRoom() const {
+        return state == WAITING_ROOM;
+    }
+
+};
+
+
+#endif //GAME_HPP
@@ -0,0 +1,80 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef INACTIVITY_WHEEL_HPP
+#define INACTIVITY_WHEEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "ClientKey.hpp"
+
+/**
+ * Hashed timer wheel of deadlines of inactivity of clients of a game: a circle
+ * of slots of SLOT_LENGTH nanoseconds, every deadline is put into the slot of
+ * its time modulo the circle. Expiring costs a visit of the slots that have
+ * passed since the last time, whatever the number of clients.
+ *
+ * A client is scheduled once, when it connects. Datagrams only move its last
+ * time of activity, so when its deadline expires the game checks whether the
+ * client has been silent for long enough and schedules it again otherwise.
+ * An entry of a client that has been replaced by a new session is stale, it
+ * is recognised by the session id and dropped.
+ */
+class InactivityWheel {
+public:
+    struct Entry {
+        ClientKey key;
+        uint64_t session_id;
+    };
+
+    /// the resolution of deadlines, in nanoseconds
+    static constexpr int64_t SLOT_LENGTH = 10'000'000;
+    /// slots of the circle, deadlines further away than the circle expire early
+    /// (and have to be scheduled again)
+    static constexpr int64_t SLOTS = 256;
+
+private:
+    std::array<std::vector<Entry>, SLOTS> slots;
+    /// number of the next slot to expire (time / SLOT_LENGTH)
+    int64_t current;
+    size_t scheduled;
+
+public:
+    explicit InactivityWheel(int64_t now = 0) : current(now / SLOT_LENGTH), scheduled(0) {}
+
+    /// Schedules @p entry to expire not earlier than @p deadline.
+    void schedule(const Entry &entry, int64_t deadline) {
+        // the first slot that begins after the deadline
+        int64_t slot = std::max(deadline / SLOT_LENGTH + 1, current);
+        slots[slot % SLOTS].push_back(entry);
+        scheduled++;
+    }
+
+    /// Appends entries of slots that have passed at @p now to @p expired.
+    void expire(int64_t now, std::vector<Entry> &expired) {
+        int64_t last = now / SLOT_LENGTH;
+        if (last - current >= SLOTS) {
+            // the whole circle has passed
+            current = last - SLOTS + 1;
+        }
+
+        for (; current <= last; current++) {
+            std::vector<Entry> &slot = slots[current % SLOTS];
+            expired.insert(expired.end(), slot.begin(), slot.end());
+            scheduled -= slot.size();
+            slot.clear();
+        }
+    }
+
+    [[nodiscard]] size_t size() const {
+        return scheduled;
+    }
+};
+
+#endif //INACTIVITY_WHEEL_HPP
@@ -0,0 +1,324 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "Game.hpp"
+
+/*
+ * An input journal is a file of games of a room with only what decides their
+ * course: where players have been placed and their turn directions in every
+ * round, which is a few bits per player per round instead of the records of
+ * eaten pixels. Games are replayed from it by the code of the server (see
+ * playRound), the result is checked by checksums of the input stream.
+ *
+ * The file begins with JOURNAL_MAGIC, then every game is an entry (numbers
+ * in network byte order):
+ *
+ *   magic          4 bytes, JOURNAL_GAME_MAGIC
+ *   size           4 bytes, of the whole entry
+ *   game_id        4 bytes
+ *   seed           4 bytes, of the room
+ *   maxx, maxy     4 bytes each
+ *   players        2 bytes
+ *   movement mode  1 byte (MovementMode)
+ *   turning speed  1 byte, signed
+ *   rounds         4 bytes
+ *   checksums      4 bytes, their number
+ *   names length   4 bytes
+ *   started        8 bytes, wall clock time of the first round in nanoseconds
+ *                  since the epoch
+ *   names          of players, each followed by a zero byte
+ *   spawn          x, y (4 bytes each) and direction (2 bytes) of every player
+ *   turns          2 bits (as in TICK) of every player in every round, from
+ *                  the lowest bits of a byte
+ *   checksums      4 bytes each, stateChecksum after every CHECKSUM_INTERVAL
+ *                  rounds but the last one
+ *
+ * A game is written at once when it ends, an entry cut short (the server has
+ * been killed while writing) is ignored by readers.
+ */
+
+constexpr char JOURNAL_MAGIC[8] = {'W', 'O', 'R', 'M', 'J', 'R', 'N', '1'};
+constexpr uint32_t JOURNAL_GAME_MAGIC = 0x4a47414d;
+constexpr uint32_t JOURNAL_GAME_HEADER = 48;
+
+/// A game of a journal, pointing into the memory of the file.
+struct JournalGame {
+    uint32_t game_id;
+    uint32_t seed;
+    uint32_t max_x;
+    uint32_t max_y;
+    uint16_t players;
+    MovementMode movement;
+    int turning_speed;
+    uint32_t rounds;
+    uint32_t checksums;
+    uint64_t started;
+    std::vector<std::string> names;
+    const char *spawn;
+    const char *turns;
+    const char *checksum_data;
+    uint32_t size;
+
+    /// Turn direction of player @p player in round @p round (counted from 0).
+    [[nodiscard]] uint8_t turn(uint32_t round, uint16_t player) const {
+        uint64_t bit = 2 * ((uint64_t) round * players + player);
+        return (get_uint8(turns + bit / 8) >> (bit % 8)) & 3;
+    }
+
+    [[nodiscard]] uint32_t checksum(uint32_t i) const {
+        return get_uint32(checksum_data + 4 * i);
+    }
+
+    /// Bytes of turns of @p rounds rounds of @p players players.
+    static uint64_t turnBytes(uint32_t rounds, uint16_t players) {
+        return (2 * (uint64_t) rounds * players + 7) / 8;
+    }
+};
+
+/**
+ * Writer of the journal of a room. The input stream of the game (SPAWN, TICK
+ * and CHECKSUM records) is condensed after every round into a buffer of the
+ * game, the whole entry is appended to the file by a single write when the
+ * game ends.
+ */
+class InputJournal {
+    int fd;
+    const uint32_t seed;
+
+    bool open;
+    /// the next record of the input stream to take
+    uint32_t next_input;
+    std::vector<char> header;
+    std::string names;
+    std::vector<char> spawn;
+    std::vector<uint8_t> turns;
+    uint64_t turn_bits;
+    uint32_t rounds;
+    std::vector<char> checksums;
+    std::vector<char> entry;
+
+    void begin(const Game &game) {
+        open = true;
+        next_input = 0;
+        names.clear();
+        for (auto &player: game.players) {
+            names += player->client->player_name;
+            names += '\0';
+        }
+        spawn.clear();
+        turns.clear();
+        turn_bits = 0;
+        rounds = 0;
+        checksums.clear();
+
+        header.assign(JOURNAL_GAME_HEADER, 0);
+        put_uint32(header.data(), JOURNAL_GAME_MAGIC);
+        put_uint32(header.data() + 8, game.game_id);
+        put_uint32(header.data() + 12, seed);
+        put_uint32(header.data() + 16, game.board->max_x);
+        put_uint32(header.data() + 20, game.board->max_y);
+        put_uint16(header.data() + 24, game.players.size());
+        put_uint64(header.data() + 40, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    void takeTick(const char *data, uint16_t players) {
+        turns.resize(JournalGame::turnBytes(rounds + 1, players), 0);
+        for (uint16_t i = 0; i < players; i++) {
+            uint8_t turn = (get_uint8(data + i / 4) >> (2 * (i % 4))) & 3;
+            turns[turn_bits / 8] |= turn << (turn_bits % 8);
+            turn_bits += 2;
+        }
+        rounds++;
+    }
+
+    void finish() {
+        put_uint32(header.data() + 28, rounds);
+        put_uint32(header.data() + 32, checksums.size() / 4);
+        put_uint32(header.data() + 36, names.size());
+
+        entry.clear();
+        entry.insert(entry.end(), header.begin(), header.end());
+        entry.insert(entry.end(), names.begin(), names.end());
+        entry.insert(entry.end(), spawn.begin(), spawn.end());
+        entry.insert(entry.end(), turns.begin(), turns.end());
+        entry.insert(entry.end(), checksums.begin(), checksums.end());
+        put_uint32(entry.data() + 4, entry.size());
+
+        writeAll(entry.data(), entry.size());
+        open = false;
+    }
+
+    void writeAll(const char *data, size_t len) {
+        while (len > 0) {
+            ssize_t res = write(fd, data, len);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            if (res <= 0) {
+                syserr("write of an input journal");
+            }
+            data += res;
+            len -= res;
+        }
+    }
+
+public:
+    InputJournal(const std::string &path, uint32_t seed_p) : seed(seed_p), open(false), next_input(0),
+                                                             turn_bits(0), rounds(0) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            syserr("Could not open the input journal " + path + ".");
+        }
+        if (lseek(fd, 0, SEEK_END) == 0) {
+            writeAll(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        }
+    }
+
+    InputJournal(const InputJournal &) = delete;
+    InputJournal &operator=(const InputJournal &) = delete;
+
+    ~InputJournal() {
+        close(fd);
+    }
+
+    /// Takes the input stream of the round @p game has just played.
+    void record(const Game &game) {
+        if (!open) {
+            begin(game);
+        }
+
+        const EventLog &inputs = game.board->inputs;
+        uint16_t players = game.players.size();
+        for (; next_input < inputs.size(); next_input++) {
+            const char *record = inputs.data(next_input);
+            const char *data = record + 9;
+            uint32_t len = get_uint32(record) - 5;
+
+            switch (get_uint8(record + 8)) {
+                case EVENT_SPAWN: {
+                    uint32_t offset = inputs.isWide() ? 4 : 2;
+                    header[26] = data[0];
+                    header[27] = data[1];
+                    spawn.insert(spawn.end(), data + offset, data + len);
+                    break;
+                }
+                case EVENT_TICK:
+                    takeTick(data, players);
+                    break;
+                case EVENT_CHECKSUM:
+                    checksums.insert(checksums.end(), data, data + 4);
+                    break;
+                default:;
+            }
+        }
+
+        if (game.isWaitingRoom()) {
+            finish();
+        }
+    }
+};
+
+/// Games of a journal read into memory, an incomplete last entry is left out.
+class JournalFile {
+    std::vector<char> data;
+    std::vector<JournalGame> games;
+    bool truncated;
+
+public:
+    explicit JournalFile(const std::string &path) : truncated(false) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            syserr("Could not open the input journal " + path + ".");
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(JOURNAL_MAGIC) ||
+            std::memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+            syserr("File " + path + " is not an input journal.");
+        }
+
+        size_t pos = sizeof(JOURNAL_MAGIC);
+        while (pos < data.size()) {
+            const char *p = data.data() + pos;
+            size_t left = data.size() - pos;
+            if (left < JOURNAL_GAME_HEADER || get_uint32(p + 4) > left) {
+                truncated = true;
+                break;
+            }
+            if (get_uint32(p) != JOURNAL_GAME_MAGIC) {
+                syserr("Input journal " + path + " is corrupted.");
+            }
+
+            JournalGame game{};
+            game.size = get_uint32(p + 4);
+            game.game_id = get_uint32(p + 8);
+            game.seed = get_uint32(p + 12);
+            game.max_x = get_uint32(p + 16);
+            game.max_y = get_uint32(p + 20);
+            game.players = get_uint16(p + 24);
+            game.movement = (MovementMode) get_uint8(p + 26);
+            game.turning_speed = (int8_t) get_uint8(p + 27);
+            game.rounds = get_uint32(p + 28);
+            game.checksums = get_uint32(p + 32);
+            uint32_t names_len = get_uint32(p + 36);
+            game.started = get_uint64((char *) p + 40);
+
+            uint64_t needed = JOURNAL_GAME_HEADER + (uint64_t) names_len + 10 * (uint64_t) game.players +
+                              JournalGame::turnBytes(game.rounds, game.players) + 4 * (uint64_t) game.checksums;
+            if (needed != game.size || game.movement > MovementMode::COMPAT) {
+                syserr("Input journal " + path + " is corrupted.");
+            }
+
+            const char *name = p + JOURNAL_GAME_HEADER;
+            const char *names_end = name + names_len;
+            while (name < names_end) {
+                game.names.emplace_back(name, strnlen(name, names_end - name));
+                name += game.names.back().size() + 1;
+            }
+            if (game.names.size() != game.players) {
+                syserr("Input journal " + path + " is corrupted.");
+            }
+            game.spawn = names_end;
+            game.turns = game.spawn + 10 * game.players;
+            game.checksum_data = game.turns + JournalGame::turnBytes(game.rounds, game.players);
+
+            games.push_back(game);
+            pos += game.size;
+        }
+    }
+
+    [[nodiscard]] const std::vector<JournalGame> &all() const {
+        return games;
+    }
+
+    /// Whether the file ends with an incomplete game.
+    [[nodiscard]] bool isTruncated() const {
+        return truncated;
+    }
+
+    [[nodiscard]] size_t bytes() const {
+        return data.size();
+    }
+};
+
+#endif //JOURNAL_HPP
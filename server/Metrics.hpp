@@ -0,0 +1,290 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/poll.h>
+#include <sys/un.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "BatchIO.hpp"
+#include "Client.hpp"
+#include "Histogram.hpp"
+
+constexpr int NUM_CLIENT_STATUSES = READY + 1;
+
+/// Metrics of a shard: counters since the start of the server and gauges of the
+/// moment they have been taken.
+struct ShardMetrics {
+    IOStats io;
+    uint64_t ticks = 0;
+    /// rounds played in a tick after its first one (by the burst policy)
+    uint64_t tick_overruns = 0;
+    /// rounds skipped (by the drop policy)
+    uint64_t rounds_dropped = 0;
+    uint64_t forwarded = 0;
+    uint64_t games = 0;
+    /// in nanoseconds
+    Histogram tick_duration;
+    Histogram tick_lateness;
+    Histogram events_per_game;
+
+    uint64_t rooms = 0;
+    std::array<uint64_t, NUM_CLIENT_STATUSES> clients{};
+    /// clients being sent missed events
+    uint64_t clients_catching_up = 0;
+    /// events broadcast but not acknowledged yet, of all clients and the greatest of one client
+    uint64_t backlog_events = 0;
+    uint64_t max_backlog_events = 0;
+};
+
+/**
+ * Metrics of all shards in the text format of Prometheus. Shards publish
+ * copies of their metrics every second from their own threads, so counting
+ * costs them plain increments of their own memory, and the text is rendered
+ * by the exporter from the copies.
+ */
+class MetricsRegistry {
+    std::mutex mutex;
+    std::vector<ShardMetrics> shards;
+
+    static void header(std::string &out, const char *name, const char *type, const char *help) {
+        out += std::string("# HELP screen_worms_") + name + " " + help + "\n";
+        out += std::string("# TYPE screen_worms_") + name + " " + type + "\n";
+    }
+
+    static void sample(std::string &out, const std::string &name, const std::string &labels, uint64_t value) {
+        out += "screen_worms_" + name + "{" + labels + "} " + std::to_string(value) + "\n";
+    }
+
+    /// Adds a metric with one sample for every shard.
+    template <class Getter>
+    void metric(std::string &out, const char *name, const char *type, const char *help, Getter get) {
+        header(out, name, type, help);
+        for (size_t i = 0; i < shards.size(); i++) {
+            sample(out, name, "shard=\"" + std::to_string(i) + "\"", get(shards[i]));
+        }
+    }
+
+    /// Adds a histogram with buckets of values below @p bounds (in recorded units,
+    /// powers of two, which are bounds of buckets of Histogram too) reported in
+    /// units @p scale times greater.
+    template <class Getter>
+    void histogram(std::string &out, const char *name, const char *help, std::initializer_list<uint64_t> bounds,
+                   double scale, Getter get) {
+        header(out, name, "histogram", help);
+        for (size_t i = 0; i < shards.size(); i++) {
+            const Histogram &h = get(shards[i]);
+            std::string shard = "shard=\"" + std::to_string(i) + "\"";
+            for (uint64_t bound: bounds) {
+                char le[32];
+                std::snprintf(le, sizeof(le), "%g", (double) bound / scale);
+                sample(out, std::string(name) + "_bucket", shard + ",le=\"" + le + "\"",
+                       h.countNotGreater(bound - 1));
+            }
+            sample(out, std::string(name) + "_bucket", shard + ",le=\"+Inf\"", h.count());
+            char sum[32];
+            std::snprintf(sum, sizeof(sum), "%g", (double) h.getSum() / scale);
+            out += "screen_worms_" + std::string(name) + "_sum{" + shard + "} " + sum + "\n";
+            sample(out, std::string(name) + "_count", shard, h.count());
+        }
+    }
+
+public:
+    explicit MetricsRegistry(size_t num_shards) : shards(num_shards) {}
+
+    void publish(int shard, const ShardMetrics &metrics) {
+        std::lock_guard<std::mutex> lock(mutex);
+        shards[shard] = metrics;
+    }
+
+    std::string render() {
+        static const char *status_names[NUM_CLIENT_STATUSES] = {"observer", "lost", "joined", "playing", "ready"};
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+
+        metric(out, "ticks_total", "counter", "Ticks of rooms handled.",
+               [](const ShardMetrics &m) { return m.ticks; });
+        metric(out, "tick_overruns_total", "counter", "Rounds played late, in a tick with a previous round.",
+               [](const ShardMetrics &m) { return m.tick_overruns; });
+        metric(out, "rounds_dropped_total", "counter", "Rounds skipped as they were too late.",
+               [](const ShardMetrics &m) { return m.rounds_dropped; });
+        histogram(out, "tick_duration_seconds", "Duration of handling a tick of a room.",
+                  {1 << 14, 1 << 16, 1 << 17, 1 << 19, 1 << 20, 1 << 22, 1 << 24}, 1e9,
+                  [](const ShardMetrics &m) -> const Histogram & { return m.tick_duration; });
+        histogram(out, "tick_lateness_seconds", "How late the first round of a tick is played after its deadline.",
+                  {1 << 14, 1 << 16, 1 << 18, 1 << 20, 1 << 22, 1 << 24, 1 << 26}, 1e9,
+                  [](const ShardMetrics &m) -> const Histogram & { return m.tick_lateness; });
+
+        metric(out, "datagrams_received_total", "counter", "Datagrams received.",
+               [](const ShardMetrics &m) { return m.io.datagrams_in; });
+        metric(out, "bytes_received_total", "counter", "Bytes of datagrams received.",
+               [](const ShardMetrics &m) { return m.io.bytes_in; });
+        metric(out, "datagrams_sent_total", "counter", "Datagrams sent.",
+               [](const ShardMetrics &m) { return m.io.datagrams_out; });
+        metric(out, "bytes_sent_total", "counter", "Bytes of datagrams sent.",
+               [](const ShardMetrics &m) { return m.io.bytes_out; });
+        metric(out, "send_errors_total", "counter", "Datagrams that could not be sent.",
+               [](const ShardMetrics &m) { return m.io.send_errors; });
+        metric(out, "receive_queue_drops_total", "counter",
+               "Datagrams dropped by the kernel as the receive queue of the socket was full.",
+               [](const ShardMetrics &m) { return m.io.rx_queue_drops; });
+        metric(out, "datagrams_queued_total", "counter",
+               "Datagrams the socket had no room for, put into outbound queues of clients.",
+               [](const ShardMetrics &m) { return m.io.queued_out; });
+        metric(out, "datagrams_queued_sent_total", "counter",
+               "Queued datagrams sent when the socket has become writable.",
+               [](const ShardMetrics &m) { return m.io.queued_sent; });
+        metric(out, "queue_drops_total", "counter", "Datagrams dropped as outbound queues were full.",
+               [](const ShardMetrics &m) { return m.io.queue_drops; });
+        metric(out, "queued_datagrams", "gauge", "Datagrams waiting in outbound queues.",
+               [](const ShardMetrics &m) { return m.io.queue_depth; });
+        metric(out, "forwarded_datagrams_total", "counter", "Datagrams forwarded to the shard of their room.",
+               [](const ShardMetrics &m) { return m.forwarded; });
+
+        metric(out, "games_total", "counter", "Games finished.",
+               [](const ShardMetrics &m) { return m.games; });
+        histogram(out, "game_events", "Events of a finished game.",
+                  {1 << 7, 1 << 10, 1 << 13, 1 << 16, 1 << 19, 1 << 22}, 1,
+                  [](const ShardMetrics &m) -> const Histogram & { return m.events_per_game; });
+
+        metric(out, "rooms", "gauge", "Rooms of the shard.",
+               [](const ShardMetrics &m) { return m.rooms; });
+        header(out, "clients", "gauge", "Connected clients by their state.");
+        for (size_t i = 0; i < shards.size(); i++) {
+            for (int status = 0; status < NUM_CLIENT_STATUSES; status++) {
+                sample(out, "clients", "shard=\"" + std::to_string(i) + "\",state=\"" + status_names[status] + "\"",
+                       shards[i].clients[status]);
+            }
+        }
+        metric(out, "clients_catching_up", "gauge", "Clients being sent events they have missed.",
+               [](const ShardMetrics &m) { return m.clients_catching_up; });
+        metric(out, "backlog_events", "gauge", "Events broadcast but not acknowledged, of all clients.",
+               [](const ShardMetrics &m) { return m.backlog_events; });
+        metric(out, "max_client_backlog_events", "gauge",
+               "Events broadcast but not acknowledged by the most lagging client.",
+               [](const ShardMetrics &m) { return m.max_backlog_events; });
+
+        return out;
+    }
+};
+
+/**
+ * Thread making metrics available: to whoever connects to a UNIX socket (an
+ * HTTP request, e.g. of curl --unix-socket, is answered with an HTTP
+ * response, anything else with the bare text) and as a file rewritten every
+ * second, which the textfile collector of node_exporter can scrape.
+ */
+class MetricsExporter {
+    MetricsRegistry &registry;
+    const std::string socket_path;
+    const std::string dump_path;
+    int sock;
+
+    void serve() {
+        int client = accept(sock, nullptr, nullptr);
+        if (client < 0) {
+            return;
+        }
+
+        // an HTTP client sends its request first, a plain one may send nothing
+        char request[512];
+        struct pollfd p{client, POLLIN, 0};
+        ssize_t len = 0;
+        if (poll(&p, 1, 50) > 0) {
+            len = read(client, request, sizeof(request));
+        }
+
+        std::string body = registry.render();
+        std::string response;
+        if (len >= 4 && std::strncmp(request, "GET ", 4) == 0) {
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+        }
+        response += body;
+
+        for (size_t sent = 0; sent < response.size(); ) {
+            ssize_t res = write(client, response.data() + sent, response.size() - sent);
+            if (res <= 0) break;
+            sent += res;
+        }
+        close(client);
+    }
+
+    void dump() {
+        std::string tmp = dump_path + ".tmp";
+        FILE *file = std::fopen(tmp.c_str(), "w");
+        if (file == nullptr) {
+            return;
+        }
+        std::string text = registry.render();
+        bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        ok &= std::fclose(file) == 0;
+        if (ok) {
+            std::rename(tmp.c_str(), dump_path.c_str());
+        }
+    }
+
+public:
+    /// Either path may be empty.
+    MetricsExporter(MetricsRegistry &registry_p, std::string socket_path_p, std::string dump_path_p) :
+            registry(registry_p), socket_path(std::move(socket_path_p)), dump_path(std::move(dump_path_p)),
+            sock(-1) {
+        if (socket_path.empty()) {
+            return;
+        }
+
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            syserr("Path of the metrics socket is too long.");
+        }
+        std::strcpy(addr.sun_path, socket_path.c_str());
+
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) syserr("socket of metrics");
+        unlink(socket_path.c_str());
+        if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) syserr("bind of metrics socket");
+        if (listen(sock, 16) < 0) syserr("listen on metrics socket");
+    }
+
+    ~MetricsExporter() {
+        if (sock >= 0) {
+            close(sock);
+            unlink(socket_path.c_str());
+        }
+    }
+
+    void run() {
+        auto next_dump = std::chrono::steady_clock::now();
+        while (true) {
+            struct pollfd p{sock, POLLIN, 0};
+            if (poll(&p, sock >= 0 ? 1 : 0, 1000) > 0) {
+                serve();
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (!dump_path.empty() && now >= next_dump) {
+                dump();
+                next_dump = now + std::chrono::seconds(1);
+            }
+        }
+    }
+};
+
+#endif //METRICS_HPP
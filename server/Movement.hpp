@@ -0,0 +1,148 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef MOVEMENT_HPP
+#define MOVEMENT_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+/// How positions of players are represented and moved.
+enum class MovementMode {
+    /// Q32.32 fixed point with a table of unit vectors computed at compile time,
+    /// gives the same pixels on every host and compiler.
+    FIXED,
+    /// long double with cosl and sinl, as in the first versions of the server
+    /// (the values are computed once per direction and cached).
+    COMPAT
+};
+
+namespace movement {
+    constexpr int FRACTION_BITS = 32;
+    constexpr int64_t ONE = (int64_t) 1 << FRACTION_BITS;
+    constexpr int64_t HALF = ONE / 2;
+
+    constexpr double PI = 3.14159265358979323846;
+
+    /// sin of @p degrees for 0 <= degrees <= 45, by Taylor series (error < 1e-17).
+    constexpr double sinSmall(int degrees) {
+        double x = degrees * PI / 180.0;
+        double term = x, res = x;
+        for (int i = 1; i < 12; i++) {
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            res += term;
+        }
+        return res;
+    }
+
+    /// cos of @p degrees for 0 <= degrees <= 45, by Taylor series.
+    constexpr double cosSmall(int degrees) {
+        double x = degrees * PI / 180.0;
+        double term = 1, res = 1;
+        for (int i = 1; i < 12; i++) {
+            term *= -x * x / ((2 * i - 1) * (2 * i));
+            res += term;
+        }
+        return res;
+    }
+
+    /// sin of @p degrees for 0 <= degrees < 360, with exact symmetries of the circle.
+    constexpr double sinDegrees(int degrees) {
+        if (degrees >= 180) return -sinDegrees(degrees - 180);
+        if (degrees > 90) return sinDegrees(180 - degrees);
+        if (degrees > 45) return cosSmall(90 - degrees);
+        return sinSmall(degrees);
+    }
+
+    constexpr double cosDegrees(int degrees) {
+        return sinDegrees((degrees + 90) % 360);
+    }
+
+    /// Rounds @p value to the nearest number in fixed point.
+    constexpr int64_t toFixed(double value) {
+        double scaled = value * (double) ONE;
+        return scaled >= 0 ? (int64_t) (scaled + 0.5) : -(int64_t) (-scaled + 0.5);
+    }
+
+    struct Vector {
+        int64_t dx;
+        int64_t dy;
+    };
+
+    constexpr std::array<Vector, 360> makeDirections() {
+        std::array<Vector, 360> res{};
+        for (int d = 0; d < 360; d++) {
+            res[d] = {toFixed(cosDegrees(d)), toFixed(sinDegrees(d))};
+        }
+        return res;
+    }
+
+    /// unit vector of every direction (in degrees) in fixed point
+    constexpr std::array<Vector, 360> DIRECTIONS = makeDirections();
+
+    /// Unit vectors computed as by the first versions of the server.
+    inline const std::array<std::pair<long double, long double>, 360> &compatDirections() {
+        static const std::array<std::pair<long double, long double>, 360> directions = [] {
+            std::array<std::pair<long double, long double>, 360> res{};
+            for (int d = 0; d < 360; d++) {
+                long double dir = d;
+                dir = dir * M_PI / 180.0;
+                res[d] = {cosl(dir), sinl(dir)};
+            }
+            return res;
+        }();
+        return directions;
+    }
+}
+
+/// Position of a player on the board.
+class Position {
+    MovementMode mode;
+
+    // fixed point
+    int64_t x;
+    int64_t y;
+
+    // compat
+    long double lx;
+    long double ly;
+
+public:
+    explicit Position(MovementMode mode_p = MovementMode::FIXED) :
+            mode(mode_p), x(-movement::ONE), y(-movement::ONE), lx(-1), ly(-1) {}
+
+    /// Places the position in the middle of pixel (@p px, @p py).
+    void set(int px, int py) {
+        x = (int64_t) px * movement::ONE + movement::HALF;
+        y = (int64_t) py * movement::ONE + movement::HALF;
+        lx = ((long double) px) + 0.5;
+        ly = ((long double) py) + 0.5;
+    }
+
+    /// Moves by one unit in @p direction (in degrees, 0 <= direction < 360).
+    inline void step(int direction) {
+        if (mode == MovementMode::FIXED) {
+            x += movement::DIRECTIONS[direction].dx;
+            y += movement::DIRECTIONS[direction].dy;
+        } else {
+            const auto &v = movement::compatDirections()[direction];
+            lx += v.first;
+            ly += v.second;
+        }
+    }
+
+    [[nodiscard]] inline std::pair<int, int> pixel() const {
+        if (mode == MovementMode::FIXED) {
+            // arithmetic shift rounds towards minus infinity, as floor does
+            return {(int) (x >> movement::FRACTION_BITS), (int) (y >> movement::FRACTION_BITS)};
+        }
+        return {(int) floorl(lx), (int) floorl(ly)};
+    }
+};
+
+#endif //MOVEMENT_HPP
@@ -0,0 +1,162 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef OCCUPANCY_GRID_HPP
+#define OCCUPANCY_GRID_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Set of eaten pixels of a board, with the number of the player that ate
+ * every one of them (for snapshots of the board). The board is split into
+ * tiles of TILE_SIZE x TILE_SIZE pixels, which are allocated when their first
+ * pixel is eaten, so a huge board that is mostly free costs memory for the
+ * painted tiles and a directory of one pointer per tile. A lookup reads the
+ * directory and the tile. Tiles are pooled: clearing the grid for a new game
+ * only detaches the tiles of the last one, they are wiped when reused.
+ */
+class OccupancyGrid {
+public:
+    static constexpr int TILE_BITS = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_BITS;
+
+private:
+    struct Tile {
+        /// 0 for free pixels, owner + 1 for eaten ones, rows one after another
+        uint16_t cells[TILE_SIZE * TILE_SIZE];
+        /// position of the tile in the directory
+        size_t slot;
+    };
+
+    const int width;
+    const int height;
+    const int tiles_x;
+
+    /// tiles in row-major order, nullptr for tiles without eaten pixels
+    std::vector<Tile *> directory;
+    /// allocated tiles in a row of tiles, whole free rows are skipped by runEnd
+    std::vector<int> row_tiles;
+
+    /// tiles allocated so far, the first used of them belong to the current game
+    std::vector<std::unique_ptr<Tile>> pool;
+    size_t used;
+
+    [[nodiscard]] inline size_t slot(int x, int y) const {
+        return (size_t) (y >> TILE_BITS) * tiles_x + (x >> TILE_BITS);
+    }
+
+    [[nodiscard]] static inline int cell(int x, int y) {
+        return ((y & (TILE_SIZE - 1)) << TILE_BITS) | (x & (TILE_SIZE - 1));
+    }
+
+    Tile *allocate(size_t s) {
+        if (used == pool.size()) {
+            pool.emplace_back(new Tile);
+        }
+        Tile *tile = pool[used++].get();
+        std::memset(tile->cells, 0, sizeof(tile->cells));
+        tile->slot = s;
+        directory[s] = tile;
+        row_tiles[s / tiles_x]++;
+        return tile;
+    }
+
+    /// Owner + 1 of pixel (@p x, @p y), 0 if it is free.
+    [[nodiscard]] inline uint16_t value(int x, int y) const {
+        const Tile *tile = directory[slot(x, y)];
+        return tile == nullptr ? 0 : tile->cells[cell(x, y)];
+    }
+
+public:
+    OccupancyGrid(int width_p, int height_p) :
+            width(width_p),
+            height(height_p),
+            tiles_x((width_p + TILE_SIZE - 1) >> TILE_BITS),
+            directory((size_t) tiles_x * ((height_p + TILE_SIZE - 1) >> TILE_BITS), nullptr),
+            row_tiles((height_p + TILE_SIZE - 1) >> TILE_BITS, 0),
+            used(0) {}
+
+    /// Assumes that @p p lies on the board.
+    [[nodiscard]] inline bool contains(std::pair<int, int> p) const {
+        return value(p.first, p.second) != 0;
+    }
+
+    /// Assumes that @p p lies on the board.
+    inline void insert(std::pair<int, int> p, uint16_t owner = 0) {
+        size_t s = slot(p.first, p.second);
+        Tile *tile = directory[s] != nullptr ? directory[s] : allocate(s);
+        tile->cells[cell(p.first, p.second)] = owner + 1;
+    }
+
+    /// Number of the player that ate pixel @p i (in row-major order), -1 if it is free.
+    [[nodiscard]] inline int owner(uint64_t i) const {
+        return value((int) (i % width), (int) (i / width)) - 1;
+    }
+
+    /// End of the run of pixels (in row-major order) with the owner of pixel @p i,
+    /// or @p limit if the run reaches it (the scan ends within the tile of the limit).
+    [[nodiscard]] uint64_t runEnd(uint64_t i, uint64_t limit = UINT64_MAX) const {
+        const uint64_t pixels = std::min((uint64_t) width * height, limit);
+        const uint16_t run = value((int) (i % width), (int) (i / width));
+        int x = (int) (i % width), y = (int) (i / width);
+
+        while (true) {
+            if (run == 0 && row_tiles[y >> TILE_BITS] == 0) {
+                // a whole row of free tiles
+                y = std::min(((y >> TILE_BITS) + 1) << TILE_BITS, height);
+                x = 0;
+            } else {
+                int end = std::min((x | (TILE_SIZE - 1)) + 1, width);
+                const Tile *tile = directory[slot(x, y)];
+                if (tile == nullptr && run != 0) {
+                    return std::min((uint64_t) y * width + x, pixels);
+                }
+                if (tile != nullptr) {
+                    const uint16_t *row = tile->cells + cell(0, y);
+                    for (; x < end; x++) {
+                        if (row[x & (TILE_SIZE - 1)] != run) {
+                            return std::min((uint64_t) y * width + x, pixels);
+                        }
+                    }
+                }
+                x = end;
+                if (x == width) {
+                    x = 0;
+                    y++;
+                }
+            }
+            if (y == height || (uint64_t) y * width + x >= pixels) {
+                return pixels;
+            }
+        }
+    }
+
+    void clear() {
+        for (size_t k = 0; k < used; k++) {
+            directory[pool[k]->slot] = nullptr;
+        }
+        std::fill(row_tiles.begin(), row_tiles.end(), 0);
+        used = 0;
+    }
+
+    /// Tiles of the current game.
+    [[nodiscard]] size_t tiles() const {
+        return used;
+    }
+
+    [[nodiscard]] size_t memoryUsage() const {
+        return directory.capacity() * sizeof(Tile *) + row_tiles.capacity() * sizeof(int) +
+               pool.capacity() * sizeof(std::unique_ptr<Tile>) + pool.size() * sizeof(Tile);
+    }
+};
+
+#endif //OCCUPANCY_GRID_HPP
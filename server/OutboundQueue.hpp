@@ -0,0 +1,281 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef OUTBOUND_QUEUE_HPP
+#define OUTBOUND_QUEUE_HPP
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "../protocol.hpp"
+#include "BatchIO.hpp"
+#include "ClientKey.hpp"
+#include "FlatTable.hpp"
+
+/// What to do with a datagram for a client whose outbound queue is full.
+enum class QueuePolicy {
+    /// drop the oldest datagram of the queue, newer events are worth more
+    DROP_OLDEST,
+    /// drop the new datagram
+    DROP_NEWEST
+};
+
+constexpr uint32_t DEFAULT_CLIENT_QUEUE = 64;
+constexpr uint32_t MAX_QUEUED_DATAGRAMS = 1 << 16;
+
+/**
+ * Datagrams that the socket had no room for, kept until it becomes writable
+ * instead of being lost. Every client (address) has its own queue of at most
+ * `limit` datagrams and all of them hold at most MAX_QUEUED_DATAGRAMS, beyond
+ * that the policy drops a datagram. A datagram is copied once however many
+ * clients it is queued for (e.g. a broadcast), queues hold references to it.
+ * Queues are drained in turns, one datagram of every client at a time, so
+ * a burst to one client does not delay the datagrams of the others.
+ */
+class OutboundQueues {
+    struct Buffer {
+        std::array<char, MAX_DATAGRAM_SIZE> data;
+        uint32_t len;
+        uint32_t refs;
+    };
+
+    struct Entry {
+        uint32_t buffer;
+        bool sent;
+    };
+
+    struct Queue {
+        struct sockaddr_in6 addr;
+        std::deque<Entry> entries;
+    };
+
+    uint32_t limit;
+    QueuePolicy policy;
+
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<uint32_t> free_buffers;
+
+    FlatTable<ClientKey, uint32_t> index;
+    std::vector<Queue> queues;
+    std::vector<uint32_t> free_queues;
+    /// queues that are not empty, in the order of draining
+    std::vector<uint32_t> active;
+    size_t turn;
+    size_t total;
+
+    /// the datagram copied last (by its parts), shared by following ones until the batch ends
+    const void *last_head;
+    const void *last_body;
+    uint32_t last_buffer;
+
+    /// the batch being drained: datagrams, and the queue and position of each of them
+    std::vector<struct mmsghdr> msgs;
+    std::vector<struct iovec> iovs;
+    std::vector<std::pair<uint32_t, uint32_t>> taken;
+    /// datagrams of every queue in the batch, they are the first ones of the queue
+    std::vector<uint32_t> taken_of;
+
+    uint32_t copy(const struct msghdr &hdr) {
+        const void *body = hdr.msg_iovlen > 1 ? hdr.msg_iov[1].iov_base : nullptr;
+        if (hdr.msg_iov[0].iov_base == last_head && body == last_body) {
+            buffers[last_buffer]->refs++;
+            return last_buffer;
+        }
+
+        uint32_t res;
+        if (free_buffers.empty()) {
+            res = buffers.size();
+            buffers.emplace_back(new Buffer);
+        } else {
+            res = free_buffers.back();
+            free_buffers.pop_back();
+        }
+
+        Buffer &buffer = *buffers[res];
+        buffer.len = 0;
+        buffer.refs = 1;
+        for (size_t i = 0; i < hdr.msg_iovlen; i++) {
+            std::memcpy(buffer.data.data() + buffer.len, hdr.msg_iov[i].iov_base, hdr.msg_iov[i].iov_len);
+            buffer.len += hdr.msg_iov[i].iov_len;
+        }
+
+        last_head = hdr.msg_iov[0].iov_base;
+        last_body = body;
+        last_buffer = res;
+        return res;
+    }
+
+    void release(uint32_t buffer) {
+        if (--buffers[buffer]->refs == 0) {
+            free_buffers.push_back(buffer);
+            if (buffer == last_buffer) {
+                last_head = last_body = nullptr;
+            }
+        }
+    }
+
+    /// Queue of the client at @p addr, created if it has none.
+    Queue &queueOf(const struct sockaddr_in6 *addr) {
+        ClientKey key(addr);
+        uint32_t *found = index.find(key);
+        if (found != nullptr) {
+            return queues[*found];
+        }
+
+        uint32_t res;
+        if (free_queues.empty()) {
+            res = queues.size();
+            queues.emplace_back();
+            taken_of.push_back(0);
+        } else {
+            res = free_queues.back();
+            free_queues.pop_back();
+        }
+        queues[res].addr = *addr;
+        index.insert(key, res);
+        active.push_back(res);
+        return queues[res];
+    }
+
+public:
+    OutboundQueues() : limit(DEFAULT_CLIENT_QUEUE), policy(QueuePolicy::DROP_OLDEST), turn(0), total(0),
+                       last_head(nullptr), last_body(nullptr), last_buffer(0),
+                       msgs(SEND_BATCH_SIZE), iovs(SEND_BATCH_SIZE) {}
+
+    /// Sets the length of a queue of a client (0 – datagrams are never queued) and the policy.
+    void setLimit(uint32_t limit_p, QueuePolicy policy_p) {
+        limit = limit_p;
+        policy = policy_p;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return total == 0;
+    }
+
+    /// Datagrams waiting in all queues.
+    [[nodiscard]] size_t size() const {
+        return total;
+    }
+
+    /// Datagrams of a new batch are not the ones copied so far, even at the same addresses.
+    void beginBatch() {
+        last_head = last_body = nullptr;
+    }
+
+    /// Queues datagram @p hdr for its client, or drops one by the policy.
+    void push(const struct msghdr &hdr, IOStats &stats) {
+        auto *addr = (const struct sockaddr_in6 *) hdr.msg_name;
+        uint32_t *found = index.find(ClientKey(addr));
+        size_t queued = found == nullptr ? 0 : queues[*found].entries.size();
+
+        if (queued >= limit || total >= MAX_QUEUED_DATAGRAMS) {
+            stats.queue_drops++;
+            if (policy == QueuePolicy::DROP_NEWEST || queued == 0) {
+                return;
+            }
+            Queue &queue = queues[*found];
+            release(queue.entries.front().buffer);
+            queue.entries.pop_front();
+            total--;
+        }
+
+        Queue &queue = queueOf(addr);
+        queue.entries.push_back({copy(hdr), false});
+        total++;
+        stats.queued_out++;
+        stats.queue_depth = total;
+    }
+
+    /**
+     * Takes a batch of queued datagrams, the first ones of every client in
+     * turns, starting from a different client every time.
+     * @return      number of datagrams in the batch, they stay queued until settle.
+     */
+    unsigned int take() {
+        taken.clear();
+        size_t start = active.empty() ? 0 : turn++ % active.size();
+        for (uint32_t position = 0; taken.size() < SEND_BATCH_SIZE; position++) {
+            size_t before = taken.size();
+            for (size_t k = 0; k < active.size() && taken.size() < SEND_BATCH_SIZE; k++) {
+                uint32_t q = active[(start + k) % active.size()];
+                if (position < queues[q].entries.size()) {
+                    taken.emplace_back(q, position);
+                    taken_of[q]++;
+                }
+            }
+            if (taken.size() == before) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < taken.size(); i++) {
+            Queue &queue = queues[taken[i].first];
+            Buffer &buffer = *buffers[queue.entries[taken[i].second].buffer];
+            iovs[i].iov_base = buffer.data.data();
+            iovs[i].iov_len = buffer.len;
+
+            struct msghdr &hdr = msgs[i].msg_hdr;
+            std::memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &queue.addr;
+            hdr.msg_namelen = sizeof(queue.addr);
+            hdr.msg_iov = &iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+        return taken.size();
+    }
+
+    /// Datagrams of the batch returned by take.
+    struct mmsghdr *batch() {
+        return msgs.data();
+    }
+
+    /// Removes datagrams of the batch from queues but those at indices @p blocked.
+    void settle(const std::vector<unsigned int> &blocked, IOStats &stats) {
+        for (auto &it: taken) {
+            queues[it.first].entries[it.second].sent = true;
+        }
+        for (auto i: blocked) {
+            queues[taken[i].first].entries[taken[i].second].sent = false;
+        }
+
+        for (size_t k = 0; k < active.size();) {
+            uint32_t q = active[k];
+            std::deque<Entry> &entries = queues[q].entries;
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < taken_of[q]; i++) {
+                if (entries[i].sent) {
+                    release(entries[i].buffer);
+                    stats.queued_sent++;
+                    total--;
+                } else {
+                    entries[kept++] = entries[i];
+                }
+            }
+            entries.erase(entries.begin() + kept, entries.begin() + taken_of[q]);
+            taken_of[q] = 0;
+
+            if (entries.empty()) {
+                index.erase(ClientKey(&queues[q].addr));
+                free_queues.push_back(q);
+                active[k] = active.back();
+                active.pop_back();
+            } else {
+                k++;
+            }
+        }
+        taken.clear();
+        stats.queue_depth = total;
+    }
+};
+
+#endif //OUTBOUND_QUEUE_HPP
@@ -1,112 +1,171 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef PLAYER_HPP
-#define PLAYER_HPP
-
-#include <cmath>
-#include <utility>
-#include <memory>
-
-#include "Board.hpp"
-#include "Client.hpp"
-
-struct Player;
-
-using player_ptr = std::shared_ptr<Player>;
-
-struct Player {
-    board_ptr board;
-
-    long double pos_x;
-    long double pos_y;
-    int direction;
-
-    client_ptr client;
-    uint8_t player_num;
-
-    Player(client_ptr c, board_ptr b, uint8_t player_num_p) :
-            board(std::move(b)),
-            client(std::move(c)),
-            player_num(player_num_p) {
-
-        pos_x       = -1;
-        pos_y       = -1;
-        direction   = -1;
-    }
-
-    [[nodiscard]] inline std::pair<int, int> getPixel() const {
-        return {(int)floorl(pos_x), (int)floorl(pos_y)};
-    }
-
-    bool isOnTheBoard() {
-        auto p = getPixel();
-        return
-            p.first >= 0 &&
-            p.first < board->max_x &&
-            p.second >= 0 &&
-            p.second < board->max_y;
-    }
-
-    void generateEventPixel() {
-        board->eaten_pixels.insert(getPixel());
-        board->events.push_back(std::make_shared<Event>(
-                board->events.size(),
-                player_num,
-                pos_x,
-                pos_y));
-    }
-
-    void generateEventPlayerEliminated() {
-        client->state = LOST;
-        board->events.push_back(std::make_shared<Event>(
-                board->events.size(),
-                player_num));
-        board->players_playing--;
-    }
-
-
-    void init() {
-        pos_x = ((long double) (Random::rand() % board->max_x)) + 0.5;
-        pos_y = ((long double) (Random::rand() % board->max_y)) + 0.5;
-        direction = int(Random::rand() % 360);
-
-        if (board->contains(getPixel())) {
-            generateEventPlayerEliminated();
-
-        } else {
-            generateEventPixel();
-        }
-    }
-
-    /// returns true if player has been eliminated, false o/w.
-    bool move(int direction_change) {
-        auto pixel = getPixel();
-        direction = (direction + direction_change + 360) % 360;
-        long double dir = direction;
-        dir = dir * M_PI / 180.0;
-        pos_x += cosl(dir);
-        pos_y += sinl(dir);
-        if (pixel == getPixel()) {
-            return false;
-        }
-
-        if (!isOnTheBoard() || board->contains(getPixel())) {
-            generateEventPlayerEliminated();
-            return true;
-        }
-
-        generateEventPixel();
-        return false;
-    }
-
-    bool operator <(const Player& p) const {
-        return (client->player_name < p.client->player_name);
-    }
-
-};
-
-#endif //PLAYER_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef PLAYER_HPP
+#define PLAYER_HPP
+
+#include <utility>
+#include <memory>
+#include <vector>
+
+#include "../protocol.hpp"
+#include "Board.hpp"
+#include "Client.hpp"
+#include "misc.hpp"
+#include "Movement.hpp"
+
+struct Player;
+
+using player_ptr = std::shared_ptr<Player>;
+
+struct Player {
+    board_ptr board;
+
+    Position pos;
+    int direction;
+
+    client_ptr client;
+    uint16_t player_num;
+    bool eliminated;
+
+    Player(client_ptr c, board_ptr b, uint16_t player_num_p, MovementMode mode) :
+            board(std::move(b)),
+            pos(mode),
+            client(std::move(c)),
+            player_num(player_num_p),
+            eliminated(false) {
+
+        direction   = -1;
+    }
+
+    [[nodiscard]] inline std::pair<int, int> getPixel() const {
+        return pos.pixel();
+    }
+
+    bool isOnTheBoard() {
+        auto p = getPixel();
+        return
+            p.first >= 0 &&
+            p.first < board->max_x &&
+            p.second >= 0 &&
+            p.second < board->max_y;
+    }
+
+    void generateEventPixel() {
+        auto pixel = getPixel();
+        board->eat(pixel, player_num);
+        board->events.pushPixel(player_num, pixel.first, pixel.second);
+    }
+
+    void generateEventPlayerEliminated() {
+        if (client) {
+            // clients simulating the game have no Client objects
+            client->state = LOST;
+        }
+        eliminated = true;
+        board->events.pushPlayerEliminated(player_num);
+        board->players_playing--;
+    }
+
+
+    void init(Random &random) {
+        int x = (int) (random.rand() % board->max_x);
+        int y = (int) (random.rand() % board->max_y);
+        int direction_p = int(random.rand() % 360);
+        spawn(x, y, direction_p);
+    }
+
+    /// Places the player in pixel (@p x, @p y), it is eliminated at once if the pixel is eaten.
+    void spawn(int x, int y, int direction_p) {
+        pos.set(x, y);
+        direction = direction_p;
+
+        if (board->contains(getPixel())) {
+            generateEventPlayerEliminated();
+
+        } else {
+            generateEventPixel();
+        }
+    }
+
+    /// returns true if player has been eliminated, false o/w.
+    bool move(int direction_change) {
+        auto pixel = getPixel();
+        direction = (direction + direction_change + 360) % 360;
+        pos.step(direction);
+        if (pixel == getPixel()) {
+            return false;
+        }
+
+        if (!isOnTheBoard() || board->contains(getPixel())) {
+            generateEventPlayerEliminated();
+            return true;
+        }
+
+        generateEventPixel();
+        return false;
+    }
+
+    bool operator <(const Player& p) const {
+        return (client->player_name < p.client->player_name);
+    }
+
+};
+
+/**
+ * Plays a round, the same on the server and on clients of the input stream.
+ * @param turns     turn direction of every player (0 - straight, 1 - right,
+ *                  2 - left, anything else - the player does not move),
+ * @return          whether the game is over (GAME_OVER has been generated).
+ */
+inline bool playRound(const std::vector<player_ptr> &players, Board &board, int turning_speed,
+                      const uint8_t *turns) {
+    for (size_t i = 0; i < players.size(); i++) {
+        Player &player = *players[i];
+        if (!player.eliminated) {
+            switch (turns[i]) {
+                case 0:
+                    player.move(0);
+                    break;
+                case 1:
+                    player.move(turning_speed);
+                    break;
+                case 2:
+                    player.move(-turning_speed);
+                    break;
+            }
+        }
+
+        // check if the game has ended
+        if (board.players_playing <= 1) {
+            board.events.pushGameOver();
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Checksum of the game: eaten pixels and pixels, directions and eliminations of players.
+/// @p state is where the state is put together, it is reused by following calls.
+inline uint32_t stateChecksum(const std::vector<player_ptr> &players, const Board &board, std::vector<char> &state) {
+    state.resize(8 + 11 * players.size());
+    put_uint32(state.data(), board.pixels_hash >> 32);
+    put_uint32(state.data() + 4, board.pixels_hash);
+
+    char *p = state.data() + 8;
+    for (auto &player: players) {
+        auto pixel = player->getPixel();
+        put_uint32(p, pixel.first);
+        put_uint32(p + 4, pixel.second);
+        put_uint8(p + 8, player->direction / 256);
+        put_uint8(p + 9, player->direction % 256);
+        put_uint8(p + 10, player->eliminated);
+        p += 11;
+    }
+    return crc32(state.data(), state.size());
+}
+
+#endif //PLAYER_HPP
@@ -0,0 +1,406 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "Game.hpp"
+
+/*
+ * A recording is a file of games of a room, appended one after another:
+ *
+ *   FileHeader
+ *   for every game:
+ *     GameHeader
+ *     names       names_len bytes, names of players separated by zero bytes
+ *     events      events_bytes bytes, records as they have been broadcast
+ *     offsets     events + 1 numbers of 4 bytes, offset of every record in
+ *                 events and the end of the last one
+ *     marks       rounds + 1 numbers of 4 bytes, records broadcast before the
+ *                 first round (0) and after every round
+ *
+ * Every part begins at a multiple of 8 bytes. Numbers are in the byte order
+ * of the host except GameHeader::game_id, which is the first 4 bytes of every
+ * datagram of the game. FileHeader::end is the end of the last game that has
+ * been finished, it is moved only when the whole game has been written, so a
+ * reader (even in another process) never sees an incomplete game.
+ */
+
+constexpr char RECORDING_MAGIC[8] = {'W', 'O', 'R', 'M', 'R', 'E', 'C', '1'};
+constexpr uint32_t GAME_MAGIC = 0x47414d45;
+
+struct FileHeader {
+    char magic[8];
+    /// end of the last finished game
+    uint64_t end;
+    uint64_t games;
+    uint64_t reserved;
+};
+
+struct GameHeader {
+    uint32_t magic;
+    /// in network byte order
+    uint32_t game_id;
+    /// seed of the room
+    uint32_t seed;
+    uint32_t max_x;
+    uint32_t max_y;
+    uint32_t players;
+    uint32_t events;
+    uint32_t rounds;
+    uint32_t names_len;
+    uint32_t wide;
+    uint64_t events_bytes;
+    /// wall clock time of the first round, in nanoseconds since the epoch
+    uint64_t started;
+    /// beginning of the next game (the end of this one)
+    uint64_t next;
+};
+
+inline uint64_t alignRecording(uint64_t n) {
+    return (n + 7) & ~(uint64_t) 7;
+}
+
+/// Locations of parts of a recorded game in a mapped file.
+struct RecordedGame {
+    const GameHeader *header;
+    const char *names;
+    const char *events;
+    const uint32_t *offsets;
+    const uint32_t *marks;
+
+    explicit RecordedGame(const char *begin) :
+            header((const GameHeader *) begin),
+            names(begin + sizeof(GameHeader)),
+            events(names + alignRecording(header->names_len)),
+            offsets((const uint32_t *) (events + alignRecording(header->events_bytes))),
+            marks(offsets + header->events + 1) {}
+
+    /// Bytes of the game from the beginning of its header to the end of marks.
+    static uint64_t size(uint32_t names_len, uint64_t events_bytes, uint32_t events, uint32_t rounds) {
+        return sizeof(GameHeader) + alignRecording(names_len) + alignRecording(events_bytes) +
+               alignRecording(4 * (uint64_t) (events + 1) + 4 * (uint64_t) (rounds + 1));
+    }
+
+    /**
+     * Finds events of a datagram, straight in the mapping: records starting
+     * from @p from, not reaching @p end, that fit into a datagram after game_id.
+     * A record that does not fit alone (GameRecorder does not write such) is skipped.
+     * @param from      on return the first event that has not been included,
+     *                  always after @p from if it was before @p end,
+     * @param len       output parameter - bytes of the records, 0 if none.
+     * @return          pointer to the first record.
+     */
+    const char *datagram(uint32_t &from, uint32_t end, int &len) const {
+        const uint32_t *limit = std::upper_bound(offsets + from, offsets + end + 1,
+                                                 offsets[from] + MAX_DATAGRAM_SIZE - 4);
+        uint32_t last = std::max<uint32_t>(from, limit - offsets - 1);
+        const char *res = events + offsets[from];
+        len = (int) (offsets[last] - offsets[from]);
+        from = last == from && from < end ? from + 1 : last;
+        return res;
+    }
+};
+
+/// Maps the file of a recording (@p fd) of @p size bytes, with @p prot.
+inline char *mapRecording(int fd, uint64_t size, int prot) {
+    void *res = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if (res == MAP_FAILED) {
+        syserr("mmap of a recording");
+    }
+    return (char *) res;
+}
+
+/**
+ * Writer of the recording of a room. Games are copied into a shared mapping
+ * of the file: events that are new after a round are copied straight from the
+ * chunks of the event log, the index of the game is written when it ends
+ * and only then the game is published by moving FileHeader::end. The file
+ * grows by doubling, dirty pages are written back by the kernel, so a round
+ * costs no system call. A file that exists is appended to; a game that has
+ * not been finished (e.g. the server has been killed) is overwritten.
+ */
+class GameRecorder {
+    static constexpr uint64_t INITIAL_SIZE = 1 << 20;
+
+    int fd;
+    char *map;
+    uint64_t capacity;
+    const uint32_t seed;
+
+    /// the game being recorded, if open, starting at FileHeader::end
+    bool open;
+    uint64_t events_begin;
+    uint64_t events_bytes;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> marks;
+
+    FileHeader *fileHeader() {
+        return (FileHeader *) map;
+    }
+
+    /// Makes the file at least @p size bytes long.
+    void reserve(uint64_t size) {
+        if (size <= capacity) {
+            return;
+        }
+        uint64_t new_capacity = std::max(capacity * 2, size);
+        if (ftruncate(fd, (off_t) new_capacity) != 0) {
+            syserr("ftruncate of a recording");
+        }
+        void *res = mremap(map, capacity, new_capacity, MREMAP_MAYMOVE);
+        if (res == MAP_FAILED) {
+            syserr("mremap of a recording");
+        }
+        map = (char *) res;
+        capacity = new_capacity;
+    }
+
+public:
+    GameRecorder(const std::string &path, uint32_t seed_p) : capacity(0), seed(seed_p), open(false),
+                                                            events_begin(0), events_bytes(0) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            syserr("Could not open the recording " + path + ".");
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            syserr("fstat of a recording");
+        }
+        bool fresh = st.st_size == 0;
+        if (!fresh && (uint64_t) st.st_size < sizeof(FileHeader)) {
+            syserr("File " + path + " is not a recording.");
+        }
+
+        capacity = std::max<uint64_t>(st.st_size, INITIAL_SIZE);
+        if (ftruncate(fd, (off_t) capacity) != 0) {
+            syserr("ftruncate of a recording");
+        }
+        map = mapRecording(fd, capacity, PROT_READ | PROT_WRITE);
+
+        if (fresh) {
+            std::memcpy(fileHeader()->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+            fileHeader()->end = sizeof(FileHeader);
+        } else if (std::memcmp(fileHeader()->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+            syserr("File " + path + " is not a recording.");
+        }
+    }
+
+    GameRecorder(const GameRecorder &) = delete;
+    GameRecorder &operator=(const GameRecorder &) = delete;
+
+    /// Cuts the file to the end of the last finished game.
+    ~GameRecorder() {
+        uint64_t end = fileHeader()->end;
+        munmap(map, capacity);
+        ftruncate(fd, (off_t) end);
+        close(fd);
+    }
+
+    /// Starts recording game @p game_id on @p board (prepared for the game) of players @p names.
+    void begin(uint32_t game_id, const Board &board, const std::vector<std::string> &names) {
+        uint64_t start = fileHeader()->end;
+        std::string joined;
+        for (auto &name: names) {
+            joined += name;
+            joined += '\0';
+        }
+
+        reserve(start + sizeof(GameHeader) + alignRecording(joined.size()));
+        auto *header = (GameHeader *) (map + start);
+        std::memset(header, 0, sizeof(GameHeader));
+        header->magic = GAME_MAGIC;
+        put_uint32((char *) &header->game_id, game_id);
+        header->seed = seed;
+        header->max_x = board.max_x;
+        header->max_y = board.max_y;
+        header->players = names.size();
+        header->names_len = joined.size();
+        header->wide = board.events.isWide();
+        header->started = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        std::memcpy(map + start + sizeof(GameHeader), joined.data(), joined.size());
+
+        open = true;
+        events_begin = start + sizeof(GameHeader) + alignRecording(joined.size());
+        events_bytes = 0;
+        offsets.clear();
+        marks.assign(1, 0);
+    }
+
+    /// Appends records of @p log that are new, those broadcast after a round.
+    /// Every record has to fit in a datagram, as it is replayed in one.
+    void round(const EventLog &log) {
+        uint64_t new_bytes = log.bytesUsed() - events_bytes;
+        if (new_bytes > 0) {
+            reserve(events_begin + events_bytes + new_bytes);
+            unsigned int from = offsets.size();
+            log.copy(from, map + events_begin + events_bytes, new_bytes);
+
+            for (uint32_t i = offsets.size(); i < log.size(); i++) {
+                uint32_t size = log.totalSize(i);
+                if (size > MAX_DATAGRAM_SIZE - 4) {
+                    syserr("Record " + std::to_string(i) + " does not fit in a datagram.");
+                }
+                offsets.push_back(events_bytes);
+                events_bytes += size;
+            }
+        }
+        marks.push_back(log.size());
+    }
+
+    /// Writes the index of the game and makes it visible to readers.
+    void finish() {
+        uint64_t start = fileHeader()->end;
+        uint32_t events = offsets.size();
+        uint32_t rounds = marks.size() - 1;
+        offsets.push_back(events_bytes);
+
+        uint64_t index = events_begin + alignRecording(events_bytes);
+        uint64_t end = start + RecordedGame::size(((GameHeader *) (map + start))->names_len, events_bytes,
+                                                  events, rounds);
+        reserve(end);
+        std::memcpy(map + index, offsets.data(), offsets.size() * sizeof(uint32_t));
+        std::memcpy(map + index + offsets.size() * sizeof(uint32_t), marks.data(), marks.size() * sizeof(uint32_t));
+
+        auto *header = (GameHeader *) (map + start);
+        header->events = events;
+        header->rounds = rounds;
+        header->events_bytes = events_bytes;
+        header->next = end;
+
+        fileHeader()->games++;
+        __atomic_store_n(&fileHeader()->end, end, __ATOMIC_RELEASE);
+        open = false;
+    }
+
+    /// Appends what @p game has broadcast in the round it has just played.
+    void record(const Game &game) {
+        if (!open) {
+            std::vector<std::string> names;
+            for (auto &player: game.players) {
+                names.push_back(player->client->player_name);
+            }
+            begin(game.game_id, *game.board, names);
+        }
+        round(game.board->events);
+        if (game.isWaitingRoom()) {
+            finish();
+        }
+    }
+
+    /// Games in the file.
+    uint64_t games() {
+        return fileHeader()->games;
+    }
+
+    /// Bytes of the file that are used.
+    uint64_t bytes() {
+        return fileHeader()->end;
+    }
+};
+
+/**
+ * Reader of a recording, mapped read-only. The file may still be written by
+ * a server, games finished since the file has been mapped are found by refresh.
+ */
+class Recording {
+    const std::string path;
+    int fd;
+    const char *map;
+    uint64_t mapped;
+    /// beginnings of games
+    std::vector<uint64_t> games;
+    uint64_t scanned;
+
+    const FileHeader *fileHeader() const {
+        return (const FileHeader *) map;
+    }
+
+public:
+    explicit Recording(std::string path_p) : path(std::move(path_p)), map(nullptr), mapped(0),
+                                             scanned(sizeof(FileHeader)) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            syserr("Could not open the recording " + path + ".");
+        }
+        refresh();
+    }
+
+    Recording(const Recording &) = delete;
+    Recording &operator=(const Recording &) = delete;
+
+    ~Recording() {
+        munmap((void *) map, mapped);
+        close(fd);
+    }
+
+    /**
+     * Finds games finished since the last call. The file is mapped again if
+     * it has grown, pointers to games taken before are not valid then.
+     * @return      whether there are new games.
+     */
+    bool refresh() {
+        uint64_t end = map == nullptr ? 0 : __atomic_load_n(&fileHeader()->end, __ATOMIC_ACQUIRE);
+        if (map == nullptr || end > mapped) {
+            struct stat st{};
+            if (fstat(fd, &st) != 0) {
+                syserr("fstat of a recording");
+            }
+            if ((uint64_t) st.st_size < sizeof(FileHeader)) {
+                syserr("File " + path + " is not a recording.");
+            }
+            if (map != nullptr) {
+                munmap((void *) map, mapped);
+            }
+            mapped = st.st_size;
+            map = mapRecording(fd, mapped, PROT_READ);
+            if (std::memcmp(fileHeader()->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+                syserr("File " + path + " is not a recording.");
+            }
+            end = std::min(__atomic_load_n(&fileHeader()->end, __ATOMIC_ACQUIRE), mapped);
+        }
+
+        size_t known = games.size();
+        while (scanned + sizeof(GameHeader) <= end) {
+            const auto *header = (const GameHeader *) (map + scanned);
+            if (header->magic != GAME_MAGIC || header->next > end ||
+                header->next < scanned + RecordedGame::size(header->names_len, header->events_bytes,
+                                                            header->events, header->rounds)) {
+                syserr("Recording " + path + " is corrupted.");
+            }
+            games.push_back(scanned);
+            scanned = header->next;
+        }
+        return games.size() > known;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return games.size();
+    }
+
+    [[nodiscard]] RecordedGame game(size_t i) const {
+        return RecordedGame(map + games[i]);
+    }
+};
+
+#endif //RECORDING_HPP
@@ -0,0 +1,213 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "BatchIO.hpp"
+#include "CatchUp.hpp"
+#include "ClientKey.hpp"
+#include "EventLoop.hpp"
+#include "FlatTable.hpp"
+#include "InactivityWheel.hpp"
+#include "Recording.hpp"
+#include "convertions.hpp"
+
+/// A client of a replay, always an observer.
+struct Spectator {
+    struct sockaddr_in6 addr;
+    uint64_t session_id;
+    int64_t last_datagram_time;
+    uint8_t capabilities;
+};
+
+/**
+ * Replays recorded games to standard clients, at the pace they have been
+ * played: after every tick the events broadcast after the next round of the
+ * game are broadcast again. Datagrams are put together from the mapped file,
+ * game_id from the header of the game and records straight from the events,
+ * so nothing is parsed nor copied. A client asking for events gets those
+ * already replayed, at most a budget of bytes per its datagram.
+ *
+ * Games are replayed in turns (or only one of them, again and again), with a
+ * pause after each of them. Games finished since the file has been read are
+ * picked up when the last game ends, the file may be written by a server.
+ */
+class ReplayHandler : public EventLoop::Handler {
+    Recording &recording;
+    Sender &sender;
+    /// the game to replay, -1 for all of them in turns
+    const long only_game;
+    /// bytes sent in response to a datagram of a client
+    const uint64_t per_client;
+    /// ticks between games
+    const int pause;
+    const int stats_interval;
+
+    size_t current;
+    /// rounds of the current game replayed and events broadcast so far
+    uint32_t round;
+    uint32_t published;
+    int paused;
+    uint64_t games_replayed;
+
+    FlatTable<ClientKey, Spectator> spectators;
+    InactivityWheel inactivity;
+    std::vector<InactivityWheel::Entry> expired;
+
+    IOStats &io;
+    IOStats io_printed;
+    std::chrono::steady_clock::time_point next_stats;
+
+    /// Whether @p spectator can follow the current game.
+    bool follows(const RecordedGame &game, const Spectator &spectator) const {
+        return !game.header->wide || (spectator.capabilities & CAPABILITY_WIDE);
+    }
+
+    /// Starts the next game (or the same one), if there is any.
+    void nextGame() {
+        if (only_game < 0) {
+            current++;
+        }
+        if (current >= recording.size()) {
+            // pointers of queued datagrams may not survive mapping the file again
+            sender.flush();
+            recording.refresh();
+            current = 0;
+        }
+        round = 0;
+        published = 0;
+        paused = 0;
+        games_replayed++;
+    }
+
+    void disconnectInactive(int64_t now) {
+        expired.clear();
+        inactivity.expire(now, expired);
+        for (auto &entry: expired) {
+            Spectator *spectator = spectators.find(entry.key);
+            if (spectator == nullptr || spectator->session_id != entry.session_id) {
+                continue;
+            }
+            int64_t deadline = spectator->last_datagram_time + MAX_INACTIVITY;
+            if (deadline >= now) {
+                inactivity.schedule(entry, deadline);
+            } else {
+                spectators.erase(entry.key);
+            }
+        }
+    }
+
+public:
+    ReplayHandler(Recording &recording_p, Sender &sender_p, IOStats &io_p, long only_game_p, uint64_t per_client_p,
+                  int pause_p, int stats_interval_p) :
+            recording(recording_p), sender(sender_p), only_game(only_game_p), per_client(per_client_p),
+            pause(pause_p), stats_interval(stats_interval_p),
+            current(only_game_p < 0 ? 0 : only_game_p), round(0), published(0), paused(0), games_replayed(1),
+            inactivity(CatchUp::now()), io(io_p),
+            next_stats(std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval_p)) {}
+
+    void onTimer(size_t, const Tick &tick) override {
+        disconnectInactive(CatchUp::now());
+        if (current >= recording.size()) {
+            // nothing has been recorded yet
+            recording.refresh();
+            return;
+        }
+
+        for (uint64_t j = 0; j < tick.rounds; j++) {
+            RecordedGame game = recording.game(current);
+            if (round == game.header->rounds) {
+                if (++paused >= pause) {
+                    nextGame();
+                }
+                continue;
+            }
+
+            uint32_t end = game.marks[++round];
+            for (uint32_t from = published; from < end; ) {
+                int len;
+                const char *body = game.datagram(from, end, len);
+                if (len == 0) {
+                    continue;
+                }
+                for (auto &it: spectators) {
+                    if (follows(game, it.second)) {
+                        sender.addParts((const char *) &game.header->game_id, 4, body, len, it.second.addr);
+                    }
+                }
+            }
+            published = end;
+        }
+    }
+
+    void onDatagram(char *data, int len, struct sockaddr_in6 *addr) override {
+        if (is_client_mess_ok(len) != 1) {
+            return;
+        }
+        auto mess = convert(data, len, addr);
+        ClientKey key(addr);
+        int64_t now = CatchUp::now();
+
+        Spectator *spectator = spectators.find(key);
+        if (spectator == nullptr || spectator->session_id < mess.session_id) {
+            spectator = &spectators.insert(key, Spectator{*addr, mess.session_id, now, mess.capabilities});
+            inactivity.schedule({key, mess.session_id}, now + MAX_INACTIVITY);
+        } else if (spectator->session_id > mess.session_id) {
+            return;
+        }
+        spectator->last_datagram_time = now;
+        spectator->capabilities = mess.capabilities;
+
+        if (current >= recording.size()) {
+            return;
+        }
+        RecordedGame game = recording.game(current);
+        if (!follows(game, *spectator)) {
+            return;
+        }
+
+        uint64_t sent = 0;
+        for (uint32_t from = mess.next_expected_event_no; from < published && sent < per_client; ) {
+            int body_len;
+            const char *body = game.datagram(from, published, body_len);
+            if (body_len == 0) {
+                continue;
+            }
+            sender.addParts((const char *) &game.header->game_id, 4, body, body_len, spectator->addr);
+            sent += body_len + 4;
+        }
+    }
+
+    void onWakeup() override {}
+
+    void onBatchEnd() override {
+        sender.flush();
+
+        if (stats_interval > 0 && std::chrono::steady_clock::now() >= next_stats) {
+            IOStats diff = io.since(io_printed);
+            std::cout << "Replay: game " << current + 1 << " of " << recording.size()
+                      << ", round " << round << ", games replayed " << games_replayed
+                      << ", spectators " << spectators.size()
+                      << ", datagrams out/s " << diff.datagrams_out / stats_interval
+                      << ", KiB out/s " << diff.bytes_out / stats_interval / 1024 << std::endl;
+            io_printed = io;
+            next_stats += std::chrono::seconds(stats_interval);
+        }
+    }
+};
+
+#endif //REPLAY_HPP
@@ -0,0 +1,291 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Game.hpp"
+#include "CatchUp.hpp"
+#include "Histogram.hpp"
+#include "Metrics.hpp"
+#include "BatchIO.hpp"
+#include "OutboundQueue.hpp"
+#include "ClientKey.hpp"
+#include "FlatTable.hpp"
+#include "Journal.hpp"
+#include "Recording.hpp"
+#include "convertions.hpp"
+
+struct Shard;
+
+/// A single game hosted by the server, with its own board, random number
+/// generator and timer of the shard's event loop.
+struct Room {
+    Game game;
+    CatchUp catch_up;
+    Shard *shard;
+    size_t timer_id;
+    /// where games of the room are recorded, if anywhere
+    std::unique_ptr<GameRecorder> recorder;
+    /// where inputs of games of the room are journaled, if anywhere
+    std::unique_ptr<InputJournal> journal;
+
+    /// number of clients routed to the room by all shards
+    std::atomic<int> assigned;
+    /// whether the room waits for players, updated by its shard
+    std::atomic<bool> waiting;
+
+    Room(Shard *shard_p, int turning_speed, int max_x, int max_y, uint32_t seed, MovementMode movement,
+         int max_clients, const CatchUpBudget &catch_up_budget) :
+            game(turning_speed, max_x, max_y, seed, movement, max_clients),
+            catch_up(catch_up_budget),
+            shard(shard_p),
+            timer_id(0),
+            assigned(0),
+            waiting(true) {}
+};
+
+/// Datagram received by one shard that must be handled by another one.
+struct Forwarded {
+    Room *room;
+    struct sockaddr_in6 addr;
+    int len;
+    char data[MAX_CLIENT_MESS_SIZE];
+};
+
+/**
+ * Rooms served by one worker thread. Every shard has its own socket bound
+ * to the server port with SO_REUSEPORT, so the kernel hashes every client
+ * (by its address and port) to one shard. That shard routes the client to
+ * a room and forwards its datagrams to the shard owning the room, if needed.
+ * Routes are private to the shard receiving the datagrams, so the only data
+ * shared between threads are inboxes of forwarded datagrams and counters of
+ * rooms used for choosing a room for a new client.
+ */
+struct Shard {
+    using clock = std::chrono::steady_clock;
+
+    const int id;
+    int sock;
+    /// signalled when the inbox is not empty
+    int event_fd;
+    std::vector<std::unique_ptr<Room>> rooms;
+
+    /// all rooms of the server
+    std::vector<Room *> *all_rooms;
+    /// multicast group to which new events are sent, if any
+    const struct sockaddr_in6 *group;
+
+    /// length of the outbound queue of a client and what to drop from a full one
+    uint32_t queue_limit;
+    QueuePolicy queue_policy;
+
+    /// duration of handling timer expirations of rooms and how late they are, in nanoseconds
+    Histogram tick_duration;
+    Histogram tick_lateness;
+    uint64_t ticks;
+    uint64_t forwarded;
+
+    /// datagrams to send, flushed at the end of every iteration of the event loop
+    Sender sender;
+    IOStats io;
+
+    /// counters of the whole run; ticks, forwarded and io are never reset either,
+    /// printed statistics are differences from the values they have last taken
+    uint64_t tick_overruns;
+    uint64_t rounds_dropped;
+    uint64_t games;
+    Histogram tick_duration_total;
+    Histogram tick_lateness_total;
+    Histogram events_per_game;
+    IOStats io_printed;
+    uint64_t ticks_printed;
+    uint64_t forwarded_printed;
+
+    /// where metrics are published (if anywhere) and when to do it next
+    MetricsRegistry *metrics;
+    clock::time_point next_publish;
+
+private:
+    struct Route {
+        Room *room;
+        clock::time_point last_seen;
+    };
+
+    FlatTable<ClientKey, Route> routes;
+    clock::time_point next_expiry;
+
+    std::mutex inbox_mutex;
+    std::vector<Forwarded> inbox;
+
+    /**
+     * Chooses a room for a new client. A player goes to a room that waits for
+     * players and has the most of them (so that games fill up), an observer
+     * to a room with a game in progress and the most clients. If there is no
+     * such room, the client goes to the room with the fewest clients.
+     */
+    Room *chooseRoom(bool observer) {
+        Room *best = nullptr, *emptiest = nullptr;
+        int best_clients = -1, emptiest_clients = MAX_CLIENTS;
+
+        for (Room *room: *all_rooms) {
+            int clients = room->assigned.load(std::memory_order_relaxed);
+            if (clients >= room->game.max_clients) {
+                continue;
+            }
+
+            if (room->waiting.load(std::memory_order_relaxed) != observer && clients > best_clients) {
+                best = room;
+                best_clients = clients;
+            }
+            if (clients < emptiest_clients) {
+                emptiest = room;
+                emptiest_clients = clients;
+            }
+        }
+
+        if (best != nullptr) return best;
+        if (emptiest != nullptr) return emptiest;
+        return all_rooms->front();
+    }
+
+public:
+    explicit Shard(int id_p) :
+            id(id_p),
+            sock(-1),
+            event_fd(eventfd(0, EFD_NONBLOCK)),
+            all_rooms(nullptr),
+            group(nullptr),
+            queue_limit(DEFAULT_CLIENT_QUEUE),
+            queue_policy(QueuePolicy::DROP_OLDEST),
+            ticks(0),
+            forwarded(0),
+            tick_overruns(0),
+            rounds_dropped(0),
+            games(0),
+            ticks_printed(0),
+            forwarded_printed(0),
+            metrics(nullptr),
+            next_publish(clock::now()),
+            next_expiry(clock::now()) {}
+
+    ~Shard() {
+        close(event_fd);
+    }
+
+    /// Returns the room of client @p client_id, choosing one for a new client.
+    Room *route(const ClientKey &client_id, bool observer) {
+        auto now = clock::now();
+        Route *route = routes.find(client_id);
+
+        if (route == nullptr) {
+            Room *room = chooseRoom(observer);
+            room->assigned.fetch_add(1, std::memory_order_relaxed);
+            route = &routes.insert(client_id, Route{room, now});
+        }
+
+        route->last_seen = now;
+        return route->room;
+    }
+
+    /// Forgets routes of clients that are silent long enough to be disconnected
+    /// by their rooms. Checks routes at most once a second.
+    void expireRoutes() {
+        auto now = clock::now();
+        if (now < next_expiry) {
+            return;
+        }
+        next_expiry = now + std::chrono::seconds(1);
+
+        for (auto it = routes.begin(); it != routes.end();) { // iterate and erase idiom
+            if (now - it->second.last_seen > std::chrono::seconds(MAX_TIME_OF_INACTIVITY + 1)) {
+                it->second.room->assigned.fetch_sub(1, std::memory_order_relaxed);
+                it = routes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /// Called by other shards, passes a datagram to this shard.
+    void forward(Room *room, const char *data, int len, const struct sockaddr_in6 &addr) {
+        Forwarded f{};
+        f.room = room;
+        f.addr = addr;
+        f.len = len;
+        std::memcpy(f.data, data, len);
+
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex);
+            was_empty = inbox.empty();
+            inbox.push_back(f);
+        }
+
+        if (was_empty) {
+            uint64_t one = 1;
+            write(event_fd, &one, sizeof(one));
+        }
+    }
+
+    /// Publishes metrics of the shard if a second has passed since the last time.
+    void publishMetrics(clock::time_point now) {
+        if (metrics == nullptr || now < next_publish) {
+            return;
+        }
+        next_publish = now + std::chrono::seconds(1);
+
+        ShardMetrics res;
+        res.io = io;
+        res.ticks = ticks;
+        res.tick_overruns = tick_overruns;
+        res.rounds_dropped = rounds_dropped;
+        res.forwarded = forwarded;
+        res.games = games;
+        res.tick_duration = tick_duration_total;
+        res.tick_lateness = tick_lateness_total;
+        res.events_per_game = events_per_game;
+        res.rooms = rooms.size();
+
+        for (auto &room: rooms) {
+            Game &game = room->game;
+            for (auto &it: game.client_map) {
+                const Client &client = *it.second;
+                res.clients[client.state]++;
+                res.clients_catching_up += client.catching_up;
+
+                auto end = (uint32_t) game.board->toBroadcast(client.streamsInputs());
+                uint64_t backlog = end > client.acked ? end - client.acked : 0;
+                res.backlog_events += backlog;
+                res.max_backlog_events = std::max(res.max_backlog_events, backlog);
+            }
+        }
+        metrics->publish(id, res);
+    }
+
+    /// Moves datagrams forwarded to this shard to @p res.
+    void takeInbox(std::vector<Forwarded> &res) {
+        uint64_t count;
+        read(event_fd, &count, sizeof(count));
+
+        res.clear();
+        std::lock_guard<std::mutex> lock(inbox_mutex);
+        inbox.swap(res);
+    }
+};
+
+#endif //SHARD_HPP
@@ -0,0 +1,206 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "Game.hpp"
+
+/// pixels of the board looked at by one call of Snapshot::build
+constexpr uint64_t SNAPSHOT_PIXELS_PER_TICK = 1 << 18;
+
+/**
+ * Board of a game in progress, run-length encoded into BOARD_SNAPSHOT
+ * records (see protocol.hpp) and packed into datagrams. A client that gets
+ * all of them knows events [0, event_no) and continues with event_no, so
+ * joining late costs a few datagrams instead of one record per eaten pixel.
+ * Built from the occupancy grid of the board, which remembers owners of
+ * pixels, a part per call of build so that a large board does not hold up
+ * a tick. Pixels eaten in the meantime may get into it, their PIXEL events
+ * follow anyway. Immutable once complete, so clients may share it.
+ */
+class Snapshot {
+public:
+    struct Page {
+        uint32_t len;
+        char data[MAX_DATAGRAM_SIZE];
+    };
+
+    const uint32_t game_id;
+    /// the snapshot covers events [0, event_no)
+    const uint32_t event_no;
+    std::vector<Page> pages;
+
+private:
+    /// len, event_no, type, x, y, flags and crc32 fields of a record
+    static constexpr uint32_t RECORD_OVERHEAD = 22;
+
+    const uint32_t width;
+    /// of a wide game (see protocol.hpp)
+    const bool wide;
+    const size_t max_run_size;
+    const uint64_t pixels;
+    /// position of the record being written in the last page
+    uint32_t record;
+    /// the first pixel not encoded yet
+    uint64_t next_pixel;
+
+    Page &newPage() {
+        pages.emplace_back();
+        Page &page = pages.back();
+        put_uint32(page.data, game_id);
+        page.len = 4;
+        return page;
+    }
+
+    /// Starts a record with pixels from @p pos, a new page is taken if less than
+    /// @p needed bytes are left in the current one.
+    void openRecord(uint64_t pos, uint8_t flags, const std::vector<uint8_t> &eliminated, uint32_t needed) {
+        if (pages.back().len + needed > MAX_DATAGRAM_SIZE) {
+            newPage();
+        }
+        Page &page = pages.back();
+        record = page.len;
+
+        char *p = page.data + record;
+        put_uint32(p + 4, event_no);
+        put_uint8(p + 8, EVENT_BOARD_SNAPSHOT);
+        put_uint32(p + 9, pos % width);
+        put_uint32(p + 13, pos / width);
+        put_uint8(p + 17, flags);
+        page.len += 18;
+
+        if (flags & SNAPSHOT_ELIMINATED) {
+            if (!wide) {
+                put_uint8(page.data + page.len++, eliminated.size());
+            }
+            for (uint8_t byte: eliminated) {
+                put_uint8(page.data + page.len++, byte);
+            }
+        }
+    }
+
+    void closeRecord(bool last) {
+        Page &page = pages.back();
+        char *p = page.data + record;
+        if (last) {
+            put_uint8(p + 17, get_uint8(p + 17) | SNAPSHOT_LAST);
+        }
+        put_uint32(p, page.len - record - 4);
+        put_uint32(page.data + page.len, crc32(p, page.len - record));
+        page.len += 4;
+    }
+
+    /// Appends a run of @p len pixels of @p owner starting from pixel @p pos.
+    void addRun(uint64_t pos, uint32_t len, uint16_t owner) {
+        if (pages.back().len + max_run_size + 4 > MAX_DATAGRAM_SIZE) {
+            closeRecord(false);
+            openRecord(pos, 0, {}, RECORD_OVERHEAD + max_run_size);
+        }
+        Page &page = pages.back();
+        page.len += putVarint(page.data + page.len, len);
+        if (wide) {
+            page.len += putVarint(page.data + page.len, owner);
+        } else {
+            put_uint8(page.data + page.len++, owner);
+        }
+    }
+
+    /// Copies NEW_GAME (or NEW_GAME_WIDE and PLAYER_NAMES) of @p board to the first pages,
+    /// each of them has to fit in a datagram (a game whose names do not fit in NEW_GAME is wide).
+    void copyNewGame(const Board &board) {
+        for (uint32_t i = 0; i < board.events.size(); i++) {
+            if (i > 0 && get_uint8(board.events.data(i) + 8) != EVENT_PLAYER_NAMES) {
+                break;
+            }
+            uint32_t size = board.events.totalSize(i);
+            if (size > MAX_DATAGRAM_SIZE - 4) {
+                syserr("Record " + std::to_string(i) + " does not fit in a datagram.");
+            }
+            if (pages.back().len + size > MAX_DATAGRAM_SIZE) {
+                newPage();
+            }
+            Page &page = pages.back();
+            std::memcpy(page.data + page.len, board.events.data(i), size);
+            page.len += size;
+        }
+    }
+
+public:
+    explicit Snapshot(Game &game) :
+            game_id(game.game_id),
+            event_no(game.board->events.size()),
+            width(game.board->max_x),
+            wide(game.board->events.isWide()),
+            max_run_size(wide ? MAX_WIDE_RUN_SIZE : MAX_RUN_SIZE),
+            pixels((uint64_t) game.board->max_x * game.board->max_y),
+            record(0),
+            next_pixel(0) {
+        const Board &board = *game.board;
+
+        // the first datagrams start the game for a client that knows nothing
+        newPage();
+        copyNewGame(board);
+
+        // numbers of eliminated players, or a bitmap of them in a wide game
+        std::vector<uint8_t> eliminated;
+        if (wide) {
+            eliminated.resize((game.players.size() + 7) / 8);
+        }
+        for (auto &player: game.players) {
+            if (player->eliminated && wide) {
+                eliminated[player->player_num / 8] |= 1 << (player->player_num % 8);
+            } else if (player->eliminated) {
+                eliminated.push_back(player->player_num);
+            }
+        }
+        openRecord(0, SNAPSHOT_ELIMINATED, eliminated,
+                   RECORD_OVERHEAD + 1 + eliminated.size() + max_run_size);
+    }
+
+    /**
+     * Encodes runs of up to @p budget more pixels of @p board, which has to be
+     * the board of the same game.
+     * @return      whether the snapshot is complete.
+     */
+    bool build(const Board &board, uint64_t budget) {
+        if (next_pixel == pixels) {
+            return true;
+        }
+        uint64_t limit = pixels - next_pixel > budget ? next_pixel + budget : pixels;
+        while (next_pixel < limit) {
+            // a free run of a 65536x65536 board would not fit the varint of a length
+            uint64_t end = std::min<uint64_t>(board.eaten_pixels.runEnd(next_pixel, limit),
+                                              next_pixel + UINT32_MAX);
+            addRun(next_pixel, end - next_pixel, board.eaten_pixels.owner(next_pixel) + 1);
+            next_pixel = end;
+        }
+        if (next_pixel == pixels) {
+            closeRecord(true);
+            return true;
+        }
+        return false;
+    }
+
+    /// Bytes of all datagrams of the snapshot.
+    [[nodiscard]] uint64_t bytes() const {
+        uint64_t res = 0;
+        for (auto &page: pages) {
+            res += page.len;
+        }
+        return res;
+    }
+};
+
+#endif //SNAPSHOT_HPP
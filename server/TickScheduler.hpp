@@ -0,0 +1,93 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef TICK_SCHEDULER_HPP
+#define TICK_SCHEDULER_HPP
+
+#include <ctime>
+#include <cstdint>
+
+/// What to do with rounds whose deadlines have passed while the server was busy.
+enum class CatchUpPolicy {
+    /// play all of them at once
+    BURST,
+    /// play one per tick, ticking twice as often until back on schedule
+    SPREAD,
+    /// skip them, the game is delayed for good
+    DROP
+};
+
+/// A tick of a room that is due.
+struct Tick {
+    /// rounds to play now
+    uint64_t rounds;
+    /// rounds skipped by the DROP policy
+    uint64_t dropped;
+    /// how late the first round of the tick is after its deadline, in nanoseconds
+    int64_t lateness;
+};
+
+/**
+ * Deadlines of ticks of a room, absolute times of CLOCK_MONOTONIC, so that
+ * neither changes of the wall clock nor the time of handling a tick shift
+ * the cadence: the k-th round after a (re)start is due k periods after it.
+ * An event loop arms a one-shot timer at deadline() and calls expire() when it
+ * fires.
+ */
+class TickScheduler {
+    int64_t period;
+    CatchUpPolicy policy;
+    /// the deadline of the next round to play
+    int64_t due;
+    /// when to wake up, earlier than due while spreading rounds that are late
+    int64_t wake;
+
+public:
+    static int64_t now() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    TickScheduler(int64_t period_p, CatchUpPolicy policy_p, int64_t now) :
+            period(period_p), policy(policy_p), due(now + period_p), wake(now + period_p) {}
+
+    [[nodiscard]] int64_t deadline() const {
+        return wake;
+    }
+
+    /// The first round is due a period after @p now, e.g. when a game starts.
+    void restart(int64_t now) {
+        due = wake = now + period;
+    }
+
+    /// The timer has fired at @p now, not earlier than deadline().
+    Tick expire(int64_t now) {
+        Tick tick{1, 0, now > due ? now - due : 0};
+        // rounds due besides the one played in any case
+        uint64_t late = now > due ? (now - due) / period : 0;
+
+        switch (policy) {
+            case CatchUpPolicy::BURST:
+                tick.rounds += late;
+                due += (int64_t) tick.rounds * period;
+                wake = due;
+                break;
+            case CatchUpPolicy::SPREAD:
+                due += period;
+                wake = due > now ? due : now + period / 2;
+                break;
+            case CatchUpPolicy::DROP:
+                tick.dropped = late;
+                due += (int64_t) (1 + late) * period;
+                wake = due;
+                break;
+        }
+        return tick;
+    }
+};
+
+#endif //TICK_SCHEDULER_HPP
@@ -0,0 +1,430 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef URING_LOOP_HPP
+#define URING_LOOP_HPP
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../utils.hpp"
+#include "EventLoop.hpp"
+
+/**
+ * Event loop backend built on io_uring (used directly through system calls).
+ * A multishot recvmsg stays posted on the socket and picks buffers from
+ * a ring of provided buffers, so a single io_uring_enter both submits pending
+ * work and reaps any number of received datagrams. Timers are absolute
+ * timeouts of the ring (standalone, as a linked timeout would cancel the
+ * multishot receive), and sends of a batch are submitted together and reaped
+ * with one io_uring_enter. While outbound queues are not empty a poll for
+ * POLLOUT on the socket is posted.
+ */
+class UringLoop : public EventLoop {
+    static constexpr unsigned int RING_ENTRIES = 1024;
+    static constexpr unsigned int CQ_ENTRIES = 8 * RING_ENTRIES;
+    static constexpr unsigned int BUFFERS = 512;
+    static constexpr unsigned int BUFFER_SIZE = 1024;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+
+    /// kinds of operations, stored in the highest byte of user_data
+    enum op_t : uint64_t { RECV = 1, SEND = 2, TIMER = 3, WAKEUP = 4, WRITABLE = 5 };
+
+    static inline uint64_t userData(op_t op, uint64_t arg) {
+        return ((uint64_t) op << 56) | arg;
+    }
+
+    int sock;
+    int event_fd;
+    IOStats &stats;
+
+    int ring_fd;
+
+    // submission queue
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int to_submit;
+
+    // completion queue
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // provided buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    std::vector<char> buffers;
+    uint16_t buf_tail;
+
+    struct msghdr recv_msg;
+
+    struct Timer {
+        TickScheduler scheduler;
+        uint32_t generation;
+        struct __kernel_timespec ts;
+    };
+    std::vector<Timer> timers;
+
+    uint64_t wakeup_value;
+    bool writable_posted;
+
+    /// completions reaped while waiting for sends, handled by the main loop
+    std::vector<struct io_uring_cqe> deferred;
+
+    struct io_uring_sqe *getSqe() {
+        unsigned int head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        unsigned int tail = *sq_tail;
+        if (tail - head >= RING_ENTRIES) {
+            enter(0);
+            head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        }
+
+        unsigned int index = tail & *sq_mask;
+        struct io_uring_sqe *sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        to_submit++;
+        return sqe;
+    }
+
+    /// Submits pending entries and waits for at least @p wait completions.
+    void enter(unsigned int wait) {
+        while (true) {
+            int res = (int) syscall(__NR_io_uring_enter, ring_fd, to_submit, wait,
+                                    wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (res >= 0) {
+                to_submit -= res;
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                syserr("io_uring_enter");
+            }
+        }
+    }
+
+    void postRecv() {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t) &recv_msg;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = userData(RECV, 0);
+    }
+
+    void postTimer(size_t id) {
+        Timer &timer = timers[id];
+        timer.ts.tv_sec = timer.scheduler.deadline() / SECOND;
+        timer.ts.tv_nsec = timer.scheduler.deadline() % SECOND;
+
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t) &timer.ts;
+        sqe->len = 1;
+        sqe->off = 0;
+        sqe->timeout_flags = IORING_TIMEOUT_ABS;
+        sqe->user_data = userData(TIMER, ((uint64_t) timer.generation << 32) | id);
+    }
+
+    void postWakeup() {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = event_fd;
+        sqe->addr = (uint64_t) &wakeup_value;
+        sqe->len = sizeof(wakeup_value);
+        sqe->off = (uint64_t) -1;
+        sqe->user_data = userData(WAKEUP, 0);
+    }
+
+    void recycleBuffer(uint16_t bid) {
+        // entries are indexed by hand, as in C++ the flexible array of
+        // io_uring_buf_ring is not placed at the beginning of the ring
+        struct io_uring_buf &buf = ((struct io_uring_buf *) buf_ring)[buf_tail & (BUFFERS - 1)];
+        buf.addr = (uint64_t) (buffers.data() + (size_t) bid * BUFFER_SIZE);
+        buf.len = BUFFER_SIZE;
+        buf.bid = bid;
+        buf_tail++;
+        __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+    }
+
+    void handleCompletion(const struct io_uring_cqe &cqe, Handler &handler) {
+        auto op = (op_t) (cqe.user_data >> 56);
+
+        switch (op) {
+            case RECV: {
+                if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                    auto bid = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    char *buf = buffers.data() + (size_t) bid * BUFFER_SIZE;
+                    auto *out = (struct io_uring_recvmsg_out *) buf;
+                    auto *addr = (struct sockaddr_in6 *) (buf + sizeof(*out));
+                    char *payload = buf + sizeof(*out) + recv_msg.msg_namelen + recv_msg.msg_controllen;
+
+                    stats.datagrams_in++;
+                    stats.bytes_in += out->payloadlen;
+                    if (out->controllen > 0) {
+                        struct msghdr control{};
+                        control.msg_control = buf + sizeof(*out) + recv_msg.msg_namelen;
+                        control.msg_controllen = out->controllen;
+                        recordRxQueueDrops(&control, stats);
+                    }
+                    if (!(out->flags & MSG_TRUNC)) {
+                        handler.onDatagram(payload, (int) out->payloadlen, addr);
+                    }
+                    recycleBuffer(bid);
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                    // multishot receive has been terminated (e.g. no buffers left)
+                    postRecv();
+                }
+                break;
+            }
+
+            case TIMER: {
+                size_t id = cqe.user_data & 0xFFFFFFFF;
+                auto generation = (uint32_t) ((cqe.user_data >> 32) & 0xFFFFFF);
+                Timer &timer = timers[id];
+                if (generation != (timer.generation & 0xFFFFFF)) {
+                    break; // timer has been restarted in the meantime
+                }
+
+                int64_t now = TickScheduler::now();
+                if (now < timer.scheduler.deadline()) {
+                    postTimer(id);
+                    break;
+                }
+
+                Tick tick = timer.scheduler.expire(now);
+                postTimer(id);
+                handler.onTimer(id, tick);
+                break;
+            }
+
+            case WAKEUP:
+                postWakeup();
+                handler.onWakeup();
+                break;
+
+            case WRITABLE:
+                writable_posted = false;
+                drainOutbound(stats);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /// Moves ready completions to @p res.
+    void reap(std::vector<struct io_uring_cqe> &res) {
+        unsigned int head = *cq_head;
+        unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            res.push_back(cqes[head & *cq_mask]);
+            head++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+public:
+    UringLoop(int sock_p, int event_fd_p, IOStats &stats_p) :
+            sock(sock_p), event_fd(event_fd_p), stats(stats_p), to_submit(0),
+            buffers((size_t) BUFFERS * BUFFER_SIZE), buf_tail(0), recv_msg(), wakeup_value(0),
+            writable_posted(false) {
+
+        struct io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = CQ_ENTRIES;
+
+        ring_fd = (int) syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+        if (ring_fd < 0)
+            syserr("io_uring_setup");
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED)
+            syserr("mmap of io_uring submission queue");
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED)
+                syserr("mmap of io_uring completion queue");
+        }
+
+        sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *) mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            syserr("mmap of io_uring submission entries");
+
+        auto sq = (char *) sq_ptr;
+        sq_head  = (unsigned int *) (sq + params.sq_off.head);
+        sq_tail  = (unsigned int *) (sq + params.sq_off.tail);
+        sq_mask  = (unsigned int *) (sq + params.sq_off.ring_mask);
+        sq_array = (unsigned int *) (sq + params.sq_off.array);
+
+        auto cq = (char *) cq_ptr;
+        cq_head = (unsigned int *) (cq + params.cq_off.head);
+        cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+        cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+        cqes    = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+        // register the ring of provided buffers
+        buf_ring_size = BUFFERS * sizeof(struct io_uring_buf);
+        buf_ring = (struct io_uring_buf_ring *) mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf_ring == MAP_FAILED)
+            syserr("mmap of buffer ring");
+
+        struct io_uring_buf_reg reg{};
+        reg.ring_addr = (uint64_t) buf_ring;
+        reg.ring_entries = BUFFERS;
+        reg.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            syserr("io_uring_register of buffer ring (kernel 5.19 or newer is required)");
+
+        for (uint16_t bid = 0; bid < BUFFERS; bid++) {
+            recycleBuffer(bid);
+        }
+
+        recv_msg.msg_namelen = sizeof(struct sockaddr_in6);
+        recv_msg.msg_controllen = RECV_CONTROL_SIZE;
+    }
+
+    ~UringLoop() override {
+        munmap(buf_ring, buf_ring_size);
+        munmap(sqes, sqes_size);
+        if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+        munmap(sq_ptr, sq_size);
+        close(ring_fd);
+    }
+
+    size_t addTimer(long period, CatchUpPolicy policy) override {
+        timers.push_back({TickScheduler(period, policy, TickScheduler::now()), 0, {}});
+        return timers.size() - 1;
+    }
+
+    void restartTimer(size_t id) override {
+        // the pending timeout will be ignored when it completes
+        timers[id].generation++;
+        timers[id].scheduler.restart(TickScheduler::now());
+        postTimer(id);
+    }
+
+    void run(Handler &handler) override {
+        std::vector<struct io_uring_cqe> ready;
+
+        postRecv();
+        postWakeup();
+        for (size_t i = 0; i < timers.size(); i++) {
+            postTimer(i);
+        }
+
+        while (!stopped) {
+            ready.clear();
+            ready.swap(deferred);
+
+            if (ready.empty()) {
+                enter(1);
+                stats.recv_calls++;
+            }
+            reap(ready);
+
+            for (auto &cqe: ready) {
+                handleCompletion(cqe, handler);
+            }
+
+            handler.onBatchEnd();
+        }
+    }
+
+protected:
+    void transmit(struct mmsghdr *msgs, unsigned int n, IOStats &stats_p,
+                  std::vector<unsigned int> &blocked_p) override {
+        std::vector<struct io_uring_cqe> ready;
+        unsigned int done = 0;
+
+        for (unsigned int i = 0; i < n; i++) {
+            msgs[i].msg_len = 0;
+            struct io_uring_sqe *sqe = getSqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = sock;
+            sqe->addr = (uint64_t) &msgs[i].msg_hdr;
+            sqe->msg_flags = MSG_DONTWAIT;
+            sqe->user_data = userData(SEND, i);
+        }
+
+        while (done < n) {
+            enter(n - done);
+            stats_p.send_calls++;
+
+            ready.clear();
+            reap(ready);
+            for (auto &cqe: ready) {
+                if ((op_t) (cqe.user_data >> 56) != SEND) {
+                    deferred.push_back(cqe);
+                    continue;
+                }
+
+                done++;
+                if (cqe.res >= 0) {
+                    msgs[cqe.user_data & 0xFFFFFFFF].msg_len = cqe.res;
+                    stats_p.datagrams_out++;
+                    stats_p.bytes_out += cqe.res;
+                } else if (cqe.res == -EAGAIN || cqe.res == -EWOULDBLOCK || cqe.res == -ENOBUFS) {
+                    blocked_p.push_back(cqe.user_data & 0xFFFFFFFF);
+                } else {
+#ifdef DEBUG
+                    std::cout << "Error on sending data to client " << -cqe.res << std::endl;
+#endif
+                    stats_p.send_errors++;
+                }
+            }
+        }
+        // completions come in any order
+        std::sort(blocked_p.begin(), blocked_p.end());
+    }
+
+    void waitWritable() override {
+        if (writable_posted) {
+            return;
+        }
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = sock;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = userData(WRITABLE, 0);
+        writable_posted = true;
+    }
+};
+
+#endif //URING_LOOP_HPP
@@ -1,36 +1,62 @@
-/*
- * Author:   Witold Drzewakowski
- * Date:     2021-05-25
- * University of Warsaw
- */
-
-#ifndef CONVERTIONS_HPP
-#define CONVERTIONS_HPP
-
-#include <sys/socket.h>
-
-struct client_mess {
-    uint64_t session_id;
-    uint8_t turn_direction;
-    uint32_t next_expected_event_no;
-    std::string player_name;
-    struct sockaddr_in6 *addr;
-};
-
-int is_client_mess_ok(int len) {
-    return len >= 13 && len <= 33;
-}
-
-struct client_mess convert(char buff[], int len, struct sockaddr_in6 *addr) {
-    struct client_mess res {
-            get_uint64(buff),
-            get_uint8(buff + 8),
-            get_uint32(buff + 9),
-            std::string(buff + 13, len - 13),
-            addr
-    };
-    return res;
-}
-
-
-#endif //CONVERTIONS_HPP
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+#ifndef CONVERTIONS_HPP
+#define CONVERTIONS_HPP
+
+#include <sys/socket.h>
+#include <cstring>
+
+/// session_id, turn_direction and next_expected_event_no
+constexpr int MIN_CLIENT_MESS_SIZE = 13;
+/// ... followed by a name of 20 characters and the capability trailer (a zero byte and the flags)
+constexpr int MAX_CLIENT_MESS_SIZE = MIN_CLIENT_MESS_SIZE + 20 + 2;
+
+struct client_mess {
+    uint64_t session_id;
+    uint8_t turn_direction;
+    uint32_t next_expected_event_no;
+    std::string player_name;
+    struct sockaddr_in6 *addr;
+    /// extensions of the protocol understood by the client (see protocol.hpp)
+    uint8_t capabilities;
+};
+
+/// Checks the length of a datagram, the name may be followed by the capability trailer.
+int is_client_mess_ok(int len) {
+    return len >= MIN_CLIENT_MESS_SIZE && len <= MAX_CLIENT_MESS_SIZE;
+}
+
+/// Length of the player name in a datagram of length @p len, without the capability trailer.
+int client_name_len(const char buff[], int len) {
+    // a zero byte anywhere else stays in the name, which makes it invalid
+    if (len >= MIN_CLIENT_MESS_SIZE + 2 && buff[len - 2] == '\0' &&
+        std::memchr(buff + MIN_CLIENT_MESS_SIZE, '\0', len - MIN_CLIENT_MESS_SIZE - 2) == nullptr) {
+        return len - MIN_CLIENT_MESS_SIZE - 2;
+    }
+    return len - MIN_CLIENT_MESS_SIZE;
+}
+
+struct client_mess convert(char buff[], int len, struct sockaddr_in6 *addr) {
+    int name_len = client_name_len(buff, len);
+    uint8_t capabilities = 0;
+    if (name_len != len - MIN_CLIENT_MESS_SIZE) {
+        capabilities = get_uint8(buff + len - 1);
+    }
+
+    struct client_mess res {
+            get_uint64(buff),
+            get_uint8(buff + 8),
+            get_uint32(buff + 9),
+            std::string(buff + 13, name_len),
+            addr,
+            capabilities
+    };
+    return res;
+}
+
+
+#endif //CONVERTIONS_HPP
@@ -14,6 +14,10 @@
 
 #include <iostream>
 #include <future>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <sched.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -21,43 +25,85 @@
 #include <netinet/in.h>
 #include <netdb.h>
 
-#include <sys/timerfd.h>
-#include <sys/poll.h>
-
 #include "../utils.hpp"
+#include "../multicast.hpp"
 #include "misc.hpp"
 #include "convertions.hpp"
 #include "Game.hpp"
+#include "Shard.hpp"
+#include "ClientKey.hpp"
+#include "EventLoop.hpp"
+#include "UringLoop.hpp"
+#include "Metrics.hpp"
+#include "Recording.hpp"
+#include "Replay.hpp"
 
 #define BUFFER_SIZE   600
-#define LINE_SIZE     100
-#define MAX_BOARD_DIM 4000
-#define SECOND        1'000'000'000
-
-void broadcastNewEvents(Game &game, int sock, char *buffer) {
-    size_t len;
-    socklen_t snd_addr_len;
-    unsigned int from = game.board->event_to_broadcast;
-    while (true) {
-
-        len = game.buildDatagram(from, buffer);
-        if (len <= 0) break;
-
-        for (const auto &it: game.client_map) {
-            snd_addr_len = sendto(sock, buffer, len, 0,
-                    (struct sockaddr *) &it.second->addr, (socklen_t) sizeof(it.second->addr));
-
-            if ((size_t) snd_addr_len != len) {
-                std::cout << "Error (while \"broadcasting\" a new event) on sending data to client " << errno << " " << snd_addr_len << " " << len << std::endl;
-                break;
-            }
-        }
-
+#define MAX_BOARD_DIM 65536
+#define MAX_ROOMS     1000
+#define DEFAULT_CLIENT_CATCH_UP (4 * MAX_DATAGRAM_SIZE)
+#define DEFAULT_ROOM_CATCH_UP   (64 * 1024)
+#define USAGE         "Usage: ./screen-worms-server [-p n] [-s n] [-t n] [-v n] [-w n] [-h n] [-r n] [-c n] [-S n] [-e backend] [-m mode] [-b n] [-B n] [-M path] [-D path] [-T policy] [-C n] [-R dir] [-P file] [-G n] [-J dir] [-g group] [-q n] [-Q policy]"
+
+/// Prints the number of rounds per second and tick duration of a shard since the last call.
+void printShardStats(Shard &shard, int interval) {
+    IOStats io = shard.io.since(shard.io_printed);
+    uint64_t ticks = shard.ticks - shard.ticks_printed;
+    std::string line = "Shard " + std::to_string(shard.id) +
+            ": rooms " + std::to_string(shard.rooms.size()) +
+            ", ticks/s " + std::to_string(ticks / interval) +
+            ", tick p50 " + std::to_string(shard.tick_duration.percentile(0.5) / 1000) +
+            " us, p99 " + std::to_string(shard.tick_duration.percentile(0.99) / 1000) +
+            " us, max " + std::to_string(shard.tick_duration.max() / 1000) +
+            " us, lateness p99 " + std::to_string(shard.tick_lateness.percentile(0.99) / 1000) +
+            " us, max " + std::to_string(shard.tick_lateness.max() / 1000) +
+            " us, forwarded datagrams " + std::to_string(shard.forwarded - shard.forwarded_printed) + "\n";
+    uint64_t catch_up_bytes = 0, catch_up_datagrams = 0, avoided_bytes = 0, retransmissions = 0, clients = 0,
+             snapshots_built = 0, snapshots_sent = 0;
+    for (auto &room: shard.rooms) {
+        catch_up_bytes += room->catch_up.bytes_sent;
+        catch_up_datagrams += room->catch_up.datagrams_sent;
+        avoided_bytes += room->catch_up.bytes_avoided;
+        retransmissions += room->catch_up.retransmissions;
+        clients += room->game.client_map.size();
+        room->catch_up.bytes_sent = room->catch_up.datagrams_sent = 0;
+        snapshots_built += room->catch_up.snapshots_built;
+        snapshots_sent += room->catch_up.snapshots_sent;
+        room->catch_up.bytes_avoided = room->catch_up.retransmissions = 0;
+        room->catch_up.snapshots_built = room->catch_up.snapshots_sent = 0;
     }
-    game.board->event_to_broadcast = game.board->events.size();
+    if (clients == 0) clients = 1;
+    if (ticks == 0) ticks = 1;
+    line += "Shard " + std::to_string(shard.id) +
+            ": per tick receive calls " + std::to_string((double) io.recv_calls / ticks) +
+            ", send calls " + std::to_string((double) io.send_calls / ticks) +
+            ", datagrams in " + std::to_string((double) io.datagrams_in / ticks) +
+            ", out " + std::to_string((double) io.datagrams_out / ticks) +
+            ", send errors " + std::to_string(io.send_errors) +
+            ", receive queue drops " + std::to_string(io.rx_queue_drops) +
+            ", queued " + std::to_string(io.queued_out) +
+            " (sent " + std::to_string(io.queued_sent) +
+            ", dropped " + std::to_string(io.queue_drops) +
+            ", waiting " + std::to_string(io.queue_depth) + ")" +
+            ", catch-up " + std::to_string(catch_up_datagrams / interval) + " datagrams/s, " +
+            std::to_string(catch_up_bytes / interval / 1024) + " KiB/s\n";
+    line += "Shard " + std::to_string(shard.id) +
+            ": per client out " + std::to_string(io.bytes_out / interval / clients) +
+            " B/s, duplicates avoided " + std::to_string(avoided_bytes / interval / clients) +
+            " B/s, retransmissions " + std::to_string(retransmissions) +
+            ", snapshots built " + std::to_string(snapshots_built) +
+            ", sent " + std::to_string(snapshots_sent) + "\n";
+    std::cout << line << std::flush;
+
+    shard.ticks_printed = shard.ticks;
+    shard.forwarded_printed = shard.forwarded;
+    shard.io_printed = shard.io;
+    shard.tick_duration.clear();
+    shard.tick_lateness.clear();
 }
 
-void initUDPSocket(struct pollfd *p, const char *port) {
+/// Opens the socket of a shard, @p reuse_port allows other shards to bind the same port.
+int initUDPSocket(const char *port, bool reuse_port) {
     int sock, rv;
 
     struct sockaddr_in6 server_address{};
@@ -75,6 +121,15 @@ void initUDPSocket(struct pollfd *p, const char *port) {
     if (setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &v6OnlyEnabled, sizeof(v6OnlyEnabled)) != 0)
         syserr("setsockopt");
 
+    int reusePortEnabled = 1;
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reusePortEnabled, sizeof(reusePortEnabled)) != 0)
+        syserr("setsockopt SO_REUSEPORT");
+
+    // received datagrams carry the number of those dropped on a full receive queue
+    int rxqOvflEnabled = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &rxqOvflEnabled, sizeof(rxqOvflEnabled)) != 0)
+        syserr("setsockopt SO_RXQ_OVFL");
+
     // bind the socket to a concrete address
     rv = bind(sock, (struct sockaddr*) &server_address,
               (socklen_t) sizeof(server_address));
@@ -85,176 +140,240 @@ void initUDPSocket(struct pollfd *p, const char *port) {
         syserr("fctl failed.");
     }
 
-    p->fd = sock;
-    p->revents = 0;
-    p->events = POLLIN;
+    return sock;
 }
 
 
-void server_routine(long freq, const char *port, Game &game) {
-    ssize_t len;
-    char buffer[BUFFER_SIZE], peer_addr[LINE_SIZE + 1];
-
-    struct sockaddr_in6 client_address{};
-    socklen_t snd_addr_len, rcv_addr_len;
-
-    struct pollfd p[2];
-    std::memset(p, 0, sizeof(p));
-
-    int timer_fd;
-    int64_t timers_elapsed;
-    struct itimerspec timerValue{}, zeroValue{}, clearValue{};
-
-    // set timerfd
-    timer_fd = timerfd_create(CLOCK_REALTIME, 0);
-    if (timer_fd < 0)
-        syserr("failed to create timer fd");
+/// Handles a datagram of a client routed to @p room of shard @p shard.
+void handleDatagram(Shard &shard, EventLoop &loop, Room *room, char *datagram, int len,
+                    struct sockaddr_in6 *client_address, char *buffer) {
+    auto mess = convert(datagram, len, client_address);
+    ClientKey client_id(client_address);
+#ifdef DEBUG
+    std::cout
+            << "Session id: " << mess.session_id << std::endl
+            << "Turn direction: " << (unsigned) mess.turn_direction << std::endl
+            << "Next event: " << mess.next_expected_event_no << std::endl
+            << "Player name: " << mess.player_name << std::endl
+            << "Client: " << client_id.toString() << std::endl;
+#endif
+    Game &game = room->game;
+    int64_t now = CatchUp::now();
 
-    bzero(&timerValue, sizeof(timerValue));
+    if (!game.handleClient(client_id, mess, now)) {
+        // datagram contains somehow invalid data, must be ignored
+#ifdef DEBUG
+        std::cout << "Datagram logically invalid, ignoring" << std::endl;
+#endif
+        return;
+    }
 
-    if (freq >= SECOND) {
-        clearValue.it_value.tv_sec = 1;
-        clearValue.it_value.tv_nsec = 0;
-        clearValue.it_interval.tv_sec = 1;
-        clearValue.it_interval.tv_nsec = 0;
-    } else {
-        clearValue.it_value.tv_sec = 0;
-        clearValue.it_value.tv_nsec = freq;
-        clearValue.it_interval.tv_sec = 0;
-        clearValue.it_interval.tv_nsec = freq;
+    if (game.isWaitingRoom()) {
+        if (game.waitingRoomRoutine(client_id)) {
+            // game has been started, reset timer
+            room->waiting.store(false, std::memory_order_relaxed);
+            loop.restartTimer(room->timer_id);
+        }
     }
-    std::memcpy(&timerValue, &clearValue, sizeof(struct itimerspec));
 
-    p[0].fd = timer_fd;
-    p[0].revents = 0;
-    p[0].events = POLLIN;
+    Client &client = **game.client_map.find(client_id);
+    if (game.setCapabilities(client, mess.capabilities)) {
+        // the client may have switched between events and the input stream
+        client.resetEvents();
+    }
+    room->catch_up.request(game, client, mess.next_expected_event_no, now);
+    room->catch_up.serve(game, client, shard.sender, buffer, now);
+}
 
-    initUDPSocket(&p[1], port);
-    signal(SIGPIPE, SIG_IGN);
+/// Game logic of a shard, driven by its event loop.
+class ShardHandler : public EventLoop::Handler {
+    Shard &shard;
+    EventLoop &loop;
+    int stats_interval;
 
-    // start timer
-    if (timerfd_settime(timer_fd, 0, &timerValue, nullptr) < 0)
-        syserr("could not start timer");
+    char buffer[BUFFER_SIZE];
+    std::vector<Forwarded> forwarded;
+    std::chrono::steady_clock::time_point next_stats;
 
-    // wait for events
-    while (true) {
-        p[0].revents = p[1].revents = 0;
+public:
+    ShardHandler(Shard &shard_p, EventLoop &loop_p, int stats_interval_p) :
+            shard(shard_p), loop(loop_p), stats_interval(stats_interval_p), buffer(),
+            next_stats(std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval_p)) {}
 
-        int rv = poll(p, 2, -1);
+    void onTimer(size_t id, const Tick &tick) override {
+        auto tick_start = std::chrono::steady_clock::now();
+        Room *room = shard.rooms[id].get();
+        Game &game = room->game;
 
-        if (rv <= 0) {
-            std::cout << "poll interrupted" << std::endl;
-            break;
-        }
+        shard.tick_lateness.record(tick.lateness);
+        shard.tick_lateness_total.record(tick.lateness);
+        shard.rounds_dropped += tick.dropped;
 
-        if (p[0].revents & POLLIN) {
-            timers_elapsed = 0;
-            read(p[0].fd, &timers_elapsed, 8);
-            game.disconnectInactiveClients();
+        game.disconnectInactiveClients(CatchUp::now());
 
-            for (int64_t i = 0; i < timers_elapsed; i++) {
-                if (game.isWaitingRoom()) {
-                    break;
-                }
-                game.doRound();
+        for (uint64_t j = 0; j < tick.rounds; j++) {
+            if (game.isWaitingRoom()) {
+                break;
+            }
+            shard.tick_overruns += j > 0;
+            bool over = game.doRound();
+            if (room->recorder != nullptr) {
+                room->recorder->record(game);
+            }
+            if (room->journal != nullptr) {
+                room->journal->record(game);
+            }
+            if (over) {
+                shard.games++;
+                shard.events_per_game.record(game.board->events.size());
             }
-
-            broadcastNewEvents(game, p[1].fd, buffer);
         }
+        room->waiting.store(game.isWaitingRoom(), std::memory_order_relaxed);
 
-        if (p[1].revents & (POLLIN | POLLERR)) {
-#ifdef DEBUG
-            std::cout << "Receiving datagram from client socket" << std::endl;
-#endif
+        broadcastNewEvents(game, shard.sender, buffer, shard.group);
+        room->catch_up.tick(game, shard.sender, buffer, CatchUp::now());
 
-            rcv_addr_len = (socklen_t) sizeof(client_address);
-            len = recvfrom(p[1].fd, buffer, sizeof(buffer), 0,
-                           (struct sockaddr *) &client_address, &rcv_addr_len);
-            if (len <= 0) {
-                std::cout << "error on datagram from client socket" << std::endl;
-                continue;
-            }
+        shard.ticks++;
+        auto tick_end = std::chrono::steady_clock::now();
+        uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_end - tick_start).count();
+        shard.tick_duration.record(duration);
+        shard.tick_duration_total.record(duration);
+        shard.publishMetrics(tick_end);
+    }
+
+    void onWakeup() override {
+        shard.takeInbox(forwarded);
+        for (auto &f: forwarded) {
+            handleDatagram(shard, loop, f.room, f.data, f.len, &f.addr, buffer);
+        }
+    }
 
-            if (is_client_mess_ok(len) != 1) {
+    void onDatagram(char *data, int len, struct sockaddr_in6 *addr) override {
+        if (is_client_mess_ok(len) != 1) {
 #ifdef DEBUG
-                std::cout << "Incorrect length of client message" << std::endl;
+            std::cout << "Incorrect length of client message" << std::endl;
 #endif
-                continue;
-            }
+            return;
+        }
 
-            // read address
-            inet_ntop(AF_INET, &client_address.sin6_addr, peer_addr, LINE_SIZE);
+        // datagrams of observers do not contain player name, they may contain the capability trailer
+        Room *room = shard.route(ClientKey(addr), client_name_len(data, len) == 0);
 
-            auto mess = convert(buffer, len, &client_address);
-            std::string client_id = toSocket(peer_addr, ntohs(client_address.sin6_port));
-#ifdef DEBUG
-            std::cout
-                    << "Session id: " << mess.session_id << std::endl
-                    << "Turn direction: " << (unsigned) mess.turn_direction << std::endl
-                    << "Next event: " << mess.next_expected_event_no << std::endl
-                    << "Player name: " << mess.player_name << std::endl
-                    << "Client address: " << peer_addr << std::endl
-                    << "Client port: " << ntohs(client_address.sin6_port) << std::endl;
-#endif
-            if (!game.handleClient(client_id, mess)) {
-                // datagram contains somehow invalid data, must be ignored
-#ifdef DEBUG
-                std::cout << "Datagram logically invalid, ignoring" << std::endl;
-#endif
-                continue;
-            }
+        if (room->shard == &shard) {
+            handleDatagram(shard, loop, room, data, len, addr, buffer);
+        } else {
+            room->shard->forward(room, data, len, *addr);
+            shard.forwarded++;
+        }
+    }
 
-            if (game.isWaitingRoom()) {
-                if (game.waitingRoomRoutine(client_id)) {
-                    // game has been started, reset timer
+    void onBatchEnd() override {
+        shard.expireRoutes();
+        shard.sender.flush();
 
-                    bzero(&zeroValue, sizeof(zeroValue));
-                    if (timerfd_settime(timer_fd, 0, &zeroValue, nullptr) == -1) {
-                        syserr("timerfd_settime");
-                    }
+        if (stats_interval > 0 && std::chrono::steady_clock::now() >= next_stats) {
+            printShardStats(shard, stats_interval);
+            next_stats += std::chrono::seconds(stats_interval);
+        }
+    }
+};
 
-                    std::memcpy(&timerValue, &clearValue, sizeof(struct itimerspec));
+/// Creates the event loop of shard @p shard with backend @p backend.
+std::unique_ptr<EventLoop> makeEventLoop(const std::string &backend, Shard &shard) {
+    std::unique_ptr<EventLoop> res;
+    if (backend == "io_uring") {
+        res = std::make_unique<UringLoop>(shard.sock, shard.event_fd, shard.io);
+    } else {
+        res = std::make_unique<PollLoop>(shard.sock, shard.event_fd, shard.io);
+    }
+    res->limitQueues(shard.queue_limit, shard.queue_policy);
+    return res;
+}
 
-                    if (timerfd_settime(timer_fd, 0, &timerValue, nullptr) < 0)
-                        syserr("timerfd_settime");
+void server_routine(long freq, Shard &shard, const std::string &backend, int stats_interval,
+                    CatchUpPolicy policy) {
+    std::unique_ptr<EventLoop> loop = makeEventLoop(backend, shard);
+    shard.sender.init(loop.get(), &shard.io);
 
-                }
-            }
+    for (auto &room: shard.rooms) {
+        room->timer_id = loop->addTimer(freq, policy);
+    }
 
-            while (true) {
-                len = game.buildDatagram(mess.next_expected_event_no, buffer);
-                if (len <= 0) break;
+    ShardHandler handler(shard, *loop, stats_interval);
+    loop->run(handler);
 
-                snd_addr_len = sendto(p[1].fd, buffer, len, 0,
-                                      (struct sockaddr *) &client_address, (socklen_t) sizeof(client_address));
+    if (close(shard.sock) < 0)
+        syserr("close");
+}
 
-                if (snd_addr_len != len) {
-#ifdef DEBUG
-                    std::cout << "Error on sending data to client " << errno << " " << snd_addr_len << " " << len << std::endl;
-#endif
-                    break;
-                }
-            }
+/// Runs shard @p shard in the current thread, pinned to core @p core (if non-negative).
+void shard_routine(long freq, Shard &shard, const std::string &backend, int stats_interval,
+                   CatchUpPolicy policy, int core) {
+    if (core >= 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+            std::cout << "Could not pin shard " << shard.id << " to core " << core << std::endl;
         }
+    }
+
+    server_routine(freq, shard, backend, stats_interval, policy);
+}
 
+/// Replays games recorded in @p path (only game @p game, if non-negative) instead of hosting rooms.
+void replay_routine(const std::string &port, const std::string &path, long game, long freq, CatchUpPolicy policy,
+                    const std::string &backend, uint64_t per_client, int stats_interval) {
+    Recording recording(path);
+    if (game >= (long) recording.size()) {
+        syserr("The recording has " + std::to_string(recording.size()) + " games, there is no game " +
+               std::to_string(game) + ".");
     }
 
-    if (close(p[1].fd) < 0)
+    Shard shard(0);
+    shard.sock = initUDPSocket(port.c_str(), false);
+    std::unique_ptr<EventLoop> loop = makeEventLoop(backend, shard);
+    shard.sender.init(loop.get(), &shard.io);
+    loop->addTimer(freq, policy);
+
+    std::cout << "Replaying " << recording.size() << " games of " << path << " on port: " << port << std::endl;
+    ReplayHandler handler(recording, shard.sender, shard.io, game, per_client, (int) (SECOND / freq),
+                          stats_interval);
+    loop->run(handler);
+
+    if (close(shard.sock) < 0)
         syserr("close");
 }
 
 int main(int argc, char *argv[]) {
     std::string port    = "2021";
+    std::string backend = "poll";
+    MovementMode movement = MovementMode::FIXED;
+    CatchUpPolicy policy  = CatchUpPolicy::SPREAD;
+    QueuePolicy queue_policy = QueuePolicy::DROP_OLDEST;
+    CatchUpBudget catch_up_budget = {DEFAULT_CLIENT_CATCH_UP, DEFAULT_ROOM_CATCH_UP};
 
     uint32_t seed            = time(nullptr);
     int turning_speed        = 6;
     long rounds_per_sec      = 50;
     int width                = 640;
     int height               = 480;
+    int num_rooms            = 1;
+    int num_threads          = 1;
+    int max_clients          = V1_MAX_CLIENTS;
+    int stats_interval       = 0;
+    int queue_limit          = DEFAULT_CLIENT_QUEUE;
+    std::string metrics_socket;
+    std::string metrics_dump;
+    std::string record_dir;
+    std::string replay_path;
+    std::string journal_dir;
+    std::string group_spec;
+    long replay_game         = -1;
 
     int c;
 
-    while ((c = getopt(argc, argv, "p:s:t:v:w:h:")) != -1)
+    while ((c = getopt(argc, argv, "p:s:t:v:w:h:r:c:S:e:m:b:B:M:D:T:C:R:P:G:J:g:q:Q:")) != -1)
         switch (c) {
             case 'p':
                 if (parseNumericParam(optarg) < 0) {
@@ -277,12 +396,86 @@ int main(int argc, char *argv[]) {
             case 'h':
                 height = parseNumericParam(optarg);
                 break;
+            case 'r':
+                num_rooms = parseNumericParam(optarg);
+                break;
+            case 'c':
+                num_threads = parseNumericParam(optarg);
+                break;
+            case 'C':
+                max_clients = parseNumericParam(optarg);
+                break;
+            case 'S':
+                stats_interval = parseNumericParam(optarg);
+                break;
+            case 'e':
+                backend = (std::string) optarg;
+                break;
+            case 'b':
+                catch_up_budget.per_client = parseNumericParam(optarg);
+                break;
+            case 'B':
+                catch_up_budget.global = parseNumericParam(optarg);
+                break;
+            case 'T':
+                if (std::string(optarg) == "burst") {
+                    policy = CatchUpPolicy::BURST;
+                } else if (std::string(optarg) == "spread") {
+                    policy = CatchUpPolicy::SPREAD;
+                } else if (std::string(optarg) == "drop") {
+                    policy = CatchUpPolicy::DROP;
+                } else {
+                    syserr("Provided tick policy is unknown (should be burst, spread or drop).");
+                }
+                break;
+            case 'q':
+                queue_limit = parseNumericParam(optarg);
+                break;
+            case 'Q':
+                if (std::string(optarg) == "oldest") {
+                    queue_policy = QueuePolicy::DROP_OLDEST;
+                } else if (std::string(optarg) == "newest") {
+                    queue_policy = QueuePolicy::DROP_NEWEST;
+                } else {
+                    syserr("Provided queue policy is unknown (should be oldest or newest).");
+                }
+                break;
+            case 'M':
+                metrics_socket = (std::string) optarg;
+                break;
+            case 'D':
+                metrics_dump = (std::string) optarg;
+                break;
+            case 'R':
+                record_dir = (std::string) optarg;
+                break;
+            case 'P':
+                replay_path = (std::string) optarg;
+                break;
+            case 'J':
+                journal_dir = (std::string) optarg;
+                break;
+            case 'g':
+                group_spec = (std::string) optarg;
+                break;
+            case 'G':
+                replay_game = parseNumericParam(optarg);
+                break;
+            case 'm':
+                if (std::string(optarg) == "fixed") {
+                    movement = MovementMode::FIXED;
+                } else if (std::string(optarg) == "compat") {
+                    movement = MovementMode::COMPAT;
+                } else {
+                    syserr("Provided movement mode is unknown (should be fixed or compat).");
+                }
+                break;
             default:
-                syserr("Usage: ./screen-worms-server [-p n] [-s n] [-t n] [-v n] [-w n] [-h n]");
+                syserr(USAGE);
         }
 
     if (width <= 0 || width > MAX_BOARD_DIM || height <= 0 || height > MAX_BOARD_DIM) {
-        syserr("Provided board size is unreasonable (width and height should be between 1 and 50000).");
+        syserr("Provided board size is unreasonable (width and height should be between 1 and 65536).");
     }
 
     if (turning_speed > 90 || turning_speed < -90 || turning_speed == 0) {
@@ -293,16 +486,116 @@ int main(int argc, char *argv[]) {
         syserr("Provided number of rounds per second is unreasonable (should be between 1 and 500).");
     }
 
+    if (num_rooms <= 0 || num_rooms > MAX_ROOMS) {
+        syserr("Provided number of rooms is unreasonable (should be between 1 and 1000).");
+    }
+
+    if (num_threads <= 0 || num_threads > num_rooms) {
+        syserr("Provided number of threads is unreasonable (should be between 1 and the number of rooms).");
+    }
+
+    if (max_clients < 2 || max_clients > MAX_CLIENTS) {
+        syserr("Provided number of clients of a room is unreasonable (should be between 2 and 8192).");
+    }
+
+    if (stats_interval < 0) {
+        syserr("Interval of statistics cannot be negative.");
+    }
+
+    if (catch_up_budget.per_client < MAX_DATAGRAM_SIZE || catch_up_budget.global < catch_up_budget.per_client) {
+        syserr("Provided catch-up budgets are unreasonable (should be at least 548 bytes per tick "
+               "for a client and at least as much for a room).");
+    }
+
+    if (backend != "poll" && backend != "io_uring") {
+        syserr("Provided event loop backend is unknown (should be poll or io_uring).");
+    }
+
+    if (queue_limit < 0 || queue_limit > (int) MAX_QUEUED_DATAGRAMS) {
+        syserr("Provided length of outbound queues is unreasonable (should be between 0 and 65536).");
+    }
+
     if (optind < argc) {
-        syserr("Non-option argument. Usage: ./screen-worms-server [-p n] [-s n] [-t n] [-v n] [-w n] [-h n]");
+        syserr(std::string("Non-option argument. ") + USAGE);
     }
 
-    Random::set(seed);
-    Game game{turning_speed, width, height};
+    if (!group_spec.empty() && num_rooms > 1) {
+        syserr("A multicast group can be used only by a single room (games of rooms would mix in it).");
+    }
+
+    if (replay_game >= 0 && replay_path.empty()) {
+        syserr("A game to replay can be chosen only with a recording to replay.");
+    }
+
+    if (!replay_path.empty()) {
+        signal(SIGPIPE, SIG_IGN);
+        replay_routine(port, replay_path, replay_game, SECOND / rounds_per_sec, policy, backend,
+                       catch_up_budget.per_client, stats_interval);
+        return 0;
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<Room *> all_rooms;
+    struct sockaddr_in6 group{};
+    if (!group_spec.empty()) {
+        group = parseGroup(group_spec);
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        shards.push_back(std::make_unique<Shard>(i));
+        shards.back()->sock = initUDPSocket(port.c_str(), num_threads > 1);
+        shards.back()->all_rooms = &all_rooms;
+        shards.back()->queue_limit = queue_limit;
+        shards.back()->queue_policy = queue_policy;
+        if (!group_spec.empty()) {
+            setMulticastSender(shards.back()->sock, group);
+            shards.back()->group = &group;
+        }
+    }
+
+    // rooms are dealt to shards in turns, room i uses seed + i
+    for (int i = 0; i < num_rooms; i++) {
+        Shard *shard = shards[i % num_threads].get();
+        shard->rooms.push_back(std::make_unique<Room>(shard, turning_speed, width, height, seed + i, movement,
+                                                         max_clients, catch_up_budget));
+        all_rooms.push_back(shard->rooms.back().get());
+        if (!record_dir.empty()) {
+            shard->rooms.back()->recorder = std::make_unique<GameRecorder>(
+                    record_dir + "/room-" + std::to_string(i) + ".rec", seed + i);
+        }
+        if (!journal_dir.empty()) {
+            shard->rooms.back()->journal = std::make_unique<InputJournal>(
+                    journal_dir + "/room-" + std::to_string(i) + ".journal", seed + i);
+            // the journal takes the input stream, whether clients stream it or not
+            shard->rooms.back()->game.keep_inputs = true;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    MetricsRegistry metrics(num_threads);
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!metrics_socket.empty() || !metrics_dump.empty()) {
+        for (auto &shard: shards) {
+            shard->metrics = &metrics;
+        }
+        exporter = std::make_unique<MetricsExporter>(metrics, metrics_socket, metrics_dump);
+        std::thread(&MetricsExporter::run, exporter.get()).detach();
+    }
 
     std::cout << "Listening on port: " << port << std::endl;
 
-    server_routine(SECOND /  rounds_per_sec, port.c_str(), game);
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back(shard_routine, SECOND / rounds_per_sec, std::ref(*shards[i]),
+                             backend, stats_interval, policy, (int) (i % num_cores));
+    }
+    shard_routine(SECOND / rounds_per_sec, *shards[0], backend, stats_interval, policy, num_threads > 1 ? 0 : -1);
+
+    for (auto &thread: threads) {
+        thread.join();
+    }
 
     return 0;
-}
\ No newline at end of file
+}
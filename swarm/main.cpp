@@ -0,0 +1,453 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Load generator: many client sessions in one process with one event loop.
+ * Every session has its own UDP socket (so that the server sees a separate
+ * client), handles the protocol with ClientState as the client does and is
+ * steered by a bot instead of a GUI. Reports event lag of sessions, records
+ * out of order, duplicated or failing the control sum and latency of
+ * responses of the server to requests for missing events. With a multicast
+ * group, datagrams received from it by one socket are passed to every
+ * session, as if each of them had joined the group.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/poll.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../protocol.hpp"
+#include "../multicast.hpp"
+#include "../client/ClientState.hpp"
+#include "../server/Histogram.hpp"
+#include "../server/misc.hpp"
+
+#define FREQ          30'000'000
+#define BUFFER_SIZE   600
+
+/// How a bot chooses turn directions.
+enum class Policy {STRAIGHT, RIGHT, LEFT, RANDOM, WALL};
+
+struct Session {
+    ClientState state;
+    const std::string name;
+    const Policy policy;
+    int fd;
+
+    /// board and the last pixel of the player, known from lines for GUI
+    uint32_t width, height;
+    int64_t x, y;
+
+    /// the oldest request for a missing event not answered yet
+    uint32_t pending_event;
+    int64_t pending_time;
+
+    uint64_t datagrams_in, datagrams_out, dropped;
+    /// events between the next expected one and the newest received, sampled every send
+    Histogram lag;
+
+    Session(const std::string &name_p, uint64_t session_id, uint8_t capabilities, Policy policy_p) :
+            state(name_p, session_id, capabilities),
+            name(name_p),
+            policy(policy_p),
+            fd(-1),
+            width(0),
+            height(0),
+            x(-1),
+            y(-1),
+            pending_event(0),
+            pending_time(-1),
+            datagrams_in(0),
+            datagrams_out(0),
+            dropped(0) {}
+};
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Policy parsePolicy(const std::string &name) {
+    if (name == "straight") return Policy::STRAIGHT;
+    if (name == "right") return Policy::RIGHT;
+    if (name == "left") return Policy::LEFT;
+    if (name == "random") return Policy::RANDOM;
+    if (name == "wall") return Policy::WALL;
+    syserr("Provided policy is unknown (should be straight, right, left, random or wall).");
+    return Policy::STRAIGHT;
+}
+
+/// Opens a non-blocking UDP socket connected to the server for every session.
+void connectSessions(std::vector<std::unique_ptr<Session>> &sessions, const char *port, const char *server) {
+    struct addrinfo addr_hints{}, *addr_result;
+
+    addr_hints.ai_family = AF_UNSPEC; // IPv4 or v6
+    addr_hints.ai_socktype = SOCK_DGRAM;
+    addr_hints.ai_protocol = IPPROTO_UDP;
+
+    if (getaddrinfo(server, port, &addr_hints, &addr_result) != 0) {
+        syserr("getaddrinfo");
+    }
+
+    for (auto &session: sessions) {
+        session->fd = socket(addr_result->ai_family, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+        if (session->fd < 0) syserr("Failed to open UDP socket (too many sessions for the limit of files?).");
+
+        if (connect(session->fd, addr_result->ai_addr, addr_result->ai_addrlen) != 0) {
+            syserr("connect on UDP socket (with server)");
+        }
+    }
+
+    freeaddrinfo(addr_result);
+}
+
+/// Takes lines for GUI of @p session, remembering the board and the position of its player.
+void takeLines(Session &session) {
+    while (!session.state.events.empty()) {
+        std::istringstream line(session.state.events.front());
+        session.state.events.pop();
+
+        std::string type;
+        line >> type;
+        if (type == "NEW_GAME") {
+            line >> session.width >> session.height;
+            session.x = session.y = -1;
+        } else if (type == "PIXEL") {
+            int64_t x, y;
+            std::string player;
+            line >> x >> y >> player;
+            if (player == session.name) {
+                session.x = x;
+                session.y = y;
+            }
+        }
+    }
+}
+
+/// Chooses the turn direction of @p session before sending a datagram.
+void steer(Session &session, Random &random) {
+    switch (session.policy) {
+        case Policy::STRAIGHT:
+            session.state.setTurn(0);
+            break;
+        case Policy::RIGHT:
+            session.state.setTurn(1);
+            break;
+        case Policy::LEFT:
+            session.state.setTurn(2);
+            break;
+        case Policy::RANDOM: {
+            uint32_t r = random.rand();
+            if (r % 10 == 0) {
+                session.state.setTurn(r / 10 % 3);
+            }
+            break;
+        }
+        case Policy::WALL: {
+            // straight ahead, circling to the right near edges of the board
+            int64_t margin_x = std::max<int64_t>(10, session.width / 10);
+            int64_t margin_y = std::max<int64_t>(10, session.height / 10);
+            bool near = session.x >= 0 && (session.x < margin_x || session.x >= session.width - margin_x ||
+                                           session.y < margin_y || session.y >= session.height - margin_y);
+            session.state.setTurn(near || session.x < 0 ? 1 : 0);
+            break;
+        }
+    }
+}
+
+void sendRequest(Session &session, Random &random, int64_t now_ns) {
+    char buffer[BUFFER_SIZE];
+
+    steer(session, random);
+    ssize_t len = session.state.generateServerMessage(buffer);
+    if (write(session.fd, buffer, len) != len) {
+#ifdef DEBUG
+        std::cout << "UDP write unsuccessful" << std::endl;
+#endif
+        return;
+    }
+    session.datagrams_out++;
+
+    // a snapshot makes events known without receiving them
+    uint32_t next = session.state.nextExpected();
+    if (session.state.stats.events_seen > 0) {
+        session.lag.record(std::max(session.state.stats.events_seen, next) - next);
+    }
+    if (session.pending_time < 0 && next < session.state.stats.events_seen) {
+        session.pending_event = next;
+        session.pending_time = now_ns;
+    }
+}
+
+/// Passes a received datagram to @p session, unless it is dropped on purpose.
+void deliver(Session &session, const char *buffer, int len, Random &random, uint32_t loss_percent) {
+    if (random.rand() % 100 < loss_percent) {
+        session.dropped++;
+        return;
+    }
+    session.datagrams_in++;
+    session.state.parseMessage(buffer, len);
+}
+
+/// Takes what @p session has received: lines for GUI and answers to its requests.
+void settle(Session &session, Histogram &latency, int64_t now_ns) {
+    takeLines(session);
+
+    if (session.pending_time >= 0) {
+        uint32_t next = session.state.nextExpected();
+        if (next > session.pending_event) {
+            latency.record(now_ns - session.pending_time);
+            session.pending_time = -1;
+        } else if (next < session.pending_event) {
+            // a new game, the event asked for will never come
+            session.pending_time = -1;
+        }
+    }
+}
+
+void receive(Session &session, Random &random, uint32_t loss_percent, Histogram &latency, int64_t now_ns) {
+    char buffer[BUFFER_SIZE];
+    ssize_t len;
+
+    while ((len = read(session.fd, buffer, sizeof(buffer))) >= 0) {
+        deliver(session, buffer, (int) len, random, loss_percent);
+    }
+    settle(session, latency, now_ns);
+}
+
+/// Passes datagrams of the multicast group received by @p fd from @p sources (see serverSources) to every session.
+void receiveGroup(std::vector<std::unique_ptr<Session>> &sessions, int fd, const std::vector<struct sockaddr_in6> &sources,
+                  Random &random, uint32_t loss_percent, Histogram &latency, int64_t now_ns) {
+    char buffer[BUFFER_SIZE];
+    ssize_t len;
+
+    while ((len = receiveFromServer(fd, buffer, sizeof(buffer), sources)) >= 0) {
+        for (auto &session: sessions) {
+            deliver(*session, buffer, (int) len, random, loss_percent);
+        }
+    }
+    for (auto &session: sessions) {
+        settle(*session, latency, now_ns);
+    }
+}
+
+void report(const std::vector<std::unique_ptr<Session>> &sessions, const Histogram &latency,
+            double seconds, bool verbose) {
+    Histogram lag;
+    uint64_t in = 0, out = 0, dropped = 0, out_of_order = 0, duplicates = 0, crc_failures = 0, silent = 0;
+    for (auto &session: sessions) {
+        const ClientState::Stats &stats = session->state.stats;
+        in += session->datagrams_in;
+        out += session->datagrams_out;
+        dropped += session->dropped;
+        out_of_order += stats.out_of_order;
+        duplicates += stats.duplicates;
+        crc_failures += stats.crc_failures;
+        silent += session->datagrams_in + session->dropped == 0;
+        lag.record(session->lag.percentile(0.99));
+
+        if (verbose) {
+            std::cout << "    " << (session->name.empty() ? "(observer)" : session->name)
+                      << ": in " << session->datagrams_in << ", out " << session->datagrams_out
+                      << ", lag mean " << session->lag.mean() << " p99 " << session->lag.percentile(0.99)
+                      << " max " << session->lag.max() << ", out of order " << stats.out_of_order
+                      << ", duplicates " << stats.duplicates << ", crc failures " << stats.crc_failures
+                      << std::endl;
+        }
+    }
+
+    std::cout << sessions.size() << " sessions, " << seconds << " s, " << silent << " never answered" << std::endl
+              << "    datagrams out " << (double) out / seconds << "/s, in " << (double) in / seconds
+              << "/s (" << dropped << " dropped on purpose)" << std::endl
+              << "    event lag p99 of sessions: median " << lag.percentile(0.5) << ", p90 "
+              << lag.percentile(0.9) << ", max " << lag.max() << " events" << std::endl
+              << "    records out of order " << out_of_order << ", duplicates " << duplicates
+              << ", crc failures " << crc_failures << std::endl
+              << "    response latency (" << latency.count() << " requests for missing events): p50 "
+              << (double) latency.percentile(0.5) / 1e6 << " ms, p90 " << (double) latency.percentile(0.9) / 1e6
+              << " ms, p99 " << (double) latency.percentile(0.99) / 1e6 << " ms, max "
+              << (double) latency.max() / 1e6 << " ms" << std::endl;
+}
+
+void poll_routine(std::vector<std::unique_ptr<Session>> &sessions, int duration, uint32_t loss_percent,
+                  bool verbose, int group_fd) {
+    std::vector<struct pollfd> p(sessions.size() + 2);
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (timer_fd < 0)
+        syserr("failed to create timer fd");
+
+    struct itimerspec timerValue{};
+    timerValue.it_value.tv_nsec = FREQ;
+    timerValue.it_interval.tv_nsec = FREQ;
+    if (timerfd_settime(timer_fd, 0, &timerValue, nullptr) < 0)
+        syserr("could not start timer");
+
+    p[0].fd = timer_fd;
+    p[0].events = POLLIN;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        p[i + 1].fd = sessions[i]->fd;
+        p[i + 1].events = POLLIN;
+    }
+    // poll skips a negative fd
+    p.back().fd = group_fd;
+    p.back().events = POLLIN;
+    std::vector<struct sockaddr_in6> group_sources;
+    if (group_fd >= 0) {
+        group_sources = serverSources(sessions[0]->fd);
+    }
+
+    Random random(time(nullptr));
+    Histogram latency;
+    int64_t start = now();
+    int64_t end = start + (int64_t) duration * 1'000'000'000;
+
+    while (now() < end) {
+        for (auto &fd: p) {
+            fd.revents = 0;
+        }
+        if (poll(p.data(), p.size(), -1) <= 0) {
+            syserr("poll interrupted");
+        }
+        int64_t now_ns = now();
+
+        if (p[0].revents & (POLLIN | POLLERR)) {
+            int64_t timersElapsed = 0;
+            read(p[0].fd, &timersElapsed, 8);
+            if (timersElapsed > 0) {
+                for (auto &session: sessions) {
+                    sendRequest(*session, random, now_ns);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (p[i + 1].revents & (POLLIN | POLLERR)) {
+                receive(*sessions[i], random, loss_percent, latency, now_ns);
+            }
+        }
+
+        if (p.back().revents & POLLIN) {
+            receiveGroup(sessions, group_fd, group_sources, random, loss_percent, latency, now_ns);
+        }
+    }
+
+    report(sessions, latency, (double) (now() - start) / 1e9, verbose);
+
+    for (auto &session: sessions) {
+        close(session->fd);
+    }
+    if (group_fd >= 0) {
+        close(group_fd);
+    }
+    close(timer_fd);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t session_id = time(nullptr);
+    int c;
+
+    if (argc < 2) {
+        syserr("Usage: ./screen-worms-swarm game_server [-p n] [-n sessions] [-o observers] [-b policies] "
+               "[-d seconds] [-l percent] [-s] [-u] [-w] [-v] [-g group]");
+    }
+
+    std::string game_server = argv[1];
+    std::string port_server = "2021";
+    int num_sessions = 100;
+    int num_observers = 0;
+    std::vector<Policy> policies = {Policy::WALL};
+    int duration = 10;
+    int loss_percent = 0;
+    uint8_t capabilities = 0;
+    bool verbose = false;
+    std::string group;
+
+    while ((c = getopt(argc - 1, argv + 1, "p:n:o:b:d:l:suwvg:")) != -1)
+        switch (c) {
+            case 'p':
+                if (parseNumericParam(optarg) < 0) {
+                    syserr("Port number cannot be negative.");
+                }
+                port_server = (std::string) optarg;
+                break;
+            case 'n':
+                num_sessions = parseNumericParam(optarg);
+                break;
+            case 'o':
+                num_observers = parseNumericParam(optarg);
+                break;
+            case 'b': {
+                policies.clear();
+                std::istringstream list(optarg);
+                std::string name;
+                while (std::getline(list, name, ',')) {
+                    policies.push_back(parsePolicy(name));
+                }
+                break;
+            }
+            case 'd':
+                duration = parseNumericParam(optarg);
+                break;
+            case 'l':
+                loss_percent = parseNumericParam(optarg);
+                break;
+            case 's':
+                capabilities |= CAPABILITY_SNAPSHOT;
+                break;
+            case 'u':
+                capabilities |= CAPABILITY_INPUTS;
+                break;
+            case 'w':
+                capabilities |= CAPABILITY_WIDE;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'g':
+                group = (std::string) optarg;
+                capabilities |= CAPABILITY_MULTICAST;
+                break;
+            default:
+                syserr("wrong argument");
+        }
+
+    if (num_sessions <= 0 || num_sessions > 100000 || num_observers < 0 || num_observers > num_sessions || duration <= 0 ||
+        loss_percent < 0 || loss_percent > 100 || policies.empty()) {
+        syserr("Parameters are unreasonable (observers are some of the sessions, loss is a percentage).");
+    }
+
+    // players get policies from the list in turns, observers are the last sessions;
+    // names differ from those of other swarms, which may still be connected
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::string prefix = "s" + std::to_string(getpid() % 100000) + "-";
+    for (int i = 0; i < num_sessions; i++) {
+        bool observer = i >= num_sessions - num_observers;
+        sessions.push_back(std::make_unique<Session>(observer ? "" : prefix + std::to_string(i), session_id,
+                                                     capabilities, policies[i % policies.size()]));
+    }
+
+    connectSessions(sessions, port_server.c_str(), game_server.c_str());
+    int group_fd = group.empty() ? -1 : joinGroup(parseGroup(group));
+    poll_routine(sessions, duration, loss_percent, verbose, group_fd);
+
+    return 0;
+}
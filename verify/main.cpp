@@ -0,0 +1,244 @@
+/*
+ * Author:   Witold Drzewakowski
+ * Date:     2021-05-25
+ * University of Warsaw
+ */
+
+/*
+ * Plays the games of an input journal again with the code of the server
+ * (Player, playRound), checks that players have been placed as the random
+ * number generator seeded with game_id places them and that the state of
+ * every game matches the checksums of the journal, and regenerates the
+ * events of the games. They are compared byte by byte with the games of a
+ * recording (-r) and written to a recording (-o), which can be replayed by
+ * the server. Reports rounds re-simulated per second, so that games played
+ * in production can serve as a benchmark. Exits with status 1 if any game
+ * does not agree.
+ *
+ * Usage: ./screen-worms-verify journal [-r recording] [-o recording] [-q]
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../server/Journal.hpp"
+#include "../server/Recording.hpp"
+
+#define USAGE "Usage: ./screen-worms-verify journal [-r recording] [-o recording] [-q]"
+
+/// Outcome of playing a game of the journal again.
+struct Verdict {
+    bool ok = true;
+    std::string error;
+    uint32_t checksums = 0;
+    double seconds = 0;
+};
+
+/**
+ * Plays @p game on @p board, the events are left in board->events.
+ * @param recorder      if not null, the events are recorded after every round.
+ */
+Verdict resimulate(const JournalGame &game, const board_ptr &board, GameRecorder *recorder) {
+    Verdict res;
+    auto fail = [&res](const std::string &error) {
+        if (res.ok) {
+            res.ok = false;
+            res.error = error;
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+
+    size_t names_size = 0;
+    for (auto &name: game.names) {
+        names_size += name.size() + 1;
+    }
+    board->prepareNewGame(game.players, isWideGame(game.players, names_size));
+    board->events.pushNewGame(game.names, game.max_x, game.max_y);
+    if (recorder != nullptr) {
+        recorder->begin(game.game_id, *board, game.names);
+    }
+
+    // the server has drawn game_id and then positions of players
+    Random random(game.game_id);
+    random.rand();
+
+    std::vector<player_ptr> players;
+    for (uint16_t i = 0; i < game.players; i++) {
+        const char *p = game.spawn + 10 * i;
+        uint32_t x = get_uint32(p);
+        uint32_t y = get_uint32(p + 4);
+        int direction = get_uint8(p + 8) * 256 + get_uint8(p + 9);
+        if (x >= game.max_x || y >= game.max_y || direction >= 360) {
+            fail("player " + std::to_string(i) + " placed out of the board");
+            return res;
+        }
+
+        uint32_t expected_x = random.rand() % game.max_x;
+        uint32_t expected_y = random.rand() % game.max_y;
+        int expected_direction = (int) (random.rand() % 360);
+        if (x != expected_x || y != expected_y || direction != expected_direction) {
+            fail("player " + std::to_string(i) + " not placed as game_id determines");
+        }
+
+        players.push_back(std::make_shared<Player>(nullptr, board, i, game.movement));
+        players.back()->spawn(x, y, direction);
+    }
+
+    std::vector<uint8_t> turns(game.players);
+    std::vector<char> checksum_state;
+    bool over = false;
+    for (uint32_t round = 0; round < game.rounds && res.ok; round++) {
+        if (over) {
+            fail("game over before round " + std::to_string(round + 1));
+            break;
+        }
+        for (uint16_t i = 0; i < game.players; i++) {
+            turns[i] = game.turn(round, i);
+        }
+        over = playRound(players, *board, game.turning_speed, turns.data());
+        if (recorder != nullptr) {
+            recorder->round(board->events);
+        }
+
+        if (!over && (round + 1) % CHECKSUM_INTERVAL == 0) {
+            uint32_t i = (round + 1) / CHECKSUM_INTERVAL - 1;
+            if (i >= game.checksums || stateChecksum(players, *board, checksum_state) != game.checksum(i)) {
+                fail("state differs from the checksum after round " + std::to_string(round + 1));
+            }
+            res.checksums++;
+        }
+    }
+
+    if (res.ok && !over) {
+        fail("game not over after its " + std::to_string(game.rounds) + " rounds");
+    }
+    if (res.ok && res.checksums != game.checksums) {
+        fail("journal has " + std::to_string(game.checksums) + " checksums, " +
+             std::to_string(res.checksums) + " expected");
+    }
+    if (recorder != nullptr && res.ok) {
+        recorder->finish();
+    }
+
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+/// Compares events of @p log with those of @p recorded, @return description of the first difference.
+std::string compareEvents(const EventLog &log, const RecordedGame &recorded) {
+    if (log.size() != recorded.header->events) {
+        return std::to_string(log.size()) + " events regenerated, " +
+               std::to_string(recorded.header->events) + " recorded";
+    }
+    for (uint32_t i = 0; i < log.size(); i++) {
+        uint32_t len = log.totalSize(i);
+        if (len != recorded.offsets[i + 1] - recorded.offsets[i] ||
+            std::memcmp(log.data(i), recorded.events + recorded.offsets[i], len) != 0) {
+            return "event " + std::to_string(i) + " differs from the recording";
+        }
+    }
+    return "";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        syserr(USAGE);
+    }
+
+    std::string journal_path = argv[1];
+    std::string recording_path;
+    std::string output_path;
+    bool quiet = false;
+    int c;
+
+    while ((c = getopt(argc - 1, argv + 1, "r:o:q")) != -1)
+        switch (c) {
+            case 'r':
+                recording_path = (std::string) optarg;
+                break;
+            case 'o':
+                output_path = (std::string) optarg;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                syserr(USAGE);
+        }
+
+    JournalFile journal(journal_path);
+
+    std::unique_ptr<Recording> recording;
+    std::unordered_map<uint32_t, size_t> recorded;
+    if (!recording_path.empty()) {
+        recording = std::make_unique<Recording>(recording_path);
+        for (size_t i = 0; i < recording->size(); i++) {
+            recorded[get_uint32((const char *) &recording->game(i).header->game_id)] = i;
+        }
+    }
+
+    std::unique_ptr<GameRecorder> output;
+    if (!output_path.empty() && !journal.all().empty()) {
+        output = std::make_unique<GameRecorder>(output_path, journal.all().front().seed);
+    }
+
+    uint64_t rounds = 0, failed = 0, compared = 0, event_bytes = 0;
+    double seconds = 0;
+    for (size_t g = 0; g < journal.all().size(); g++) {
+        const JournalGame &game = journal.all()[g];
+        auto board = std::make_shared<Board>(game.max_x, game.max_y);
+        Verdict verdict = resimulate(game, board, output.get());
+        rounds += game.rounds;
+        seconds += verdict.seconds;
+        event_bytes += board->events.bytesUsed();
+
+        std::string comparison;
+        if (verdict.ok && recording != nullptr) {
+            auto it = recorded.find(game.game_id);
+            if (it == recorded.end()) {
+                comparison = ", not in the recording";
+            } else {
+                std::string difference = compareEvents(board->events, recording->game(it->second));
+                if (difference.empty()) {
+                    comparison = ", events identical to the recording";
+                    compared++;
+                } else {
+                    verdict.ok = false;
+                    verdict.error = difference;
+                }
+            }
+        }
+
+        failed += !verdict.ok;
+        if (!quiet || !verdict.ok) {
+            char id[16];
+            std::snprintf(id, sizeof(id), "%08x", game.game_id);
+            std::cout << "game " << g << " (" << id << "): " << game.players << " players, " << game.rounds
+                      << " rounds, " << verdict.checksums << " checksums, " << board->events.size() << " events, "
+                      << game.size << " bytes of journal, " << board->events.bytesUsed() << " of events"
+                      << (verdict.ok ? comparison : ": FAILED, " + verdict.error) << std::endl;
+        }
+    }
+
+    std::cout << journal.all().size() << " games, " << rounds << " rounds re-simulated at "
+              << (seconds > 0 ? (double) rounds / seconds : 0) << " rounds/s, " << failed << " failed";
+    if (recording != nullptr) {
+        std::cout << ", " << compared << " identical to the recording";
+    }
+    std::cout << std::endl
+              << "journal " << journal.bytes() << " bytes, events " << event_bytes << " bytes ("
+              << (journal.bytes() > 0 ? (double) event_bytes / journal.bytes() : 0) << " times more)" << std::endl;
+    if (journal.isTruncated()) {
+        std::cout << "the last game of the journal is incomplete and has been skipped" << std::endl;
+    }
+
+    return failed == 0 ? 0 : 1;
+}